@@ -14,7 +14,8 @@ class AppDelegate: UIResponder, UIApplicationDelegate {
 
     func application(_ application: UIApplication, didFinishLaunchingWithOptions launchOptions: [UIApplication.LaunchOptionsKey: Any]?) -> Bool {
         // Override point for customization after application launch.
-        gst_ios_init()
+        // Initialize GStreamer in the background; GStreamerBackend waits for it
+        gst_ios_init_async(nil)
         return true
     }
 
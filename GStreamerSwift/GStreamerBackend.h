@@ -1,26 +1,300 @@
 #import <Foundation/Foundation.h>
 #import "GStreamerBackendDelegate.h"
+#import "GStreamerWebRTCSignalling.h"
+#import "GStreamerSegmentCache.h"
 #import <UIKit/UIKit.h>
+#import <CoreMedia/CoreMedia.h>
+#import <CoreVideo/CoreVideo.h>
 
+/* Latency profiles. The default profile keeps the playbin and rtspsrc defaults
+ * (2000 ms jitterbuffer, clock synchronised rendering). The low latency profiles
+ * shrink the jitterbuffer, drop packets that arrive too late and stop the video
+ * sink from waiting for, or rendering, late buffers. */
+typedef NS_ENUM(NSInteger, GStreamerLatencyProfile) {
+    GStreamerLatencyProfileDefault,
+    GStreamerLatencyProfileLow,
+    GStreamerLatencyProfileUltraLow
+};
+
+/* Lower transport used for RTSP sessions */
+typedef NS_ENUM(NSInteger, GStreamerTransport) {
+    GStreamerTransportAuto,  /* Let rtspsrc try UDP first and fall back to TCP */
+    GStreamerTransportUDP,
+    GStreamerTransportTCP    /* RTP interleaved in the RTSP connection */
+};
+
+/* How frames are rendered. Smooth shows every decoded frame in order. In
+ * LatestFrame the queue in front of the sink holds a single frame, which for
+ * live streams is dropped when a newer one arrives behind it, the sink drops
+ * frames more than a few ms late, and a lost clock is replaced by the system
+ * clock for good. Meant for head tracked content, where a stale frame is worse
+ * than a skipped one. */
+typedef NS_ENUM(NSInteger, GStreamerRenderMode) {
+    GStreamerRenderModeSmooth,
+    GStreamerRenderModeLatestFrame
+};
+
+/* Connection mode of SRT sources. Default keeps the mode of the srt:// URI
+ * (caller, unless it has no host or sets ?mode=listener). */
+typedef NS_ENUM(NSInteger, GStreamerSRTMode) {
+    GStreamerSRTModeDefault,
+    GStreamerSRTModeCaller,   /* Connect to the sender */
+    GStreamerSRTModeListener  /* Wait for the sender to connect to us */
+};
+
+/* How the video is decoded. Auto lets playbin pick decoders by rank. Hardware
+ * builds an explicit RTSP pipeline pinned to VideoToolbox (vtdec_hw) which hands
+ * GL memory straight to the sink, and only falls back to a software decoder if
+ * the hardware decoder fails to initialise. */
+typedef NS_ENUM(NSInteger, GStreamerDecodeMode) {
+    GStreamerDecodeModeAuto,
+    GStreamerDecodeModeHardware
+};
+
+/* What is done with the audio of a stream. Default leaves it to playbin, which
+ * plays it, while the hardware pipeline ignores it. None does not even set it
+ * up: rtspsrc only SETUPs the video streams and playbin decodes no audio, so
+ * there is no audio to download, decode, or hand the pipeline clock to.
+ * LowLatency plays it with a short audio sink buffer, in both decode modes,
+ * without making the audio sink the pipeline clock, and through a
+ * webrtcechoprobe: a talk-back capture pipeline with webrtcdsp
+ * probe=GStreamerEchoProbeName cancels the echo of the stream. */
+typedef NS_ENUM(NSInteger, GStreamerAudioMode) {
+    GStreamerAudioModeDefault,
+    GStreamerAudioModeNone,
+    GStreamerAudioModeLowLatency
+};
+
+/* Name of the webrtcechoprobe of the GStreamerAudioModeLowLatency audio path */
+extern NSString * const GStreamerEchoProbeName;
+
+/* Receives the decoded frames of the frame tap. The pixel buffer is the
+ * decoder's own memory, valid for the duration of the call; retain it to keep
+ * it longer, but as long as it is held the decoder cannot reuse it. The
+ * presentation time is the stream PTS. Called on a GStreamer streaming thread. */
+typedef void (^GStreamerFrameHandler)(CVPixelBufferRef pixel_buffer, CMTime presentation_time);
+
+/* Called on the main queue once a DVR clip is written, error is nil on success */
+typedef void (^GStreamerClipCompletion)(NSError *error);
+
+/* Called on the main queue once a control call has been carried out on the
+ * backend's context. A state change has been requested from the pipeline by
+ * then, gstreamerStateChanged: reports when it is reached. */
+typedef void (^GStreamerCommandCompletion)(void);
+
+/* The control methods can be called from any thread, right after init as
+ * well. Each call is queued and carried out in order on the context the
+ * backend handles its pipeline on, once the pipeline is built, so none of
+ * them blocks the caller on a state change. Redundant calls still waiting
+ * there are coalesced: only the last of a series of play and pause, or of
+ * viewport updates, is applied. setFrameHandler: and setBackground: take
+ * effect at once. */
 @interface GStreamerBackend : NSObject
 
 /* Initialization method. Pass the delegate that will take care of the UI.
  * This delegate must implement the GStreamerBackendDelegate protocol.
- * Pass also the UIView object that will hold the video window. */
+ * Pass also the UIView object that will hold the video window. With a
+ * GStreamerMetalView the video is rendered with Metal instead of glimagesink. */
 -(id) init:(id) uiDelegate videoView:(UIView*) video_view;
 
+/* Same as above, selecting the latency profile used for the pipeline */
+-(id) init:(id) uiDelegate videoView:(UIView*) video_view latencyProfile:(GStreamerLatencyProfile) profile;
+
+/* Same as above, also selecting how the video is decoded */
+-(id) init:(id) uiDelegate videoView:(UIView*) video_view latencyProfile:(GStreamerLatencyProfile) profile decodeMode:(GStreamerDecodeMode) decode_mode;
+
 /* Quit the main loop and free all resources, including the pipeline and
  * the references to the ui delegate and the UIView used for rendering, so
- * these objects can be deallocated. */
+ * these objects can be deallocated. Calls made before still run first,
+ * those made after are dropped and their completions never called. */
 -(void) deinit;
 
 /* Set the pipeline to PLAYING */
 -(void) play;
+-(void) playWithCompletion:(GStreamerCommandCompletion)completion;
 
 /* Set the pipeline to PAUSED */
 -(void) pause;
+-(void) pauseWithCompletion:(GStreamerCommandCompletion)completion;
 
-/* Set the URI to be played */
+/* Set the URI to be played. The pipeline and its video sink are kept: the
+ * pipeline goes through READY and back to its previous target state. */
 -(void) setUri:(NSString*)uri;
+-(void) setUri:(NSString*)uri completion:(GStreamerCommandCompletion)completion;
+
+/* completion is called once every control call made before this one has
+ * been carried out */
+-(void) afterPendingCommands:(GStreamerCommandCompletion)completion;
+
+/* Connect to the given URI in the background while the current stream keeps
+ * playing. A following setUri: with the same URI switches to it without having
+ * to wait for the connection and session setup. Meant for live sources. */
+-(void) prerollUri:(NSString*)uri;
+
+/* Seek to the given position while the user scrubs: lands on the nearest
+ * keyframe and is throttled, so dragging a slider does not flood the
+ * pipeline. Deferred until the pipeline is PAUSED, ignored for live streams. */
+-(void) setPosition:(NSInteger)milliseconds;
+
+/* Seek to exactly the given position, e.g. when the slider is released.
+ * Never throttled, and replaces any scrubbing seek still pending. */
+-(void) setPositionAccurate:(NSInteger)milliseconds;
+
+/* Play one of several renditions of the same stream, ordered from the highest
+ * to the lowest quality (e.g. the main and sub streams of an IP camera). The
+ * backend starts with the first one, steps down when QoS, jitterbuffer losses,
+ * buffering or a throughput drop show the link is congested, and steps back
+ * up once it has been healthy for a while. The next rendition is prerolled
+ * before switching, so the picture does not stall. setUri: stops adaptation. */
+-(void) setQualityUris:(NSArray<NSString *> *)uris;
+
+/* Tuning for HTTP adaptive streaming (HLS, DASH) with playbin. bitrate, in
+ * bits/s, picks the first variant instead of the conservative default, 0
+ * lets the demuxer choose. bufferTarget is how much has to be buffered, in
+ * seconds, before playback starts, and how far ahead segments are fetched;
+ * 0 keeps the defaults of several segments. lowLatency plays LL-HLS partial
+ * segments and stays close to the live edge. The decisions show up in the
+ * abr* stats. Applies to streams opened afterwards. */
+-(void) setAdaptiveStartBitrate:(NSUInteger)bitrate bufferTarget:(NSTimeInterval)buffer_target lowLatency:(BOOL)low_latency;
+
+/* Memory budget for long running sessions on devices with little memory.
+ * Caps the bytes each queue (including playbin's network buffering and
+ * decodebin's multiqueue) may hold, the buffers a decoder output pool may
+ * allocate beyond what the decoder needs, and the jitterbuffer depth in ms.
+ * 0 keeps the default for that limit. Applies to elements created
+ * afterwards, so call it before setUri: */
+-(void) setMemoryBudgetQueueBytes:(NSUInteger)queue_bytes decoderBuffers:(NSUInteger)decoder_buffers jitterbufferMs:(NSUInteger)jitterbuffer_ms;
+
+/* Play https URIs through the given disk cache, so segments and progressive
+ * downloads watched again come from Library/Caches. nil plays them from the
+ * network. Only applies to the playbin decode mode, and to URIs set
+ * afterwards. */
+-(void) setSegmentCache:(GStreamerSegmentCache *)cache;
+
+/* Background power mode, for while the app is not visible. The pipeline keeps
+ * PLAYING so the RTSP/SRT session, jitterbuffer and decoder stay set up, but
+ * no video is decoded or rendered. Leaving it resumes from the next keyframe,
+ * without renegotiating. Call it instead of pause when the app resigns active. */
+-(void) setBackground:(BOOL)enabled;
+
+/* Select the RTSP lower transport. Takes effect the next time a source
+ * is created, so call it before setUri: */
+-(void) setTransport:(GStreamerTransport)transport;
+
+/* Hand every decoded frame to handler as well as rendering it, nil stops.
+ * The frames are not copied: VideoToolbox frames come as their CVPixelBuffer,
+ * software decoded ones are wrapped in place. A handler slower than the
+ * stream only gets the newest frame, it never holds back decoding or
+ * rendering. Composites have no per frame pixel buffer and are not tapped. */
+-(void) setFrameHandler:(GStreamerFrameHandler)handler;
+
+/* Select how frames are rendered, takes effect immediately */
+-(void) setRenderMode:(GStreamerRenderMode)mode;
+
+/* Tune srt:// sources. latency_ms is the SRT receive latency, the window
+ * in which lost packets are retransmitted, 0 keeps the URI or srtsrc default
+ * (125 ms). In the hardware decode mode the MPEG-TS carried by SRT is demuxed
+ * into the same VideoToolbox chain as RTSP. SRT round trip time, loss and
+ * retransmissions are reported in GStreamerStats. Takes effect the next time
+ * a source is created, so call it before setUri: */
+-(void) setSRTLatency:(NSUInteger)latency_ms mode:(GStreamerSRTMode)mode;
+
+/* Select what is done with the audio of the stream, e.g. None for camera
+ * feeds whose audio nobody listens to. Applies to streams opened afterwards,
+ * so call it before setUri: */
+-(void) setAudioMode:(GStreamerAudioMode)mode;
+
+/* Follow the network the device is on, with NWPathMonitor, instead of
+ * static defaults. Over cellular and other expensive paths RTSP goes over
+ * TCP, the jitterbuffer of the low latency profiles is twice as deep, SRT
+ * sources get a 500 ms receive latency, and HLS/DASH start from a 1.5 Mbit/s
+ * variant. In Low Data Mode they start from 600 kbit/s and stay below
+ * 1.5 Mbit/s, and setQualityUris: starts from the lowest rendition. What is
+ * set with setTransport:, setSRTLatency:mode: and
+ * setAdaptiveStartBitrate:bufferTarget:lowLatency: wins. A change of path
+ * retunes the running session in place; after a handover to another
+ * interface the live source is opened again, keeping the pipeline and its
+ * sink. Off by default. */
+-(void) setNetworkAware:(BOOL)enabled;
+
+/* Reconnect on our own when the network or the server goes away, instead of
+ * reporting the error: up to max_attempts times, 250 ms after the failure and
+ * twice as long before each following attempt, up to 8 s. The count starts
+ * over once frames flow again. The pipeline and its sink are kept, only the
+ * source is opened again, and an RTSP server that was only reachable over
+ * TCP is not tried over UDP again. gstreamerFailed: comes once the attempts
+ * run out. 0, the default, reports failures right away. */
+-(void) setReconnectAttempts:(NSUInteger)max_attempts;
+
+/* Keep a warm session to a second server for the same stream, in the
+ * standby pipeline of prerollUri:. A reconnect fails over to it at once, and
+ * the server that failed becomes the backup. Needs setReconnectAttempts:.
+ * prerollUri: and quality switches take over the standby pipeline for a
+ * while, the backup is connected again afterwards. nil stops. */
+-(void) setBackupUri:(NSString *)uri;
+
+/* Play several streams at once, mixed on the GPU into a single canvas shown in
+ * the video view. The streams are laid out in a grid with the given number of
+ * columns, 0 picks a square grid. Replaces the current URI, a later setUri:
+ * goes back to a single stream. Needs GStreamerDecodeModeHardware. */
+-(void) setCompositeUris:(NSArray<NSString *> *)uris columns:(NSUInteger)columns;
+
+/* Receive the video over WebRTC instead of RTSP, for interactive latencies.
+ * A receive-only webrtcbin replaces the current source and feeds the same
+ * hardware decoding chain and sink. SDP and ICE go through the signalling
+ * object: with createOffer we offer to receive H.264 video, otherwise we wait
+ * for the remote offer and answer it. stun_server is a stun://host:port URI,
+ * or nil. Needs GStreamerDecodeModeHardware; setUri: ends the session. */
+-(void) startWebRTC:(id<GStreamerWebRTCSignalling>)signalling stunServer:(NSString *)stun_server createOffer:(BOOL)create_offer;
+
+/* Hand the session description received from the remote peer to webrtcbin.
+ * type is "offer" or "answer", as sent by the peer. */
+-(void) setRemoteDescription:(NSString *)sdp type:(NSString *)type;
+
+/* Hand an ICE candidate received from the remote peer to webrtcbin */
+-(void) addRemoteIceCandidate:(NSString *)candidate sdpMLineIndex:(NSUInteger)mline_index;
+
+/* Move a stream of the composite. The frame is given in fractions of the canvas,
+ * so {0, 0, 1, 1} covers all of it. */
+-(void) setCompositeTile:(NSUInteger)index frame:(CGRect)frame;
+
+/* Size in pixels of the canvas the composite is mixed into, 1920x1080 by default */
+-(void) setCompositeCanvasSize:(CGSize)size;
+
+/* Viewport-adaptive 360° streaming. The equirectangular frame is served as a
+ * grid of tiles with the given number of columns, listed row by row from the
+ * top left, each tile as a high and a low quality stream. Every tile plays,
+ * so there is a picture wherever the user looks, but only those in or near
+ * the viewport play their high quality stream. The tiles are mixed on the GPU
+ * into the canvas, which should be set to 2:1 with setCompositeCanvasSize:,
+ * for the app to project. A tile switches quality once the new stream has
+ * its first frame, so it never goes blank. Needs GStreamerDecodeModeHardware. */
+-(void) setTiledUris:(NSArray<NSString *> *)high_uris lowQualityUris:(NSArray<NSString *> *)low_uris columns:(NSUInteger)columns;
+
+/* What the user sees of the 360° stream, as the head moves. yaw and pitch
+ * give the view direction in degrees: yaw 0 is the centre of the
+ * equirectangular frame, positive to the right; pitch 0 is the horizon,
+ * positive up. The fields of view are in degrees as well, 90x90 by default. */
+-(void) setViewportYaw:(double)yaw pitch:(double)pitch horizontalFov:(double)horizontal_fov verticalFov:(double)vertical_fov;
+
+/* DVR mode for live streams, in the hardware decode mode. The still compressed
+ * video is teed off after the parser and written to disk in short MP4
+ * fragments, keeping the last window seconds: no second decode, no re-encode.
+ * 0 stops recording and deletes the recording. Applies to sources created
+ * afterwards, so call it before setUri: */
+-(void) setDvrWindow:(NSTimeInterval)window;
+
+/* Rewind into the recording: play its last seconds, from the keyframe that
+ * starts the fragment they fall in. The live source is closed meanwhile, the
+ * replay can be paused and scrubbed with setPosition: like a file. The
+ * fragment still being written does not make it into the replay. */
+-(void) replayLast:(NSTimeInterval)seconds;
+
+/* Leave a replay and reconnect to the live stream, which is recorded again */
+-(void) resumeLive;
+
+/* Write the last seconds of the recording into the MP4 file at url, by
+ * remuxing the fragments. Works while playing live or replaying. */
+-(void) exportClip:(NSTimeInterval)seconds toURL:(NSURL *)url completion:(GStreamerClipCompletion)completion;
 
 @end
@@ -1,18 +1,246 @@
 #import "GStreamerBackend.h"
+#import "GStreamerBackendPrivate.h"
+#import "GStreamerMetalView.h"
+#import "gst_ios_init.h"
+#import <Network/Network.h>
 
 #include <gst/gst.h>
 #include <gst/video/video.h>
+#include <gst/app/app.h>
+#include <gst/sdp/sdp.h>
+#define GST_USE_UNSTABLE_API
+#include <gst/webrtc/webrtc.h>
+#include <glib/gstdio.h>
+#include <pthread.h>
+#include <mach/mach.h>
+#include <os/proc.h>
 
 GST_DEBUG_CATEGORY_STATIC (debug_category);
 #define GST_CAT_DEFAULT debug_category
 
+NSString * const GStreamerErrorSourceKey = @"GStreamerErrorSource";
+NSString * const GStreamerEchoProbeName = @"gstreamer-echo-probe";
+
 /* Do not allow seeks to be performed closer than this distance. It is visually useless, and will probably
  * confuse some demuxers. */
 #define SEEK_MIN_DELAY (500 * GST_MSECOND)
 
+/* rtspsrc jitterbuffer size, in milliseconds, for each of the low latency profiles */
+#define LOW_LATENCY_JITTERBUFFER_MS 200
+#define ULTRA_LOW_LATENCY_JITTERBUFFER_MS 50
+
+/* Buffers later than this are dropped by the video sink instead of being rendered */
+#define LOW_LATENCY_MAX_LATENESS (20 * GST_MSECOND)
+
+/* Latest-frame-wins rendering: a frame later than this is dropped by the sink rather than
+ * shown, instead of GstVideoSink's default of DEFAULT_MAX_LATENESS */
+#define LATEST_FRAME_MAX_LATENESS (5 * GST_MSECOND)
+#define DEFAULT_MAX_LATENESS (20 * GST_MSECOND)
+
+/* What the video sink of a GStreamerMetalView accepts. System memory makes VideoToolbox
+ * output CVPixelBuffers instead of GL textures. */
+#define METAL_FRAME_CAPS "video/x-raw, format=(string){ NV12, BGRA, I420 }"
+
+/* Frames the render queue in front of the sink holds in the smooth render mode */
+#define RENDER_QUEUE_BUFFERS 3
+
+/* Audio sink buffer and period of the low latency audio path, in microseconds. The defaults
+ * are 200 ms and 10 ms. */
+#define LOW_LATENCY_AUDIO_BUFFER_TIME 40000
+#define LOW_LATENCY_AUDIO_LATENCY_TIME 10000
+
+/* GST_PLAY_FLAG_AUDIO of playbin, whose flags type is not public */
+#define PLAY_FLAG_AUDIO (1 << 1)
+
+/* Minimum time between keyframe requests made because a decoder reported corrupted data */
+#define KEYFRAME_REQUEST_MIN_INTERVAL (1 * GST_SECOND)
+
+/* The UI timer fires every 250 ms, stats are reported every this many ticks */
+#define STATS_REPORT_TICKS 4
+
+/* Quality adaptation. A stats interval is congested when the jitterbuffers lost or got
+ * too late more packets than QUALITY_DEGRADE_PACKETS, the sink reported more than
+ * QUALITY_DEGRADE_LATE_FRAMES late buffers, buffering kicked in, or the received bitrate
+ * fell below QUALITY_THROUGHPUT_RATIO of its running average. */
+#define QUALITY_DEGRADE_PACKETS 10
+#define QUALITY_DEGRADE_LATE_FRAMES 5
+#define QUALITY_THROUGHPUT_RATIO 0.5
+/* Consecutive congested intervals before stepping down */
+#define QUALITY_DEGRADE_INTERVALS 2
+/* Consecutive healthy intervals before stepping back up. Doubled, up to
+ * QUALITY_MAX_UPGRADE_INTERVALS, each time an upgrade has to be undone quickly. */
+#define QUALITY_UPGRADE_INTERVALS 10
+#define QUALITY_MAX_UPGRADE_INTERVALS 120
+/* Stats intervals the next rendition gets to preroll before the switch is given up */
+#define QUALITY_PREROLL_INTERVALS 10
+
+/* What we accept when offering a WebRTC session */
+#define WEBRTC_VIDEO_CAPS "application/x-rtp,media=video,encoding-name=H264,payload=96,clock-rate=90000"
+
+/* Default size of the canvas the composite tiles are mixed into */
+#define COMPOSITE_CANVAS_WIDTH 1920
+#define COMPOSITE_CANVAS_HEIGHT 1080
+
+/* Viewport-adaptive tiles within this many degrees of the viewport get their high quality
+ * stream, fetched ahead of the head movement. They only go back to low quality beyond twice
+ * the margin, so a tile on the edge does not flip back and forth. */
+#define VIEWPORT_MARGIN_DEGREES 15
+
+/* Reconnect backoff: delay before the first attempt after a network failure, doubled for each
+ * following attempt up to the maximum. A warm backup session is failed over to at once. */
+#define RECONNECT_INITIAL_DELAY (250 * GST_MSECOND)
+#define RECONNECT_MAX_DELAY (8 * GST_SECOND)
+
+/* Network-aware tuning, see setNetworkAware:. Over cellular the jitterbuffer of the low latency
+ * profiles is this many times deeper, and SRT sources get this receive latency, about four
+ * times a typical cellular round trip. */
+#define NETWORK_CELLULAR_JITTERBUFFER_FACTOR 2
+#define NETWORK_CELLULAR_SRT_LATENCY_MS 500
+/* Bitrate of the first HLS/DASH variant over cellular and in Low Data Mode, in bits/s. Low
+ * Data Mode also caps the variants picked afterwards. */
+#define NETWORK_CELLULAR_START_BITRATE 1500000
+#define NETWORK_CONSTRAINED_START_BITRATE 600000
+#define NETWORK_CONSTRAINED_MAX_BITRATE 1500000
+
+/* Length of the DVR fragments. A fragment is closed at the first keyframe after this much
+ * video, and only then becomes part of the recording. */
+#define DVR_FRAGMENT_DURATION (2 * GST_SECOND)
+/* Video the DVR queue holds for a slow disk. Past this, the recorder drops frames up to the
+ * next keyframe rather than holding back the live video; the queue itself is twice as deep
+ * so it never blocks the tee. */
+#define DVR_QUEUE_OVERFLOW (2 * DVR_FRAGMENT_DURATION)
+
+/* Software decoders tried, in order, when the hardware decoder cannot be used */
+static const gchar *software_h264_decoders[] = { "avdec_h264", "vtdec", NULL };
+static const gchar *software_h265_decoders[] = { "avdec_h265", "vtdec", NULL };
+
+static void set_hardware_source (GStreamerBackend *self, const gchar *uri);
+static void reset_stats (GStreamerBackend *self);
+static GstElement *create_pipeline (GStreamerBackend *self);
+static GstElement *make_source (GStreamerBackend *self, GstElement *bin, const gchar *uri, const gchar *name,
+                                GCallback pad_added_cb, gpointer user_data);
+static void source_pad_added_cb (GstElement *src, GstPad *pad, GStreamerBackend *self);
+static void teardown_decode_chain (GStreamerBackend *self);
+static void teardown_composite (GStreamerBackend *self);
+static void request_keyframe (GstPad *decoder_sink_pad);
+static void remove_source (GStreamerBackend *self);
+static gboolean build_mixer (GStreamerBackend *self);
+static void layout_tile (GStreamerBackend *self, CompositeTile *tile);
+static void update_mixer_caps (GStreamerBackend *self);
+static void tile_pad_added_cb (GstElement *src, GstPad *pad, CompositeTile *tile);
+static void update_viewport (GStreamerBackend *self);
+static gboolean promote_ready_tiles_cb (GStreamerBackend *self);
+static gboolean is_hardware_decoder (GstObject *object);
+static void configure_video_sink_latency (GStreamerBackend *self);
+static void configure_render_queue (GStreamerBackend *self);
+static GstElement *make_render_filter (GStreamerBackend *self);
+static GstFlowReturn frame_tap_sample_cb (GstAppSink *sink, gpointer user_data);
+static GstFlowReturn metal_sink_sample_cb (GstAppSink *sink, gpointer user_data);
+static gboolean is_srt_source (GstElement *element);
+static gboolean is_rtsp_source (GstObject *object);
+static GstElement *wrap_transport_stream (GStreamerBackend *self, GstElement *ts_source, const gchar *name);
+static GstState clear_hardware_sources (GStreamerBackend *self);
+static void restore_hardware_state (GStreamerBackend *self, GstState previous);
+static GstElement *make_webrtc_source (GStreamerBackend *self, const gchar *stun_server);
+static void remote_offer_set_cb (GstPromise *promise, GStreamerBackend *self);
+static void set_webrtc_signalling (GStreamerBackend *self, id<GStreamerWebRTCSignalling> signalling);
+static void promote_standby (GStreamerBackend *self);
+static void discard_standby (GStreamerBackend *self);
+static gboolean shared_start_cb (GStreamerBackend *self);
+static gboolean shared_stop_cb (GStreamerBackend *self);
+static GstBusSyncReply standby_bus_sync_cb (GstBus *bus, GstMessage *msg, gpointer user_data);
+static void release_floating (GstElement **element);
+static gboolean schedule_reconnect (GStreamerBackend *self);
+static void cancel_reconnect (GStreamerBackend *self);
+static gboolean standby_is_backup (GStreamerBackend *self);
+static void configure_playbin_audio (GStreamerBackend *self, GstElement *playbin);
+static void remove_dvr_recorder (GstElement *bin);
+static void remove_audio_chain (GstElement *bin);
+static void preroll_backup (GStreamerBackend *self);
+static void free_dvr_fragment (DvrFragment *fragment);
+static void clear_dvr_recording (GStreamerBackend *self);
+static gchar **dvr_locations (GStreamerBackend *self, GstClockTime length);
+static GstElement *make_dvr_source (GStreamerBackend *self, GstElement *bin, gchar **locations, const gchar *name,
+                                    GCallback pad_added_cb, gpointer user_data);
+static void export_pad_added_cb (GstElement *src, GstPad *pad, GstElement *muxer);
+static gboolean export_bus_cb (GstBus *bus, GstMessage *msg, DvrExport *export);
+static void finish_dvr_export (DvrExport *export, NSError *error);
+static NSError *dvr_error (GQuark domain, gint code, const gchar *message);
+
+/* One stream of a composite: its source, decoding chain and pad on the mixer */
+typedef struct CompositeTile {
+    __unsafe_unretained GStreamerBackend *backend;
+    GstElement *source;
+    GstElement *depayloader;
+    GstElement *parser;
+    GstElement *decoder;
+    GstPad *mixer_pad;
+    CGRect frame;                /* Placement on the canvas, in fractions of its size */
+    gchar *uris[2];              /* Viewport-adaptive tile: its TILE_QUALITY_LOW and TILE_QUALITY_HIGH streams */
+    gint quality;                /* Viewport-adaptive tile: which of them plays */
+    struct CompositeTile *pending; /* The other quality, connecting until its first frame */
+    gint ready;                  /* A pending tile got its first frame (atomic) */
+} CompositeTile;
+
+enum {
+    TILE_QUALITY_LOW,
+    TILE_QUALITY_HIGH
+};
+
+/* Link the network monitor reports, from the least to the most careful tuning */
+typedef enum {
+    NETWORK_UNKNOWN,             /* Not monitored, or no path yet: the static defaults */
+    NETWORK_UNMETERED,           /* Wi-Fi or wired */
+    NETWORK_CELLULAR,            /* Cellular, or another expensive path such as a personal hotspot */
+    NETWORK_CONSTRAINED          /* Low Data Mode */
+} NetworkClass;
+
+/* A fragment of the DVR recording, once splitmuxsink has closed it */
+typedef struct {
+    gchar *location;
+    gint generation;             /* Recorder that wrote it */
+    GstClockTime duration;
+} DvrFragment;
+
+/* Overflow state of a DVR recorder queue, see dvr_overflow_probe_cb() */
+typedef struct {
+    __unsafe_unretained GStreamerBackend *backend;
+    gboolean discarding;         /* Dropping frames until the next keyframe */
+    gboolean reported;           /* The UI was told the recording has gaps */
+} DvrOverflow;
+
+/* A clip being written by exportClip:toURL:completion: */
+typedef struct {
+    GstElement *pipeline;
+    void *completion;            /* Retained GStreamerClipCompletion */
+} DvrExport;
+
+/* Events for the UI delegate. They are posted from the GStreamer threads and delivered on the
+ * main queue. Only the latest value of each kind is kept until then, so a burst of messages
+ * costs a single dispatch. */
+enum {
+    UI_EVENT_STATE      = 1 << 0,
+    UI_EVENT_BUFFERING  = 1 << 1,
+    UI_EVENT_ERROR      = 1 << 2,
+    UI_EVENT_STATS      = 1 << 3,
+    UI_EVENT_QUALITY    = 1 << 4,
+    UI_EVENT_MEDIA_SIZE = 1 << 5,
+    UI_EVENT_POSITION   = 1 << 6
+};
+
+static void free_tile (CompositeTile *tile);
+static void switch_uri (GStreamerBackend *self, const gchar *uri);
+static gchar *playback_uri (GStreamerBackend *self, const gchar *uri);
+static void execute_seek (gint64 position, GstSeekFlags flags, GStreamerBackend *self);
+static void retune_network (GStreamerBackend *self, NetworkClass network, nw_interface_type_t interface);
+
 @interface GStreamerBackend()
 -(void)setUIMessage:(gchar*) message;
+-(void)setCurrentUIPosition:(gint)pos duration:(gint)dur;
+-(void)deliver_ui_events;
 -(void)app_function;
+-(BOOL)start_pipeline;
+-(void)stop_pipeline;
 -(void)check_initialization_complete;
 @end
 
@@ -20,6 +248,16 @@ GST_DEBUG_CATEGORY_STATIC (debug_category);
     id ui_delegate;              /* Class that we use to interact with the user interface */
     GstElement *pipeline;        /* The running pipeline */
     GstElement *video_sink;      /* The video sink element which receives XOverlay commands */
+    GstElement *render_filter;   /* Bin in front of the video sink, see make_render_filter() */
+    GstElement *render_queue;    /* Queue right in front of the video sink */
+    GstElement *frame_tap;       /* appsink handing decoded frames to frame_handler */
+    GMutex tap_lock;             /* Protects frame_handler, read from the frame tap thread */
+    GStreamerFrameHandler frame_handler;
+    gint frame_tap_open;         /* A frame handler is set, frames go down the tap branch (atomic) */
+    GStreamerMetalView *metal_view; /* The video view when it renders with Metal. Protected by tap_lock */
+    GStreamerRenderMode render_mode; /* Whether stale frames are dropped before reaching the sink */
+    gint background;             /* Power mode: no video is decoded, the session is kept (atomic) */
+    GstClockTime last_keyframe_request; /* For throttling keyframe requests after decode errors */
     GMainContext *context;       /* GLib context used to run the main loop */
     GMainLoop *main_loop;        /* GLib main loop */
     gboolean initialized;        /* To avoid informing the UI multiple times about the initialization */
@@ -28,123 +266,3679 @@ GST_DEBUG_CATEGORY_STATIC (debug_category);
     GstState target_state;       /* Desired pipeline state, to be set once buffering is complete */
     gint64 duration;             /* Cached clip duration */
     gint64 desired_position;     /* Position to seek to, once the pipeline is running */
+    GstSeekFlags desired_flags;  /* Flags of the seek to desired_position */
     GstClockTime last_seek_time; /* For seeking overflow prevention (throttling) */
+    GSource *seek_source;        /* Pending throttled seek */
     gboolean is_live;            /* Live streams do not use buffering */
+    GStreamerLatencyProfile latency_profile; /* How aggressively to trade smoothness for latency */
+    GStreamerTransport transport; /* RTSP lower transport */
+    GStreamerDecodeMode decode_mode; /* playbin auto-plugging or explicit hardware pipeline */
+    GstElement *source;          /* Source element of the hardware pipeline */
+    GstElement *depayloader;     /* Decoding chain of the hardware pipeline, built once the */
+    GstElement *parser;          /* source exposes its video stream */
+    GstElement *decoder;
+    gboolean software_decode;    /* Set once the hardware decoder has failed */
+    GPtrArray *discard_sinks;    /* fakesinks linked to the streams we do not decode. Protected by stats_lock */
+    GstElement *mixer;           /* glvideomixer of a composite, NULL for a single stream */
+    GstElement *mixer_caps;      /* capsfilter setting the canvas size */
+    GPtrArray *tiles;            /* CompositeTile of each composite stream */
+    guint tiled_columns;         /* Grid of the viewport-adaptive tiles, 0 for a plain composite */
+    guint tiled_rows;
+    gdouble viewport_yaw;        /* What the user sees of a 360° stream, in degrees */
+    gdouble viewport_pitch;
+    gdouble viewport_hfov;
+    gdouble viewport_vfov;
+    gint canvas_width;           /* Size of the composite canvas */
+    gint canvas_height;
+    NSArray<NSString *> *quality_uris; /* Renditions set by setQualityUris:, highest quality first */
+    NSUInteger quality_level;    /* Index of the rendition being played */
+    NSInteger pending_level;     /* Rendition prerolling in the standby pipeline, -1 if none */
+    guint preroll_intervals;     /* Stats intervals pending_level has been prerolling for */
+    guint congested_intervals;   /* Consecutive stats intervals that looked congested */
+    guint healthy_intervals;     /* Consecutive stats intervals that did not */
+    guint upgrade_intervals;     /* Healthy intervals needed before stepping up */
+    guint intervals_since_upgrade; /* To detect upgrades the link could not sustain */
+    guint64 last_packets_lost;   /* Jitterbuffer totals at the previous stats interval */
+    guint64 last_packets_late;
+    gdouble average_kbps;        /* Running average of the received bitrate */
+    gboolean buffering_stalled;  /* Buffering started during the current stats interval */
+    GMutex webrtc_lock;          /* Protects webrtc_signalling, read from the webrtcbin threads */
+    id<GStreamerWebRTCSignalling> webrtc_signalling; /* Carries SDP and ICE of the WebRTC session */
+    gboolean webrtc_offer;       /* We create the WebRTC offer, rather than answer the remote one */
+    NSUInteger srt_latency_ms;   /* SRT receive latency, 0 for the URI or srtsrc default */
+    guint budget_queue_bytes;    /* Memory budget: queue size cap, 0 for the element defaults */
+    guint budget_decoder_buffers; /* Memory budget: decoder output pool cap, 0 for no cap */
+    guint budget_jitterbuffer_ms; /* Memory budget: jitterbuffer depth cap, 0 for no cap */
+    guint adaptive_start_bitrate; /* HLS/DASH: bits/s of the first variant, 0 lets the demuxer pick */
+    GstClockTime adaptive_buffer_target; /* HLS/DASH: buffering needed to start, NONE for the defaults */
+    gboolean adaptive_low_latency; /* HLS/DASH: play LL-HLS partial segments, stay close to the live edge */
+    guint abr_bitrate;           /* Bitrate of the variant the demuxer switched to last */
+    guint abr_switches;          /* Variant switches since the stream started */
+    gdouble abr_throughput_kbps; /* Download rate of the last fragment */
+    gdouble abr_download_ms;     /* Download time of the last fragment */
+    GStreamerSRTMode srt_mode;   /* SRT connection mode, Default for the URI or srtsrc default */
+    GStreamerAudioMode audio_mode; /* Whether audio is set up, decoded and played */
+    nw_path_monitor_t path_monitor; /* Watches the network while network tuning is on, nil otherwise */
+    NetworkClass network;        /* Link the streams are tuned for, only touched on our context */
+    nw_interface_type_t network_interface; /* Interface of the current path, to notice a handover */
+    GstElement *srt_source;      /* srtsrc of the current stream, to read its stats. Protected by stats_lock */
+    GMutex stats_lock;           /* Protects jitterbuffers and discard_sinks, which are filled from streaming threads */
+    GMutex event_lock;           /* Protects the UI events waiting to be delivered */
+    guint pending_events;        /* UI_EVENT_* flags posted since the last delivery */
+    GStreamerPlaybackState event_state;
+    gint event_buffering;        /* Percent */
+    NSError *event_error;        /* First error since the last delivery */
+    GStreamerStats *event_stats;
+    NSUInteger event_quality;
+    gint event_width, event_height;
+    gint event_position, event_duration; /* In ms */
+    GPtrArray *jitterbuffers;    /* rtpjitterbuffer elements of the current RTSP session */
+    guint frames_rendered;       /* Buffers that reached the video sink, updated atomically */
+    guint last_frames_rendered;  /* frames_rendered at the previous stats snapshot */
+    guint interval_bytes;        /* Bytes received from the source since the last snapshot, updated atomically */
+    guint64 frames_dropped;      /* Highest dropped count reported by QoS messages */
+    guint interval_late_frames;  /* QoS messages received since the last snapshot */
+    gdouble last_lateness_ms;    /* Jitter of the last QoS message */
+    gint64 last_stats_time;      /* Monotonic time of the previous stats snapshot */
+    guint ui_ticks;              /* Number of times the UI timer fired */
+    GSource *bus_source;         /* Watch on the bus of the current pipeline */
+    GStreamerSegmentCache *segment_cache; /* Disk cache https URIs are played through, or nil */
+    gchar *live_uri;             /* URI last set, to go back to after a DVR replay */
+    GstClockTime dvr_window;     /* DVR: how much of the live stream is kept, 0 when not recording */
+    gchar *dvr_directory;        /* DVR: where the fragments are written */
+    gint dvr_generation;         /* DVR: recorders created so far, keeps their fragments apart (atomic) */
+    gboolean dvr_replaying;      /* The hardware pipeline plays the recording rather than the live stream */
+    GMutex dvr_lock;             /* Protects dvr_fragments */
+    GPtrArray *dvr_fragments;    /* DvrFragment of each closed fragment, oldest first */
+    GstElement *standby_pipeline; /* Next pipeline, connected in the background by prerollUri: */
+    gchar *standby_uri;          /* URI the standby pipeline was created for */
+    gint standby_failed;         /* The standby pipeline posted an error (atomic) */
+    guint reconnect_max_attempts; /* Reconnects after a network failure before reporting it, 0 to report at once */
+    guint reconnect_attempt;     /* Reconnects since frames last flowed */
+    guint reconnects;            /* Reconnects since the stream was set */
+    GSource *reconnect_source;   /* Pending reconnect, attached to our context */
+    gchar *backup_uri;           /* Server kept warm in the standby pipeline, to fail over to */
+    gchar *tcp_only_uri;         /* RTSP URI whose server could not be reached over UDP */
+    gint64 outage_start;         /* Monotonic time the stream failed, for lastOutageMs */
+    gint outage_open;            /* No frame since the failure (atomic) */
+    gint last_outage_ms;         /* Failure to first frame of the last reconnect (atomic) */
+    GSource *timeout_source;     /* UI timer, attached to our context */
+    GMutex command_lock;         /* Protects the command queue and the requested state and viewport */
+    GQueue commands;             /* Control calls waiting to run on our context, oldest first */
+    gboolean commands_ready;     /* The pipeline is built, queued commands can run */
+    gboolean commands_scheduled; /* An idle source is about to run the queued commands */
+    gboolean running_commands;   /* Inside run_commands(), only touched on our context */
+    gboolean commands_closed;    /* deinit ran or the pipeline could not be built, commands are dropped */
+    gboolean state_queued;       /* A state command is queued, further play/pause only update requested_state */
+    GstState requested_state;
+    gboolean viewport_queued;    /* Same for the viewport, head tracking moves it every frame */
+    gdouble requested_viewport[4]; /* yaw, pitch, hfov, vfov */
+    gboolean shared_context;     /* The context belongs to a GStreamerBackendManager */
+    dispatch_block_t teardown_block; /* Called once deinit has released everything on a shared context */
+}
+
+/*
+ * Control commands
+ */
+
+/* The interface methods can be called from any thread, while the pipeline is only built,
+ * and its bus messages handled, on our context. Each call becomes a command that runs there,
+ * in the order of the calls. Commands wait until the pipeline exists, so calls made right
+ * after init are not lost or run against a NULL pipeline. */
+
+static void run_commands (GStreamerBackend *self)
+{
+    dispatch_block_t command;
+
+    self->running_commands = TRUE;
+    for (;;) {
+        g_mutex_lock (&self->command_lock);
+        command = (__bridge_transfer dispatch_block_t) g_queue_pop_head (&self->commands);
+        if (!command)
+            self->commands_scheduled = FALSE;
+        g_mutex_unlock (&self->command_lock);
+        if (!command)
+            break;
+        command ();
+    }
+    self->running_commands = FALSE;
+}
+
+static gboolean run_commands_cb (gpointer user_data)
+{
+    run_commands ((__bridge GStreamerBackend *) user_data);
+    return G_SOURCE_REMOVE;
+}
+
+/* Must be called with command_lock held. The idle source keeps self alive until it ran. */
+static void schedule_commands (GStreamerBackend *self)
+{
+    GSource *idle;
+
+    if (self->commands_scheduled || !self->commands_ready || g_queue_is_empty (&self->commands))
+        return;
+    self->commands_scheduled = TRUE;
+    idle = g_idle_source_new ();
+    g_source_set_priority (idle, G_PRIORITY_DEFAULT);
+    g_source_set_callback (idle, run_commands_cb, (__bridge_retained void *) self, (GDestroyNotify) CFRelease);
+    g_source_attach (idle, self->context);
+    g_source_unref (idle);
+}
+
+/* Queue command to run on our context, after the commands queued before it, and return TRUE.
+ * Returns FALSE when called on our context once the pipeline is built: the caller is already
+ * where the command has to run and goes on with it right away, after anything still queued. */
+static gboolean defer_command (GStreamerBackend *self, dispatch_block_t command)
+{
+    g_mutex_lock (&self->command_lock);
+    if (self->commands_closed) {
+        g_mutex_unlock (&self->command_lock);
+        return TRUE;
+    }
+    if (self->commands_ready && g_main_context_is_owner (self->context)) {
+        g_mutex_unlock (&self->command_lock);
+        if (!self->running_commands)
+            run_commands (self);
+        return FALSE;
+    }
+    g_queue_push_tail (&self->commands, (__bridge_retained void *) [command copy]);
+    schedule_commands (self);
+    g_mutex_unlock (&self->command_lock);
+    return TRUE;
+}
+
+/* Start running commands, once the pipeline is built. Runs on our context. */
+static void open_commands (GStreamerBackend *self)
+{
+    g_mutex_lock (&self->command_lock);
+    self->commands_ready = TRUE;
+    schedule_commands (self);
+    g_mutex_unlock (&self->command_lock);
+}
+
+/* Drop the queued commands and any made later, for deinit or a pipeline that could not be
+ * built. The commands hold a reference to self, this breaks the cycle. */
+static void close_commands (GStreamerBackend *self)
+{
+    GQueue dropped = G_QUEUE_INIT;
+
+    g_mutex_lock (&self->command_lock);
+    self->commands_closed = TRUE;
+    self->commands_ready = FALSE;
+    self->state_queued = FALSE;
+    self->viewport_queued = FALSE;
+    dropped = self->commands;
+    g_queue_init (&self->commands);
+    g_mutex_unlock (&self->command_lock);
+
+    /* Without the lock: releasing a command may release self */
+    g_queue_clear_full (&dropped, (GDestroyNotify) CFRelease);
+}
+
+static void complete_command (GStreamerCommandCompletion completion)
+{
+    if (completion)
+        dispatch_async (dispatch_get_main_queue (), completion);
+}
+
+static void run_state_command (GStreamerBackend *self, GStreamerCommandCompletion completion)
+{
+    GstState state;
+
+    g_mutex_lock (&self->command_lock);
+    state = self->requested_state;
+    self->state_queued = FALSE;
+    g_mutex_unlock (&self->command_lock);
+
+    self->target_state = state;
+    self->is_live = (gst_element_set_state (self->pipeline, state) == GST_STATE_CHANGE_NO_PREROLL);
+    complete_command (completion);
+}
+
+/* play and pause only set the target state, so a burst of them (e.g. from foreground and
+ * background notifications) is coalesced into the queued state command, which goes to the
+ * last state requested. The completions of the coalesced calls run after it. */
+static void request_state (GStreamerBackend *self, GstState state, GStreamerCommandCompletion completion)
+{
+    gboolean coalesced;
+
+    g_mutex_lock (&self->command_lock);
+    self->requested_state = state;
+    coalesced = self->state_queued;
+    self->state_queued = TRUE;
+    g_mutex_unlock (&self->command_lock);
+
+    if (coalesced) {
+        if (completion && !defer_command (self, ^{ complete_command (completion); }))
+            complete_command (completion);
+    } else if (!defer_command (self, ^{ run_state_command (self, completion); })) {
+        run_state_command (self, completion);
+    }
+}
+
+/*
+ * Interface methods
+ */
+
+-(id) init:(id) uiDelegate videoView:(UIView *)video_view
+{
+    return [self init:uiDelegate videoView:video_view latencyProfile:GStreamerLatencyProfileDefault];
+}
+
+-(id) init:(id) uiDelegate videoView:(UIView *)video_view latencyProfile:(GStreamerLatencyProfile) profile
+{
+    return [self init:uiDelegate videoView:video_view latencyProfile:profile decodeMode:GStreamerDecodeModeAuto];
+}
+
+-(id) init:(id) uiDelegate videoView:(UIView *)video_view latencyProfile:(GStreamerLatencyProfile) profile decodeMode:(GStreamerDecodeMode) mode
+{
+    if (self = [self init_common:uiDelegate videoView:video_view latencyProfile:profile decodeMode:mode])
+    {
+        /* Start the bus monitoring task. It only handles control and UI work, the media
+         * flows through the streaming threads. */
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+            [self app_function];
+        });
+    }
+
+    return self;
+}
+
+-(id) init:(id) uiDelegate videoView:(UIView *)video_view latencyProfile:(GStreamerLatencyProfile) profile decodeMode:(GStreamerDecodeMode) mode sharedContext:(GMainContext *) shared teardown:(dispatch_block_t) teardown
+{
+    if (self = [self init_common:uiDelegate videoView:video_view latencyProfile:profile decodeMode:mode])
+    {
+        self->shared_context = TRUE;
+        self->context = g_main_context_ref (shared);
+        self->teardown_block = teardown;
+
+        /* The thread running the shared context builds our pipeline */
+        g_main_context_invoke (context, (GSourceFunc) shared_start_cb, (__bridge void *)self);
+    }
+
+    return self;
+}
+
+-(id) init_common:(id) uiDelegate videoView:(UIView *)video_view latencyProfile:(GStreamerLatencyProfile) profile decodeMode:(GStreamerDecodeMode) mode
+{
+    if (self = [super init])
+    {
+        self->ui_delegate = uiDelegate;
+        self->ui_video_view = video_view;
+        if ([video_view isKindOfClass:[GStreamerMetalView class]])
+            self->metal_view = (GStreamerMetalView *) video_view;
+        self->duration = GST_CLOCK_TIME_NONE;
+        self->desired_position = GST_CLOCK_TIME_NONE;
+        self->last_seek_time = GST_CLOCK_TIME_NONE;
+        self->last_keyframe_request = GST_CLOCK_TIME_NONE;
+        self->adaptive_buffer_target = GST_CLOCK_TIME_NONE;
+        self->latency_profile = profile;
+        self->transport = GStreamerTransportAuto;
+        self->decode_mode = mode;
+        g_mutex_init (&self->stats_lock);
+        g_mutex_init (&self->event_lock);
+        g_mutex_init (&self->tap_lock);
+        g_mutex_init (&self->dvr_lock);
+        g_mutex_init (&self->command_lock);
+        g_mutex_init (&self->webrtc_lock);
+        g_queue_init (&self->commands);
+        self->dvr_fragments = g_ptr_array_new_with_free_func ((GDestroyNotify) free_dvr_fragment);
+        self->dvr_directory = g_strdup ([[NSTemporaryDirectory() stringByAppendingPathComponent:
+                                          [NSString stringWithFormat:@"GStreamerDVR-%p", self]] fileSystemRepresentation]);
+        self->jitterbuffers = g_ptr_array_new_with_free_func (gst_object_unref);
+        self->discard_sinks = g_ptr_array_new ();
+        self->tiles = g_ptr_array_new_with_free_func ((GDestroyNotify) free_tile);
+        self->canvas_width = COMPOSITE_CANVAS_WIDTH;
+        self->canvas_height = COMPOSITE_CANVAS_HEIGHT;
+        self->viewport_hfov = 90;
+        self->viewport_vfov = 90;
+        self->pending_level = -1;
+        self->upgrade_intervals = QUALITY_UPGRADE_INTERVALS;
+    }
+
+    return self;
+}
+
+-(void) dealloc
+{
+    if (context)
+        g_main_context_unref (context);
+    g_ptr_array_unref (jitterbuffers);
+    gst_object_replace ((GstObject **) &srt_source, NULL);
+    g_ptr_array_unref (discard_sinks);
+    g_ptr_array_unref (tiles);
+    clear_dvr_recording (self);
+    g_rmdir (dvr_directory);
+    g_free (dvr_directory);
+    g_ptr_array_unref (dvr_fragments);
+    g_free (live_uri);
+    g_free (backup_uri);
+    g_free (tcp_only_uri);
+    g_mutex_clear (&stats_lock);
+    g_mutex_clear (&event_lock);
+    g_mutex_clear (&tap_lock);
+    g_mutex_clear (&dvr_lock);
+    g_mutex_clear (&command_lock);
+    g_mutex_clear (&webrtc_lock);
+}
+
+-(void) deinit
+{
+    /* Runs after the calls made before it, those made after it are dropped */
+    if (defer_command (self, ^{ [self deinit]; }))
+        return;
+
+    close_commands(self);
+    if (shared_context) {
+        shared_stop_cb(self);
+    } else if (main_loop) {
+        g_main_loop_quit(main_loop);
+    }
+}
+
+-(void) play
+{
+    request_state(self, GST_STATE_PLAYING, nil);
+}
+
+-(void) playWithCompletion:(GStreamerCommandCompletion)completion
+{
+    request_state(self, GST_STATE_PLAYING, completion);
+}
+
+-(void) pause
+{
+    request_state(self, GST_STATE_PAUSED, nil);
+}
+
+-(void) pauseWithCompletion:(GStreamerCommandCompletion)completion
+{
+    request_state(self, GST_STATE_PAUSED, completion);
+}
+
+-(void) setUri:(NSString*)uri
+{
+    [self setUri:uri completion:nil];
+}
+
+-(void) setUri:(NSString*)uri completion:(GStreamerCommandCompletion)completion
+{
+    if (defer_command (self, ^{ [self setUri:uri completion:completion]; }))
+        return;
+
+    quality_uris = nil;
+    pending_level = -1;
+    cancel_reconnect(self);
+    switch_uri(self, [uri UTF8String]);
+    complete_command(completion);
+}
+
+-(void) afterPendingCommands:(GStreamerCommandCompletion)completion
+{
+    if (!defer_command (self, ^{ complete_command (completion); }))
+        complete_command(completion);
+}
+
+-(void) setQualityUris:(NSArray<NSString *> *)uris
+{
+    if (defer_command (self, ^{ [self setQualityUris:uris]; }))
+        return;
+
+    cancel_reconnect(self);
+    quality_uris = [uris copy];
+    pending_level = -1;
+    upgrade_intervals = QUALITY_UPGRADE_INTERVALS;
+    intervals_since_upgrade = QUALITY_MAX_UPGRADE_INTERVALS;
+    if (uris.count == 0)
+        return;
+
+    /* In Low Data Mode start from the lowest rendition, adaptation steps up if the link allows */
+    quality_level = network == NETWORK_CONSTRAINED ? uris.count - 1 : 0;
+    switch_uri(self, [uris[quality_level] UTF8String]);
+}
+
+-(void) prerollUri:(NSString*)uri
+{
+    gchar *char_uri;
+    GstBus *bus;
+
+    if (defer_command (self, ^{ [self prerollUri:uri]; }))
+        return;
+
+    discard_standby(self);
+    standby_pipeline = create_pipeline(self);
+    if (!standby_pipeline)
+        return;
+    char_uri = playback_uri(self, [uri UTF8String]);
+
+    /* Nobody watches the standby bus until the pipeline is promoted, drop its messages once
+     * errors have been noted */
+    g_atomic_int_set (&standby_failed, FALSE);
+    bus = gst_element_get_bus (standby_pipeline);
+    gst_bus_set_sync_handler (bus, standby_bus_sync_cb, (__bridge void *)self, NULL);
+    gst_object_unref (bus);
+
+    if (decode_mode == GStreamerDecodeModeHardware) {
+        if (!make_source(self, standby_pipeline, char_uri, "source", G_CALLBACK (source_pad_added_cb), (__bridge void *)self)) {
+            discard_standby(self);
+            g_free (char_uri);
+            return;
+        }
+    } else {
+        g_object_set(standby_pipeline, "uri", char_uri, NULL);
+    }
+    standby_uri = char_uri;
+
+    /* PAUSED is enough to connect and set up the session, live sources do not send any
+     * data before PLAYING */
+    gst_element_set_state (standby_pipeline, GST_STATE_PAUSED);
+    GST_DEBUG ("Prerolling %s", char_uri);
+}
+
+-(void) setPosition:(NSInteger)milliseconds
+{
+    if (defer_command (self, ^{ [self setPosition:milliseconds]; }))
+        return;
+
+    /* There is nothing to scrub through in a live stream */
+    if (is_live)
+        return;
+
+    gint64 position = (gint64)(milliseconds * GST_MSECOND);
+    GstSeekFlags flags = GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_NEAREST;
+
+    if (state >= GST_STATE_PAUSED) {
+        execute_seek(position, flags, self);
+    } else {
+        GST_DEBUG ("Scheduling seek to %" GST_TIME_FORMAT " for later", GST_TIME_ARGS (position));
+        self->desired_position = position;
+        self->desired_flags = flags;
+    }
+}
+
+-(void) setPositionAccurate:(NSInteger)milliseconds
+{
+    if (defer_command (self, ^{ [self setPositionAccurate:milliseconds]; }))
+        return;
+
+    /* There is nothing to scrub through in a live stream */
+    if (is_live)
+        return;
+
+    gint64 position = (gint64)(milliseconds * GST_MSECOND);
+
+    if (state >= GST_STATE_PAUSED) {
+        execute_seek(position, GST_SEEK_FLAG_ACCURATE, self);
+    } else {
+        GST_DEBUG ("Scheduling accurate seek to %" GST_TIME_FORMAT " for later", GST_TIME_ARGS (position));
+        self->desired_position = position;
+        self->desired_flags = GST_SEEK_FLAG_ACCURATE;
+    }
+}
+
+-(void) setSegmentCache:(GStreamerSegmentCache *)cache
+{
+    if (defer_command (self, ^{ [self setSegmentCache:cache]; }))
+        return;
+
+    segment_cache = cache;
+}
+
+-(void) setBackground:(BOOL)enabled
+{
+    GST_DEBUG ("%s background power mode", enabled ? "Entering" : "Leaving");
+    g_atomic_int_set (&background, enabled);
+}
+
+-(void) setTransport:(GStreamerTransport)new_transport
+{
+    if (defer_command (self, ^{ [self setTransport:new_transport]; }))
+        return;
+
+    transport = new_transport;
+}
+
+-(void) setFrameHandler:(GStreamerFrameHandler)handler
+{
+    g_mutex_lock (&tap_lock);
+    frame_handler = [handler copy];
+    g_atomic_int_set (&frame_tap_open, handler != nil);
+    g_mutex_unlock (&tap_lock);
+}
+
+-(void) setRenderMode:(GStreamerRenderMode)mode
+{
+    if (defer_command (self, ^{ [self setRenderMode:mode]; }))
+        return;
+
+    render_mode = mode;
+    if (video_sink)
+        configure_video_sink_latency(self);
+}
+
+-(void) setMemoryBudgetQueueBytes:(NSUInteger)queue_bytes decoderBuffers:(NSUInteger)decoder_buffers jitterbufferMs:(NSUInteger)jitterbuffer_ms
+{
+    if (defer_command (self, ^{ [self setMemoryBudgetQueueBytes:queue_bytes decoderBuffers:decoder_buffers jitterbufferMs:jitterbuffer_ms]; }))
+        return;
+
+    budget_queue_bytes = (guint) MIN (queue_bytes, G_MAXUINT);
+    budget_decoder_buffers = (guint) MIN (decoder_buffers, G_MAXUINT);
+    budget_jitterbuffer_ms = (guint) MIN (jitterbuffer_ms, G_MAXINT);
+
+    /* playbin keeps its network buffering size across URIs */
+    if (pipeline && decode_mode != GStreamerDecodeModeHardware && budget_queue_bytes > 0)
+        g_object_set (pipeline, "buffer-size", (gint) MIN (budget_queue_bytes, G_MAXINT), NULL);
+}
+
+-(void) setAdaptiveStartBitrate:(NSUInteger)bitrate bufferTarget:(NSTimeInterval)buffer_target lowLatency:(BOOL)low_latency
+{
+    if (defer_command (self, ^{ [self setAdaptiveStartBitrate:bitrate bufferTarget:buffer_target lowLatency:low_latency]; }))
+        return;
+
+    adaptive_start_bitrate = (guint) MIN (bitrate, G_MAXUINT);
+    adaptive_buffer_target = buffer_target > 0 ? (GstClockTime) (buffer_target * GST_SECOND) : GST_CLOCK_TIME_NONE;
+    adaptive_low_latency = low_latency;
+
+    if (pipeline && decode_mode != GStreamerDecodeModeHardware && GST_CLOCK_TIME_IS_VALID (adaptive_buffer_target))
+        g_object_set (pipeline, "buffer-duration", (gint64) adaptive_buffer_target, NULL);
+}
+
+-(void) setSRTLatency:(NSUInteger)latency_ms mode:(GStreamerSRTMode)mode
+{
+    if (defer_command (self, ^{ [self setSRTLatency:latency_ms mode:mode]; }))
+        return;
+
+    srt_latency_ms = latency_ms;
+    srt_mode = mode;
+}
+
+-(void) setAudioMode:(GStreamerAudioMode)mode
+{
+    if (defer_command (self, ^{ [self setAudioMode:mode]; }))
+        return;
+
+    audio_mode = mode;
+
+    /* playbin picks the flags and the audio sink up with the next URI */
+    if (pipeline && decode_mode != GStreamerDecodeModeHardware)
+        configure_playbin_audio(self, pipeline);
+}
+
+static const gchar *network_name (NetworkClass network)
+{
+    switch (network) {
+        case NETWORK_UNMETERED:
+            return "unmetered";
+        case NETWORK_CELLULAR:
+            return "cellular";
+        case NETWORK_CONSTRAINED:
+            return "constrained";
+        default:
+            return NULL;
+    }
+}
+
+static NetworkClass classify_path (nw_path_t path)
+{
+    if (nw_path_is_constrained (path))
+        return NETWORK_CONSTRAINED;
+    if (nw_path_is_expensive (path) || nw_path_uses_interface_type (path, nw_interface_type_cellular))
+        return NETWORK_CELLULAR;
+    return NETWORK_UNMETERED;
+}
+
+static nw_interface_type_t path_interface (nw_path_t path)
+{
+    static const nw_interface_type_t types[] = { nw_interface_type_wifi, nw_interface_type_wired, nw_interface_type_cellular };
+
+    for (int i = 0; i < G_N_ELEMENTS (types); i++) {
+        if (nw_path_uses_interface_type (path, types[i]))
+            return types[i];
+    }
+    return nw_interface_type_other;
+}
+
+static void stop_network_monitor (GStreamerBackend *self)
+{
+    if (self->path_monitor) {
+        nw_path_monitor_cancel (self->path_monitor);
+        self->path_monitor = nil;
+    }
+}
+
+-(void) setNetworkAware:(BOOL)enabled
+{
+    __weak GStreamerBackend *weak_self = self;
+    dispatch_queue_t queue;
+
+    if (defer_command (self, ^{ [self setNetworkAware:enabled]; }))
+        return;
+
+    if (!enabled) {
+        stop_network_monitor(self);
+        retune_network(self, NETWORK_UNKNOWN, nw_interface_type_other);
+        return;
+    }
+    if (path_monitor)
+        return;
+
+    /* Paths come in on a queue of their own and are applied on our context, in order */
+    queue = dispatch_queue_create ("org.gstreamer.swift.network",
+                                   dispatch_queue_attr_make_with_qos_class (DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0));
+    path_monitor = nw_path_monitor_create ();
+    nw_path_monitor_set_queue (path_monitor, queue);
+    nw_path_monitor_set_update_handler (path_monitor, ^(nw_path_t path) {
+        GStreamerBackend *backend = weak_self;
+        NetworkClass network = classify_path (path);
+        nw_interface_type_t interface = path_interface (path);
+
+        /* Offline: keep the tuning, the path the network comes back on decides */
+        if (!backend || nw_path_get_status (path) != nw_path_status_satisfied)
+            return;
+        if (!defer_command (backend, ^{ retune_network (backend, network, interface); }))
+            retune_network (backend, network, interface);
+    });
+    nw_path_monitor_start (path_monitor);
+}
+
+-(void) setReconnectAttempts:(NSUInteger)max_attempts
+{
+    if (defer_command (self, ^{ [self setReconnectAttempts:max_attempts]; }))
+        return;
+
+    reconnect_max_attempts = (guint) MIN (max_attempts, G_MAXUINT);
+    if (reconnect_max_attempts == 0)
+        cancel_reconnect(self);
+}
+
+-(void) setBackupUri:(NSString *)uri
+{
+    if (defer_command (self, ^{ [self setBackupUri:uri]; }))
+        return;
+
+    if (standby_is_backup(self))
+        discard_standby(self);
+    g_free (backup_uri);
+    backup_uri = g_strdup ([uri UTF8String]);
+    preroll_backup(self);
+}
+
+-(void) setCompositeUris:(NSArray<NSString *> *)uris columns:(NSUInteger)columns
+{
+    GstState current;
+    NSUInteger rows;
+
+    if (defer_command (self, ^{ [self setCompositeUris:uris columns:columns]; }))
+        return;
+
+    if (decode_mode != GStreamerDecodeModeHardware || !pipeline) {
+        [self setUIMessage:"Compositing needs the hardware decode mode"];
+        return;
+    }
+    quality_uris = nil;
+    pending_level = -1;
+    reset_stats(self);
+    cancel_reconnect(self);
+    discard_standby(self);
+    current = clear_hardware_sources(self);
+
+    if (uris.count == 0 || !build_mixer(self))
+        return;
+
+    /* Without a column count, lay the tiles out in a square grid */
+    if (columns == 0)
+        columns = (NSUInteger) ceil (sqrt ((double) uris.count));
+    rows = (uris.count + columns - 1) / columns;
+
+    [uris enumerateObjectsUsingBlock:^(NSString *uri, NSUInteger index, BOOL *stop) {
+        CompositeTile *tile = g_new0 (CompositeTile, 1);
+
+        tile->backend = self;
+        tile->mixer_pad = gst_element_request_pad_simple (self->mixer, "sink_%u");
+        if (!tile->mixer_pad) {
+            g_free (tile);
+            *stop = YES;
+            return;
+        }
+        tile->frame = CGRectMake ((CGFloat) (index % columns) / columns, (CGFloat) (index / columns) / rows,
+                                  1.0 / columns, 1.0 / rows);
+        layout_tile (self, tile);
+        g_ptr_array_add (self->tiles, tile);
+        tile->source = make_source (self, self->pipeline, [uri UTF8String], NULL, G_CALLBACK (tile_pad_added_cb), tile);
+    }];
+
+    if (current > GST_STATE_READY && target_state >= GST_STATE_PAUSED)
+        is_live = (gst_element_set_state (pipeline, target_state) == GST_STATE_CHANGE_NO_PREROLL);
+    GST_DEBUG ("Compositing %u streams in %u columns", (guint) uris.count, (guint) columns);
+}
+
+-(void) startWebRTC:(id<GStreamerWebRTCSignalling>)signalling stunServer:(NSString *)stun_server createOffer:(BOOL)create_offer
+{
+    GstState previous;
+
+    if (defer_command (self, ^{ [self startWebRTC:signalling stunServer:stun_server createOffer:create_offer]; }))
+        return;
+
+    if (decode_mode != GStreamerDecodeModeHardware || !pipeline) {
+        [self setUIMessage:"WebRTC needs the hardware decode mode"];
+        return;
+    }
+
+    quality_uris = nil;
+    pending_level = -1;
+    reset_stats(self);
+    cancel_reconnect(self);
+    discard_standby(self);
+    previous = clear_hardware_sources(self);
+
+    set_webrtc_signalling(self, signalling);
+    webrtc_offer = create_offer;
+    source = make_webrtc_source(self, [stun_server UTF8String]);
+    restore_hardware_state(self, previous);
+    GST_DEBUG ("Started a WebRTC session, %s", create_offer ? "offering" : "waiting for an offer");
+}
+
+-(void) setRemoteDescription:(NSString *)sdp type:(NSString *)type
+{
+    GstSDPMessage *message;
+    GstWebRTCSessionDescription *description;
+    GstWebRTCSDPType sdp_type;
+    GstPromise *promise = NULL;
+
+    if (defer_command (self, ^{ [self setRemoteDescription:sdp type:type]; }))
+        return;
+
+    if (!source || !webrtc_signalling)
+        return;
+
+    if ([type isEqualToString:@"offer"]) {
+        sdp_type = GST_WEBRTC_SDP_TYPE_OFFER;
+        promise = gst_promise_new_with_change_func ((GstPromiseChangeFunc) remote_offer_set_cb, (__bridge void *)self, NULL);
+    } else if ([type isEqualToString:@"answer"]) {
+        sdp_type = GST_WEBRTC_SDP_TYPE_ANSWER;
+    } else {
+        [self setUIMessage:"Unsupported WebRTC session description type"];
+        return;
+    }
+
+    if (gst_sdp_message_new_from_text ([sdp UTF8String], &message) != GST_SDP_OK) {
+        [self setUIMessage:"Unable to parse the remote session description"];
+        if (promise)
+            gst_promise_unref (promise);
+        return;
+    }
+
+    description = gst_webrtc_session_description_new (sdp_type, message);
+    g_signal_emit_by_name (source, "set-remote-description", description, promise);
+    gst_webrtc_session_description_free (description);
+}
+
+-(void) addRemoteIceCandidate:(NSString *)candidate sdpMLineIndex:(NSUInteger)mline_index
+{
+    if (defer_command (self, ^{ [self addRemoteIceCandidate:candidate sdpMLineIndex:mline_index]; }))
+        return;
+
+    if (source && webrtc_signalling)
+        g_signal_emit_by_name (source, "add-ice-candidate", (guint) mline_index, [candidate UTF8String]);
+}
+
+-(void) setTiledUris:(NSArray<NSString *> *)high_uris lowQualityUris:(NSArray<NSString *> *)low_uris columns:(NSUInteger)columns
+{
+    if (defer_command (self, ^{ [self setTiledUris:high_uris lowQualityUris:low_uris columns:columns]; }))
+        return;
+
+    if (high_uris.count == 0 || high_uris.count != low_uris.count || columns == 0 || high_uris.count % columns != 0) {
+        [self setUIMessage:"Tiled streams need a high and a low quality URI for every tile of a full grid"];
+        return;
+    }
+
+    /* Every tile starts at low quality, which connects fastest, and those in view step up */
+    [self setCompositeUris:low_uris columns:columns];
+    if (!mixer)
+        return;
+    for (guint i = 0; i < tiles->len; i++) {
+        CompositeTile *tile = g_ptr_array_index (tiles, i);
+
+        tile->uris[TILE_QUALITY_LOW] = g_strdup ([low_uris[i] UTF8String]);
+        tile->uris[TILE_QUALITY_HIGH] = g_strdup ([high_uris[i] UTF8String]);
+        tile->quality = TILE_QUALITY_LOW;
+    }
+    tiled_columns = (guint) columns;
+    tiled_rows = (guint) (high_uris.count / columns);
+    update_viewport (self);
+}
+
+/* Like play and pause, viewport updates are coalesced: only the latest one is applied */
+static void run_viewport_command (GStreamerBackend *self)
+{
+    g_mutex_lock (&self->command_lock);
+    self->viewport_yaw = self->requested_viewport[0];
+    self->viewport_pitch = self->requested_viewport[1];
+    self->viewport_hfov = self->requested_viewport[2];
+    self->viewport_vfov = self->requested_viewport[3];
+    self->viewport_queued = FALSE;
+    g_mutex_unlock (&self->command_lock);
+
+    update_viewport (self);
+}
+
+-(void) setViewportYaw:(double)yaw pitch:(double)pitch horizontalFov:(double)horizontal_fov verticalFov:(double)vertical_fov
+{
+    gboolean coalesced;
+
+    g_mutex_lock (&command_lock);
+    requested_viewport[0] = yaw;
+    requested_viewport[1] = CLAMP (pitch, -90, 90);
+    requested_viewport[2] = CLAMP (horizontal_fov, 0, 360);
+    requested_viewport[3] = CLAMP (vertical_fov, 0, 180);
+    coalesced = viewport_queued;
+    viewport_queued = TRUE;
+    g_mutex_unlock (&command_lock);
+
+    /* Tiles are switched on our context, where their first frames are picked up */
+    if (!coalesced && !defer_command (self, ^{ run_viewport_command (self); }))
+        run_viewport_command (self);
+}
+
+-(void) setCompositeTile:(NSUInteger)index frame:(CGRect)frame
+{
+    CompositeTile *tile;
+
+    if (defer_command (self, ^{ [self setCompositeTile:index frame:frame]; }))
+        return;
+
+    if (index >= tiles->len)
+        return;
+    tile = g_ptr_array_index (tiles, index);
+    tile->frame = frame;
+    layout_tile (self, tile);
+    if (tile->pending) {
+        tile->pending->frame = frame;
+        layout_tile (self, tile->pending);
+    }
+}
+
+-(void) setCompositeCanvasSize:(CGSize)size
+{
+    if (defer_command (self, ^{ [self setCompositeCanvasSize:size]; }))
+        return;
+
+    canvas_width = (gint) size.width;
+    canvas_height = (gint) size.height;
+    if (!mixer)
+        return;
+
+    update_mixer_caps (self);
+    for (guint i = 0; i < tiles->len; i++) {
+        CompositeTile *tile = g_ptr_array_index (tiles, i);
+
+        layout_tile (self, tile);
+        if (tile->pending)
+            layout_tile (self, tile->pending);
+    }
+}
+
+-(void) setDvrWindow:(NSTimeInterval)window
+{
+    if (defer_command (self, ^{ [self setDvrWindow:window]; }))
+        return;
+
+    dvr_window = window > 0 ? (GstClockTime) (window * GST_SECOND) : 0;
+    if (!dvr_window)
+        clear_dvr_recording (self);
+}
+
+-(void) replayLast:(NSTimeInterval)seconds
+{
+    gchar **locations;
+    GstState previous;
+
+    if (defer_command (self, ^{ [self replayLast:seconds]; }))
+        return;
+
+    if (decode_mode != GStreamerDecodeModeHardware) {
+        [self setUIMessage:"DVR needs the hardware decode mode"];
+        return;
+    }
+    locations = dvr_locations (self, (GstClockTime) (seconds * GST_SECOND));
+    if (!locations) {
+        [self setUIMessage:"Nothing recorded yet"];
+        return;
+    }
+
+    /* A rendition prerolled for the live stream is of no use while replaying */
+    cancel_reconnect (self);
+    discard_standby (self);
+    pending_level = -1;
+    reset_stats (self);
+    duration = GST_CLOCK_TIME_NONE;
+    desired_position = GST_CLOCK_TIME_NONE;
+
+    previous = clear_hardware_sources (self);
+    dvr_replaying = TRUE;
+    source = make_dvr_source (self, pipeline, locations, "source", G_CALLBACK (source_pad_added_cb), (__bridge void *)self);
+    restore_hardware_state (self, previous);
+    GST_DEBUG ("Replaying the last %.1f s of the recording", seconds);
+}
+
+-(void) resumeLive
+{
+    if (defer_command (self, ^{ [self resumeLive]; }))
+        return;
+
+    if (dvr_replaying && live_uri)
+        switch_uri (self, live_uri);
+}
+
+-(void) exportClip:(NSTimeInterval)seconds toURL:(NSURL *)url completion:(GStreamerClipCompletion)completion
+{
+    gchar **locations;
+    DvrExport *export;
+    GstElement *muxer, *sink;
+    GSource *watch;
+    GstBus *bus;
+
+    if (defer_command (self, ^{ [self exportClip:seconds toURL:url completion:completion]; }))
+        return;
+
+    locations = dvr_locations (self, (GstClockTime) (seconds * GST_SECOND));
+    export = g_new0 (DvrExport, 1);
+    export->completion = (__bridge_retained void *) [completion copy];
+    if (!locations) {
+        finish_dvr_export (export, dvr_error (GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_NOT_FOUND, "Nothing recorded yet"));
+        return;
+    }
+
+    /* The fragments are remuxed as they are, the clip starts on the keyframe of the first one */
+    export->pipeline = gst_pipeline_new ("dvr-export");
+    muxer = gst_element_factory_make ("mp4mux", NULL);
+    sink = gst_element_factory_make ("filesink", NULL);
+    if (!muxer || !sink) {
+        release_floating (&muxer);
+        release_floating (&sink);
+        g_strfreev (locations);
+        finish_dvr_export (export, dvr_error (GST_CORE_ERROR, GST_CORE_ERROR_MISSING_PLUGIN, "Unable to create mp4mux or filesink"));
+        return;
+    }
+    g_object_set (sink, "location", url.fileSystemRepresentation, NULL);
+    gst_bin_add_many (GST_BIN (export->pipeline), muxer, sink, NULL);
+    gst_element_link (muxer, sink);
+    if (!make_dvr_source (self, export->pipeline, locations, NULL, G_CALLBACK (export_pad_added_cb), muxer)) {
+        finish_dvr_export (export, dvr_error (GST_CORE_ERROR, GST_CORE_ERROR_MISSING_PLUGIN, "Unable to create splitmuxsrc"));
+        return;
+    }
+
+    /* The export runs next to whatever is playing, its bus is watched from our context */
+    bus = gst_element_get_bus (export->pipeline);
+    watch = gst_bus_create_watch (bus);
+    g_source_set_callback (watch, (GSourceFunc) export_bus_cb, export, NULL);
+    g_source_attach (watch, context);
+    g_source_unref (watch);
+    gst_object_unref (bus);
+    gst_element_set_state (export->pipeline, GST_STATE_PLAYING);
+}
+
+/*
+ * Private methods
+ */
+
+/* Queue UI events. Must be called with event_lock held, after storing their values. Only the
+ * first event since the last delivery dispatches to the main queue. */
+static void post_ui_events (GStreamerBackend *self, guint events)
+{
+    if (!self->pending_events) {
+        dispatch_async (dispatch_get_main_queue (), ^{
+            [self deliver_ui_events];
+        });
+    }
+    self->pending_events |= events;
+}
+
+/* Hand the queued UI events to the UI delegate, on the main queue */
+-(void) deliver_ui_events
+{
+    id delegate = ui_delegate;
+    guint events;
+    GStreamerPlaybackState state;
+    gint buffering, width, height, position, clip_duration;
+    NSError *error;
+    GStreamerStats *stats;
+    NSUInteger quality;
+
+    g_mutex_lock (&event_lock);
+    events = pending_events;
+    state = event_state;
+    buffering = event_buffering;
+    error = event_error;
+    stats = event_stats;
+    quality = event_quality;
+    width = event_width;
+    height = event_height;
+    position = event_position;
+    clip_duration = event_duration;
+    pending_events = 0;
+    event_error = nil;
+    event_stats = nil;
+    g_mutex_unlock (&event_lock);
+
+    if (!delegate)
+        return;
+    if ((events & UI_EVENT_STATE) && [delegate respondsToSelector:@selector(gstreamerStateChanged:)])
+        [delegate gstreamerStateChanged:state];
+    if ((events & UI_EVENT_MEDIA_SIZE) && [delegate respondsToSelector:@selector(mediaSizeChanged:height:)])
+        [delegate mediaSizeChanged:width height:height];
+    if ((events & UI_EVENT_BUFFERING) && [delegate respondsToSelector:@selector(gstreamerBufferingChanged:)])
+        [delegate gstreamerBufferingChanged:buffering];
+    if ((events & UI_EVENT_ERROR) && [delegate respondsToSelector:@selector(gstreamerFailed:)])
+        [delegate gstreamerFailed:error];
+    if ((events & UI_EVENT_QUALITY) && [delegate respondsToSelector:@selector(gstreamerQualityChanged:)])
+        [delegate gstreamerQualityChanged:quality];
+    if ((events & UI_EVENT_STATS) && [delegate respondsToSelector:@selector(gstreamerStatsUpdated:)])
+        [delegate gstreamerStatsUpdated:stats];
+    if ((events & UI_EVENT_POSITION) && [delegate respondsToSelector:@selector(setCurrentPosition:duration:)])
+        [delegate setCurrentPosition:position duration:clip_duration];
+}
+
+/* Tell the application the current position and clip duration */
+-(void) setCurrentUIPosition:(gint)pos duration:(gint)dur
+{
+    g_mutex_lock (&event_lock);
+    event_position = pos;
+    event_duration = dur;
+    post_ui_events (self, UI_EVENT_POSITION);
+    g_mutex_unlock (&event_lock);
+}
+
+/* Change the message on the UI through the UI delegate. Only used for rare diagnostics,
+ * regular pipeline activity goes through the typed UI events. */
+-(void)setUIMessage:(gchar*) message
+{
+    NSString *string = [NSString stringWithUTF8String:message];
+    dispatch_async (dispatch_get_main_queue (), ^{
+        id delegate = self->ui_delegate;
+        if (delegate && [delegate respondsToSelector:@selector(gstreamerSetUIMessage:)])
+            [delegate gstreamerSetUIMessage:string];
+    });
+}
+
+/* Retrieve errors from the bus and show them on the UI */
+static void error_cb (GstBus *bus, GstMessage *msg, GStreamerBackend *self)
+{
+    GError *err;
+    gchar *debug_info;
+    gchar *message_string;
+
+    gst_message_parse_error (msg, &err, &debug_info);
+
+    /* The hardware decoder failed to initialise (unsupported profile or resolution, or no
+     * decoder session available). Rebuild the decoding chain with a software decoder instead
+     * of giving up on the stream. */
+    if (is_hardware_decoder (GST_MESSAGE_SRC (msg)) && !self->software_decode) {
+        message_string = g_strdup_printf ("Hardware decoder failed (%s), falling back to software decoding", err->message);
+        g_clear_error (&err);
+        g_free (debug_info);
+        [self setUIMessage:message_string];
+        g_free (message_string);
+        self->software_decode = TRUE;
+        gst_element_set_state (self->pipeline, GST_STATE_READY);
+        teardown_decode_chain (self);
+        gst_element_set_state (self->pipeline, self->target_state);
+        return;
+    }
+
+    /* The network or the server went away: reconnect rather than give up on the stream. Once
+     * the attempts run out, the error is reported like any other. */
+    if (err->domain == GST_RESOURCE_ERROR && err->code != GST_RESOURCE_ERROR_NOT_AUTHORIZED && schedule_reconnect (self)) {
+        GST_WARNING_OBJECT (msg->src, "%s, reconnecting (%s)", err->message, debug_info ? debug_info : "no details");
+        g_clear_error (&err);
+        g_free (debug_info);
+        return;
+    }
+
+    GST_ERROR_OBJECT (msg->src, "%s (%s)", err->message, debug_info ? debug_info : "no details");
+    g_mutex_lock (&self->event_lock);
+    if (!self->event_error) {
+        self->event_error = [NSError errorWithDomain:[NSString stringWithUTF8String:g_quark_to_string (err->domain)]
+                                                code:err->code
+                                            userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithUTF8String:err->message],
+                                                        GStreamerErrorSourceKey: [NSString stringWithUTF8String:GST_OBJECT_NAME (msg->src)] }];
+    }
+    post_ui_events (self, UI_EVENT_ERROR);
+    g_mutex_unlock (&self->event_lock);
+    g_clear_error (&err);
+    g_free (debug_info);
+    gst_element_set_state (self->pipeline, GST_STATE_NULL);
+}
+
+/* Decoders report corrupted or undecodable frames as warnings. Ask for a keyframe so the picture
+ * recovers right away instead of at the next GOP boundary. */
+static void warning_cb (GstBus *bus, GstMessage *msg, GStreamerBackend *self)
+{
+    GstClockTime now = gst_util_get_timestamp ();
+    GError *err;
+    GstPad *sink_pad;
+
+    /* rtspsrc received nothing over UDP and retried over TCP. Remember it, so reconnects to
+     * this server go straight to TCP instead of waiting for the UDP timeout again. */
+    if (is_rtsp_source (GST_MESSAGE_SRC (msg))) {
+        gst_message_parse_warning (msg, &err, NULL);
+        if (err->domain == GST_RESOURCE_ERROR && err->code == GST_RESOURCE_ERROR_READ) {
+            g_free (self->tcp_only_uri);
+            g_object_get (GST_MESSAGE_SRC (msg), "location", &self->tcp_only_uri, NULL);
+            GST_DEBUG ("UDP failed for %s, using TCP from now on", self->tcp_only_uri);
+        }
+        g_clear_error (&err);
+        return;
+    }
+
+    if (!GST_IS_VIDEO_DECODER (GST_MESSAGE_SRC (msg)))
+        return;
+
+    gst_message_parse_warning (msg, &err, NULL);
+    GST_WARNING_OBJECT (GST_MESSAGE_SRC (msg), "Decode error: %s", err->message);
+    g_clear_error (&err);
+
+    if (GST_CLOCK_TIME_IS_VALID (self->last_keyframe_request) && now - self->last_keyframe_request < KEYFRAME_REQUEST_MIN_INTERVAL)
+        return;
+    self->last_keyframe_request = now;
+    sink_pad = gst_element_get_static_pad (GST_ELEMENT (GST_MESSAGE_SRC (msg)), "sink");
+    if (sink_pad) {
+        request_keyframe (sink_pad);
+        gst_object_unref (sink_pad);
+    }
+}
+
+/* Delete the files in the DVR directory that are not part of the recording: fragments that
+ * earlier recorders did not get to close. Called with dvr_lock held. */
+static void prune_dvr_directory (GStreamerBackend *self, gint generation)
+{
+    GDir *dir = g_dir_open (self->dvr_directory, 0, NULL);
+    const gchar *name;
+
+    if (!dir)
+        return;
+    while ((name = g_dir_read_name (dir))) {
+        gchar *path = g_build_filename (self->dvr_directory, name, NULL);
+        gboolean recorded = (gint) g_ascii_strtoll (name, NULL, 10) == generation;
+
+        for (guint i = 0; i < self->dvr_fragments->len && !recorded; i++)
+            recorded = g_strcmp0 (((DvrFragment *) g_ptr_array_index (self->dvr_fragments, i))->location, path) == 0;
+        if (!recorded)
+            g_unlink (path);
+        g_free (path);
+    }
+    g_dir_close (dir);
+}
+
+/* splitmuxsink closed a fragment: add it to the recording, and drop the fragments that fell
+ * out of the window. One extra fragment is kept, so a replay or export of the whole window
+ * does not lose its first fragment to the next one being closed. */
+static void add_dvr_fragment (GStreamerBackend *self, const GstStructure *structure)
+{
+    const gchar *location = gst_structure_get_string (structure, "location");
+    GstClockTime keep = self->dvr_window ? self->dvr_window + DVR_FRAGMENT_DURATION : 0;
+    GstClockTime kept = 0;
+    DvrFragment *fragment;
+    gboolean new_recorder;
+    guint first;
+
+    if (!location)
+        return;
+    fragment = g_new0 (DvrFragment, 1);
+    fragment->location = g_strdup (location);
+    fragment->generation = (gint) g_ascii_strtoll (strrchr (location, '/') ? strrchr (location, '/') + 1 : location, NULL, 10);
+    if (!gst_structure_get_clock_time (structure, "fragment-duration", &fragment->duration))
+        fragment->duration = DVR_FRAGMENT_DURATION;
+
+    g_mutex_lock (&self->dvr_lock);
+    new_recorder = self->dvr_fragments->len == 0 ||
+                   ((DvrFragment *) g_ptr_array_index (self->dvr_fragments, self->dvr_fragments->len - 1))->generation != fragment->generation;
+    g_ptr_array_add (self->dvr_fragments, fragment);
+    for (first = self->dvr_fragments->len; first > 0 && kept < keep; first--)
+        kept += ((DvrFragment *) g_ptr_array_index (self->dvr_fragments, first - 1))->duration;
+    for (guint i = 0; i < first; i++)
+        g_unlink (((DvrFragment *) g_ptr_array_index (self->dvr_fragments, i))->location);
+    g_ptr_array_remove_range (self->dvr_fragments, 0, first);
+    if (new_recorder)
+        prune_dvr_directory (self, fragment->generation);
+    g_mutex_unlock (&self->dvr_lock);
+}
+
+/* The HLS and DASH demuxers post statistics after each fragment download, and hlsdemux the
+ * bitrate of the variant it picked whenever it switches. The DVR recorder reports each
+ * fragment it closes. */
+static void element_cb (GstBus *bus, GstMessage *msg, GStreamerBackend *self)
+{
+    const GstStructure *structure = gst_message_get_structure (msg);
+    GstClockTime download_time;
+    guint64 size;
+    gint bitrate;
+
+    if (gst_structure_has_name (structure, "splitmuxsink-fragment-closed")) {
+        add_dvr_fragment (self, structure);
+        return;
+    }
+    if (!gst_structure_has_name (structure, "adaptive-streaming-statistics"))
+        return;
+
+    if (gst_structure_get_int (structure, "bitrate", &bitrate) && bitrate > 0 && (guint) bitrate != self->abr_bitrate) {
+        if (self->abr_bitrate)
+            self->abr_switches++;
+        self->abr_bitrate = bitrate;
+        GST_DEBUG ("Adaptive streaming switched to the %d bit/s variant", bitrate);
+    }
+    if (gst_structure_get_clock_time (structure, "fragment-download-time", &download_time) && download_time > 0 &&
+        gst_structure_get_uint64 (structure, "fragment-size", &size)) {
+        self->abr_download_ms = download_time / (gdouble) GST_MSECOND;
+        self->abr_throughput_kbps = size * 8 / (download_time / (gdouble) GST_MSECOND);
+    }
+}
+
+/* Called when the End Of the Stream is reached. Just move to the beginning of the media and pause. */
+static void eos_cb (GstBus *bus, GstMessage *msg, GStreamerBackend *self) {
+    /* A live stream only ends when the server or the sender closes the session */
+    if (self->is_live && schedule_reconnect (self))
+        return;
+
+    self->target_state = GST_STATE_PAUSED;
+    self->is_live = (gst_element_set_state (self->pipeline, GST_STATE_PAUSED) == GST_STATE_CHANGE_NO_PREROLL);
+}
+
+/* Called when buffering messages are received. We inform the UI about the current buffering level and
+ * keep the pipeline paused until 100% buffering is reached. At that point, set the desired state. */
+static void buffering_cb (GstBus *bus, GstMessage *msg, GStreamerBackend *self) {
+    gint percent;
+
+    if (self->is_live)
+        return;
+
+    gst_message_parse_buffering (msg, &percent);
+    g_mutex_lock (&self->event_lock);
+    self->event_buffering = percent;
+    post_ui_events (self, UI_EVENT_BUFFERING);
+    g_mutex_unlock (&self->event_lock);
+
+    if (percent < 100 && self->target_state >= GST_STATE_PAUSED) {
+        self->buffering_stalled = TRUE;
+        gst_element_set_state (self->pipeline, GST_STATE_PAUSED);
+    } else if (self->target_state >= GST_STATE_PLAYING) {
+        gst_element_set_state (self->pipeline, GST_STATE_PLAYING);
+    }
+}
+
+/* Move the pipeline to the system clock for good, the provider of the lost one is going
+ * away. The PAUSED/PLAYING cycle lets the pipeline pick a new base time from the start time
+ * it kept, so the running time carries on where the lost clock left it. */
+static void switch_clock (GStreamerBackend *self)
+{
+    GstClock *clock = gst_system_clock_obtain ();
+
+    gst_pipeline_use_clock (GST_PIPELINE (self->pipeline), clock);
+    gst_object_unref (clock);
+    gst_element_set_state (self->pipeline, GST_STATE_PAUSED);
+    gst_element_set_state (self->pipeline, GST_STATE_PLAYING);
+    GST_DEBUG ("Switched to the system clock");
+}
+
+/* Called when the clock is lost. In the latest-frame render mode we keep the system clock from
+ * then on, so the picture does not stall again on the next clock provider that goes away. */
+static void clock_lost_cb (GstBus *bus, GstMessage *msg, GStreamerBackend *self) {
+    if (self->render_mode == GStreamerRenderModeLatestFrame && self->target_state >= GST_STATE_PLAYING) {
+        switch_clock (self);
+    } else if (self->target_state >= GST_STATE_PLAYING) {
+        gst_element_set_state (self->pipeline, GST_STATE_PAUSED);
+        gst_element_set_state (self->pipeline, GST_STATE_PLAYING);
+    }
+}
+
+/* Called from the streaming thread of the video sink for every frame it receives */
+static GstPadProbeReturn video_sink_probe_cb (GstPad *pad, GstPadProbeInfo *info, GStreamerBackend *self)
+{
+    static dispatch_once_t deferred_plugins_once;
+
+    g_atomic_int_inc (&self->frames_rendered);
+
+    /* First frame since a reconnect: the outage is over */
+    if (g_atomic_int_get (&self->outage_open) && g_atomic_int_compare_and_exchange (&self->outage_open, TRUE, FALSE))
+        g_atomic_int_set (&self->last_outage_ms, (gint) ((g_get_monotonic_time () - self->outage_start) / 1000));
+
+    /* First frame on screen: the rest of the plugins can be registered without
+     * delaying startup */
+    dispatch_once (&deferred_plugins_once, ^{
+        dispatch_async (dispatch_get_global_queue (QOS_CLASS_UTILITY, 0), ^{
+            gst_ios_register_deferred_plugins ();
+        });
+    });
+    return GST_PAD_PROBE_OK;
+}
+
+/* Ask the sender for a keyframe with an upstream force-key-unit event from a decoder. The RTP
+ * session turns it into an RTCP PLI or FIR when the sender supports one of them; sources without
+ * a way back to the sender (SRT, files) ignore it. */
+static void request_keyframe (GstPad *decoder_sink_pad)
+{
+    GST_DEBUG_OBJECT (decoder_sink_pad, "Requesting a keyframe");
+    gst_pad_push_event (decoder_sink_pad, gst_video_event_new_upstream_force_key_unit (GST_CLOCK_TIME_NONE, TRUE, 0));
+}
+
+/* Where the stream into a decoder stands, kept in the qdata of its sink pad */
+enum {
+    DECODER_STARTING,            /* First buffer not seen yet, also after the background mode */
+    DECODER_AWAITING_KEYFRAME,   /* Started on a delta unit, a keyframe was requested */
+    DECODER_RUNNING
+};
+
+/* Called from the streaming thread in front of every video decoder. Nothing is decoded before
+ * the first keyframe. When the stream starts on a delta unit, which with long GOPs means waiting
+ * seconds for the next one, a keyframe is requested right away.
+ * In background power mode nothing reaches the decoder, which could not use the hardware or the
+ * GL context anyway, while the source keeps the session alive. Afterwards the decoder starts over
+ * as above, the parsers repeat SPS/PPS in front of every keyframe. */
+static GstPadProbeReturn decoder_probe_cb (GstPad *pad, GstPadProbeInfo *info, GStreamerBackend *self)
+{
+    static GQuark state_quark;
+    gint state;
+
+    if (!state_quark)
+        state_quark = g_quark_from_static_string ("gstreamer-backend-decoder-state");
+
+    if (g_atomic_int_get (&self->background)) {
+        g_object_set_qdata (G_OBJECT (pad), state_quark, GINT_TO_POINTER (DECODER_STARTING));
+        return GST_PAD_PROBE_DROP;
+    }
+
+    state = GPOINTER_TO_INT (g_object_get_qdata (G_OBJECT (pad), state_quark));
+    if (state == DECODER_RUNNING)
+        return GST_PAD_PROBE_OK;
+
+    if (!GST_BUFFER_FLAG_IS_SET (GST_PAD_PROBE_INFO_BUFFER (info), GST_BUFFER_FLAG_DELTA_UNIT)) {
+        GST_DEBUG_OBJECT (pad, "Starting decode on a keyframe");
+        g_object_set_qdata (G_OBJECT (pad), state_quark, GINT_TO_POINTER (DECODER_RUNNING));
+        return GST_PAD_PROBE_OK;
+    }
+    if (state == DECODER_STARTING) {
+        request_keyframe (pad);
+        g_object_set_qdata (G_OBJECT (pad), state_quark, GINT_TO_POINTER (DECODER_AWAITING_KEYFRAME));
+    }
+    return GST_PAD_PROBE_DROP;
+}
+
+/* Whether an element is one of the HLS or DASH demuxers */
+static gboolean is_adaptive_demuxer (GstElement *element)
+{
+    static const gchar *names[] = { "hlsdemux2", "dashdemux2", "hlsdemux", "dashdemux", NULL };
+    GstElementFactory *factory = gst_element_get_factory (element);
+
+    for (int i = 0; factory && names[i]; i++) {
+        if (g_strcmp0 (GST_OBJECT_NAME (factory), names[i]) == 0)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* Set an adaptive demuxer property, if this demuxer has it */
+static void set_demuxer_property (GstElement *demuxer, const gchar *name, const GValue *value)
+{
+    if (g_object_class_find_property (G_OBJECT_GET_CLASS (demuxer), name))
+        g_object_set_property (G_OBJECT (demuxer), name, value);
+}
+
+/* The bitrate set by setAdaptiveStartBitrate:, or the one the network calls for */
+static guint adaptive_start_bitrate (GStreamerBackend *self)
+{
+    if (self->adaptive_start_bitrate > 0)
+        return self->adaptive_start_bitrate;
+    switch (self->network) {
+        case NETWORK_CELLULAR:
+            return NETWORK_CELLULAR_START_BITRATE;
+        case NETWORK_CONSTRAINED:
+            return NETWORK_CONSTRAINED_START_BITRATE;
+        default:
+            return 0;
+    }
+}
+
+/* Low Data Mode caps the variants, lifted again once the path is no longer constrained */
+static void configure_demuxer_max_bitrate (GStreamerBackend *self, GstElement *demuxer)
+{
+    GValue value = G_VALUE_INIT;
+
+    g_value_init (&value, G_TYPE_UINT);
+    g_value_set_uint (&value, self->network == NETWORK_CONSTRAINED ? NETWORK_CONSTRAINED_MAX_BITRATE : 0);
+    set_demuxer_property (demuxer, "max-bitrate", &value);
+    g_value_unset (&value);
+}
+
+/* Apply the adaptive streaming tuning to a new HLS or DASH demuxer. The adaptivedemux2 demuxers
+ * download ahead on their own thread up to the high watermark, and start playing once the buffer
+ * target is reached instead of after several full segments. */
+static void configure_adaptive_demuxer (GStreamerBackend *self, GstElement *demuxer)
+{
+    GValue value = G_VALUE_INIT;
+    guint start_bitrate = adaptive_start_bitrate (self);
+
+    if (start_bitrate > 0) {
+        g_value_init (&value, G_TYPE_UINT);
+        g_value_set_uint (&value, start_bitrate);
+        set_demuxer_property (demuxer, "start-bitrate", &value);
+        g_value_unset (&value);
+    }
+    if (self->network != NETWORK_UNKNOWN)
+        configure_demuxer_max_bitrate (self, demuxer);
+
+    if (GST_CLOCK_TIME_IS_VALID (self->adaptive_buffer_target)) {
+        g_value_init (&value, G_TYPE_UINT64);
+        g_value_set_uint64 (&value, self->adaptive_buffer_target);
+        set_demuxer_property (demuxer, "high-watermark-time", &value);
+        set_demuxer_property (demuxer, "max-buffering-time", &value);
+        g_value_set_uint64 (&value, self->adaptive_buffer_target / 4);
+        set_demuxer_property (demuxer, "low-watermark-time", &value);
+        g_value_unset (&value);
+    }
+
+    if (self->adaptive_low_latency) {
+        g_value_init (&value, G_TYPE_BOOLEAN);
+        g_value_set_boolean (&value, TRUE);
+        set_demuxer_property (demuxer, "low-latency", &value);
+        g_value_unset (&value);
+    }
+    GST_DEBUG_OBJECT (demuxer, "Configured for adaptive streaming, start bitrate %u", start_bitrate);
+}
+
+/* Called after the elements downstream of a video decoder answered its allocation query. Cap the
+ * number of buffers its output pool may grow to, keeping what the decoder needs at minimum. */
+static GstPadProbeReturn decoder_allocation_probe_cb (GstPad *pad, GstPadProbeInfo *info, GStreamerBackend *self)
+{
+    GstQuery *query = GST_PAD_PROBE_INFO_QUERY (info);
+    guint max_buffers = self->budget_decoder_buffers;
+    GstBufferPool *pool;
+    guint size, min, max;
+
+    if (GST_QUERY_TYPE (query) != GST_QUERY_ALLOCATION || max_buffers == 0)
+        return GST_PAD_PROBE_OK;
+
+    /* Without a proposed pool the decoder creates an unlimited one of its own */
+    if (gst_query_get_n_allocation_pools (query) == 0)
+        gst_query_add_allocation_pool (query, NULL, 0, 0, max_buffers);
+
+    for (guint i = 0; i < gst_query_get_n_allocation_pools (query); i++) {
+        gst_query_parse_nth_allocation_pool (query, i, &pool, &size, &min, &max);
+        if (max == 0 || max > max_buffers)
+            gst_query_set_nth_allocation_pool (query, i, pool, size, min, MAX (min, max_buffers));
+        if (pool)
+            gst_object_unref (pool);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+/* Called for every element added anywhere in a pipeline, to set up the video decoders and RTP
+ * depayloaders, whether we created them or decodebin did. Decode errors stay warnings, so a
+ * corrupted reference chain is recovered by asking for a keyframe instead of stopping the
+ * pipeline, and the depayloaders ask for one themselves when packets are lost. */
+static void deep_element_added_cb (GstBin *pipeline, GstBin *bin, GstElement *element, GStreamerBackend *self)
+{
+    GstPad *sink_pad, *src_pad;
+
+    if (g_object_class_find_property (G_OBJECT_GET_CLASS (element), "request-keyframe"))
+        g_object_set (element, "request-keyframe", TRUE, NULL);
+
+    if (is_adaptive_demuxer (element))
+        configure_adaptive_demuxer (self, element);
+
+    /* queue, queue2, multiqueue and decodebin, which sizes its multiqueue itself */
+    if (self->budget_queue_bytes > 0 && g_object_class_find_property (G_OBJECT_GET_CLASS (element), "max-size-bytes")) {
+        guint max_bytes;
+
+        g_object_get (element, "max-size-bytes", &max_bytes, NULL);
+        if (max_bytes == 0 || max_bytes > self->budget_queue_bytes)
+            g_object_set (element, "max-size-bytes", self->budget_queue_bytes, NULL);
+    }
+
+    if (!GST_IS_VIDEO_DECODER (element))
+        return;
+    gst_video_decoder_set_max_errors (GST_VIDEO_DECODER (element), -1);
+    src_pad = gst_element_get_static_pad (element, "src");
+    if (src_pad) {
+        gst_pad_add_probe (src_pad, GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM | GST_PAD_PROBE_TYPE_PULL,
+                           (GstPadProbeCallback) decoder_allocation_probe_cb, (__bridge void *)self, NULL);
+        gst_object_unref (src_pad);
+    }
+    sink_pad = gst_element_get_static_pad (element, "sink");
+    if (sink_pad) {
+        gst_pad_add_probe (sink_pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback) decoder_probe_cb,
+                           (__bridge void *)self, NULL);
+        gst_object_unref (sink_pad);
+    }
+}
+
+/* QoS class a boosted streaming thread had before, to go back to when its task leaves the
+ * thread, which the task pool hands to other tasks next */
+typedef struct {
+    qos_class_t qos_class;
+    int relative_priority;
+} ThreadQos;
+
+static GPrivate saved_thread_qos = G_PRIVATE_INIT (g_free);
+
+/* Whether a streaming thread decodes or renders the video: the output task of a decoder, or
+ * the render queue feeding the video sink. Sources, the DVR writer, audio and the frame tap
+ * keep their default QoS. */
+static gboolean is_video_thread_owner (GstElement *owner)
+{
+    return owner && (GST_IS_VIDEO_DECODER (owner) || g_strcmp0 (GST_OBJECT_NAME (owner), "render-queue") == 0);
+}
+
+/* Run the calling streaming thread at the user-interactive QoS class, so decoding and rendering
+ * are not preempted by ARKit tracking or other app work and frames do not arrive late */
+static void raise_thread_qos (GstElement *owner)
+{
+    ThreadQos *saved;
+
+    if (g_private_get (&saved_thread_qos))
+        return;
+    saved = g_new0 (ThreadQos, 1);
+    pthread_get_qos_class_np (pthread_self (), &saved->qos_class, &saved->relative_priority);
+    if (pthread_set_qos_class_self_np (QOS_CLASS_USER_INTERACTIVE, 0) != 0) {
+        GST_WARNING_OBJECT (owner, "Could not raise the QoS class of the streaming thread");
+        g_free (saved);
+        return;
+    }
+    g_private_set (&saved_thread_qos, saved);
+    GST_DEBUG_OBJECT (owner, "Streaming thread running at user-interactive QoS");
+}
+
+/* Give the calling thread back the QoS class it had before raise_thread_qos() */
+static void restore_thread_qos (GstElement *owner)
+{
+    ThreadQos *saved = g_private_get (&saved_thread_qos);
+
+    if (!saved)
+        return;
+    pthread_set_qos_class_self_np (saved->qos_class, saved->relative_priority);
+    g_private_replace (&saved_thread_qos, NULL);
+    GST_DEBUG_OBJECT (owner, "Streaming thread back to its previous QoS");
+}
+
+/* Streaming threads post stream-status ENTER and LEAVE messages from the thread itself when a
+ * task starts and stops running on it */
+static void set_streaming_thread_qos (GstMessage *msg)
+{
+    GstStreamStatusType type;
+    GstElement *owner;
+
+    if (GST_MESSAGE_TYPE (msg) != GST_MESSAGE_STREAM_STATUS)
+        return;
+    gst_message_parse_stream_status (msg, &type, &owner);
+    if (type == GST_STREAM_STATUS_TYPE_ENTER && is_video_thread_owner (owner))
+        raise_thread_qos (owner);
+    else if (type == GST_STREAM_STATUS_TYPE_LEAVE)
+        restore_thread_qos (owner);
+}
+
+/* Raise the video threads of a promoted standby pipeline from within, with the first buffer
+ * they push: they entered while the pipeline was in the background and kept their QoS */
+static GstPadProbeReturn raise_thread_qos_probe_cb (GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    GstElement *owner = GST_ELEMENT (gst_pad_get_parent (pad));
+
+    raise_thread_qos (owner);
+    if (owner)
+        gst_object_unref (owner);
+    return GST_PAD_PROBE_REMOVE;
+}
+
+static void raise_video_threads_qos (GstElement *pipeline)
+{
+    GstIterator *iterator = gst_bin_iterate_recurse (GST_BIN (pipeline));
+    GValue item = G_VALUE_INIT;
+
+    while (gst_iterator_next (iterator, &item) == GST_ITERATOR_OK) {
+        GstElement *element = g_value_get_object (&item);
+        GstPad *pad;
+
+        if (is_video_thread_owner (element) && (pad = gst_element_get_static_pad (element, "src"))) {
+            gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, raise_thread_qos_probe_cb, NULL, NULL);
+            gst_object_unref (pad);
+        }
+        g_value_reset (&item);
+    }
+    g_value_unset (&item);
+    gst_iterator_free (iterator);
+}
+
+/* Synchronous handler of the bus of the current pipeline, called from the posting thread */
+static GstBusSyncReply bus_sync_cb (GstBus *bus, GstMessage *msg, gpointer user_data)
+{
+    set_streaming_thread_qos (msg);
+    return GST_BUS_PASS;
+}
+
+/* Same for a standby pipeline, whose messages nobody would read */
+static GstBusSyncReply standby_bus_sync_cb (GstBus *bus, GstMessage *msg, gpointer user_data)
+{
+    GStreamerBackend *self = (__bridge GStreamerBackend *)user_data;
+
+    /* A backup session that failed is not worth failing over to. Its threads are not raised,
+     * see raise_video_threads_qos(). */
+    if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR)
+        g_atomic_int_set (&self->standby_failed, TRUE);
+    return GST_BUS_DROP;
+}
+
+/* Called from the streaming threads of the source to measure the network bitrate */
+static GstPadProbeReturn source_probe_cb (GstPad *pad, GstPadProbeInfo *info, GStreamerBackend *self)
+{
+    gsize size;
+
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST)
+        size = gst_buffer_list_calculate_size (GST_PAD_PROBE_INFO_BUFFER_LIST (info));
+    else
+        size = gst_buffer_get_size (GST_PAD_PROBE_INFO_BUFFER (info));
+    g_atomic_int_add (&self->interval_bytes, (gint) size);
+    return GST_PAD_PROBE_OK;
+}
+
+static void source_stats_pad_added_cb (GstElement *src, GstPad *pad, GStreamerBackend *self)
+{
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+                       (GstPadProbeCallback) source_probe_cb, (__bridge void *)self, NULL);
+}
+
+static gboolean add_source_stats_probe (GstElement *src, GstPad *pad, gpointer user_data)
+{
+    source_stats_pad_added_cb (src, pad, (__bridge GStreamerBackend *)user_data);
+    return TRUE;
+}
+
+/* rtpbin created a jitterbuffer for a new RTP stream, keep it around to read its statistics */
+static void new_jitterbuffer_cb (GstElement *rtpbin, GstElement *jitterbuffer, guint session, guint ssrc, GStreamerBackend *self)
+{
+    guint latency;
+
+    /* The jitterbuffer holds up to its latency worth of packets */
+    if (self->budget_jitterbuffer_ms > 0) {
+        g_object_get (jitterbuffer, "latency", &latency, NULL);
+        if (latency > self->budget_jitterbuffer_ms)
+            g_object_set (jitterbuffer, "latency", self->budget_jitterbuffer_ms, NULL);
+    }
+
+    g_mutex_lock (&self->stats_lock);
+    g_ptr_array_add (self->jitterbuffers, gst_object_ref (jitterbuffer));
+    g_mutex_unlock (&self->stats_lock);
+}
+
+static void new_manager_cb (GstElement *rtspsrc, GstElement *manager, GStreamerBackend *self)
+{
+    if (g_signal_lookup ("new-jitterbuffer", G_OBJECT_TYPE (manager)))
+        g_signal_connect (manager, "new-jitterbuffer", G_CALLBACK (new_jitterbuffer_cb), (__bridge void *)self);
+}
+
+/* The source of a promoted standby pipeline created its rtpbin and jitterbuffers before it was
+ * watched, so new-manager and new-jitterbuffer are long gone: register the jitterbuffers it
+ * has, and follow its rtpbin for the streams still to come */
+static void watch_existing_jitterbuffers (GStreamerBackend *self, GstElement *source)
+{
+    GstIterator *iterator;
+    GValue item = G_VALUE_INIT;
+
+    if (!GST_IS_BIN (source))
+        return;
+
+    iterator = gst_bin_iterate_recurse (GST_BIN (source));
+    while (gst_iterator_next (iterator, &item) == GST_ITERATOR_OK) {
+        GstElement *element = g_value_get_object (&item);
+        GstElementFactory *factory = gst_element_get_factory (element);
+        const gchar *name = factory ? gst_plugin_feature_get_name (GST_PLUGIN_FEATURE (factory)) : NULL;
+
+        if (g_strcmp0 (name, "rtpjitterbuffer") == 0)
+            new_jitterbuffer_cb (NULL, element, 0, 0, self);
+        else if (g_strcmp0 (name, "rtpbin") == 0)
+            new_manager_cb (source, element, self);
+        g_value_reset (&item);
+    }
+    g_value_unset (&item);
+    gst_iterator_free (iterator);
+}
+
+/* Find the srtsrc of a stream: the source itself, or inside the bin wrapping it */
+static GstElement *find_srt_source (GstElement *source)
+{
+    GstIterator *iterator;
+    GValue item = G_VALUE_INIT;
+    GstElement *found = NULL;
+
+    if (is_srt_source (source))
+        return gst_object_ref (source);
+    if (!GST_IS_BIN (source))
+        return NULL;
+
+    iterator = gst_bin_iterate_all_by_element_factory_name (GST_BIN (source), "srtsrc");
+    if (gst_iterator_next (iterator, &item) == GST_ITERATOR_OK) {
+        found = gst_object_ref (g_value_get_object (&item));
+        g_value_unset (&item);
+    }
+    gst_iterator_free (iterator);
+    return found;
+}
+
+/* Hook the statistics probes and signals into a newly created source element */
+static void watch_source (GStreamerBackend *self, GstElement *source)
+{
+    GstElement *srt = find_srt_source (source);
+
+    if (srt) {
+        g_mutex_lock (&self->stats_lock);
+        gst_object_replace ((GstObject **) &self->srt_source, GST_OBJECT (srt));
+        g_mutex_unlock (&self->stats_lock);
+        gst_object_unref (srt);
+    }
+
+    gst_element_foreach_src_pad (source, add_source_stats_probe, (__bridge void *)self);
+    g_signal_connect (source, "pad-added", G_CALLBACK (source_stats_pad_added_cb), (__bridge void *)self);
+    if (g_signal_lookup ("new-manager", G_OBJECT_TYPE (source)))
+        g_signal_connect (source, "new-manager", G_CALLBACK (new_manager_cb), (__bridge void *)self);
+}
+
+/* Forget the counters and jitterbuffers of the previous stream */
+static void reset_stats (GStreamerBackend *self)
+{
+    g_atomic_int_set (&self->frames_rendered, 0);
+    g_atomic_int_set (&self->interval_bytes, 0);
+    self->last_frames_rendered = 0;
+    self->frames_dropped = 0;
+    self->interval_late_frames = 0;
+    self->last_lateness_ms = 0;
+    self->last_packets_lost = 0;
+    self->last_packets_late = 0;
+    self->last_stats_time = g_get_monotonic_time ();
+    self->abr_bitrate = 0;
+    self->abr_switches = 0;
+    self->abr_throughput_kbps = 0;
+    self->abr_download_ms = 0;
+    g_mutex_lock (&self->stats_lock);
+    g_ptr_array_set_size (self->jitterbuffers, 0);
+    gst_object_replace ((GstObject **) &self->srt_source, NULL);
+    g_mutex_unlock (&self->stats_lock);
+}
+
+/* Read an integer SRT counter whatever its type: srtsrc reports some of them as gint and
+ * others as gint64, depending on the direction and the version */
+static gboolean get_srt_counter (const GstStructure *structure, const gchar *field, gint64 *counter)
+{
+    const GValue *value = gst_structure_get_value (structure, field);
+    GValue converted = G_VALUE_INIT;
+    gboolean transformed;
+
+    if (!value || !g_value_type_transformable (G_VALUE_TYPE (value), G_TYPE_INT64))
+        return FALSE;
+    g_value_init (&converted, G_TYPE_INT64);
+    transformed = g_value_transform (value, &converted);
+    if (transformed)
+        *counter = g_value_get_int64 (&converted);
+    g_value_unset (&converted);
+    return transformed;
+}
+
+/* Add the counters of the SRT connection to a stats snapshot */
+static void collect_srt_stats (GstElement *srt, GStreamerStats *stats)
+{
+    GstStructure *srt_stats = NULL;
+    const GstStructure *connection;
+    const GValue *callers;
+    gint64 value;
+    gdouble rtt;
+    gint latency;
+
+    g_object_get (srt, "stats", &srt_stats, NULL);
+    if (!srt_stats)
+        return;
+
+    /* In listener mode the counters are reported per caller, we only ever have one */
+    connection = srt_stats;
+    callers = gst_structure_get_value (srt_stats, "callers");
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+    if (callers && G_VALUE_HOLDS (callers, G_TYPE_VALUE_ARRAY)) {
+        GValueArray *array = g_value_get_boxed (callers);
+
+        connection = NULL;
+        if (array && array->n_values > 0)
+            connection = gst_value_get_structure (&array->values[0]);
+    }
+G_GNUC_END_IGNORE_DEPRECATIONS
+
+    if (connection) {
+        if (gst_structure_get_double (connection, "rtt-ms", &rtt))
+            stats.srtRttMs = rtt;
+        if (gst_structure_get_int (connection, "negotiated-latency-ms", &latency))
+            stats.srtLatencyMs = latency;
+        if (get_srt_counter (connection, "packets-received-lost", &value))
+            stats.srtPacketsLost = value;
+        if (get_srt_counter (connection, "packets-received-retransmitted", &value))
+            stats.srtPacketsRetransmitted = value;
+        if (get_srt_counter (connection, "packets-received-dropped", &value))
+            stats.srtPacketsDropped = value;
+    }
+    gst_structure_free (srt_stats);
+}
+
+/* Whether the last stats interval shows the link or the decoder falling behind */
+static gboolean is_congested (GStreamerBackend *self, GStreamerStats *stats)
+{
+    /* The jitterbuffer totals start over with every stream */
+    guint64 lost = stats.packetsLost >= self->last_packets_lost ? stats.packetsLost - self->last_packets_lost : stats.packetsLost;
+    guint64 late = stats.packetsLate >= self->last_packets_late ? stats.packetsLate - self->last_packets_late : stats.packetsLate;
+    gboolean congested;
+
+    congested = lost + late > QUALITY_DEGRADE_PACKETS ||
+                stats.lateFrames > QUALITY_DEGRADE_LATE_FRAMES ||
+                self->buffering_stalled ||
+                (self->average_kbps > 0 && stats.bitrateKbps < self->average_kbps * QUALITY_THROUGHPUT_RATIO);
+
+    self->last_packets_lost = stats.packetsLost;
+    self->last_packets_late = stats.packetsLate;
+    self->buffering_stalled = FALSE;
+    if (!congested)
+        self->average_kbps = self->average_kbps > 0 ? 0.8 * self->average_kbps + 0.2 * stats.bitrateKbps : stats.bitrateKbps;
+    return congested;
+}
+
+/* Start connecting to another rendition in the standby pipeline. The switch happens
+ * on the next stats interval, once the new session had time to set up. */
+static void request_quality_level (GStreamerBackend *self, NSUInteger level)
+{
+    GST_DEBUG ("Quality level %lu -> %lu", (unsigned long) self->quality_level, (unsigned long) level);
+    self->pending_level = level;
+    self->preroll_intervals = 0;
+    [self prerollUri:self->quality_uris[level]];
+}
+
+/* Whether the rendition of pending_level is ready to be switched to. The switch is given up,
+ * and the standby pipeline discarded, if it failed or is taking too long to preroll. */
+static gboolean pending_level_prerolled (GStreamerBackend *self)
+{
+    GstStateChangeReturn ret = GST_STATE_CHANGE_FAILURE;
+    GstState current = GST_STATE_NULL;
+    gchar *uri = playback_uri (self, [self->quality_uris[self->pending_level] UTF8String]);
+
+    if (self->standby_pipeline && g_strcmp0 (self->standby_uri, uri) == 0 && !g_atomic_int_get (&self->standby_failed))
+        ret = gst_element_get_state (self->standby_pipeline, &current, NULL, 0);
+    g_free (uri);
+
+    if (ret != GST_STATE_CHANGE_FAILURE && current >= GST_STATE_PAUSED)
+        return TRUE;
+    if (ret == GST_STATE_CHANGE_FAILURE || ++self->preroll_intervals >= QUALITY_PREROLL_INTERVALS) {
+        GST_DEBUG ("Rendition %ld did not preroll, staying at %lu", (long) self->pending_level, (unsigned long) self->quality_level);
+        self->pending_level = -1;
+        discard_standby (self);
+        preroll_backup (self);
+    }
+    return FALSE;
+}
+
+/* Step down to a lower rendition before the stream stalls, and back up once the link
+ * has been healthy for a while */
+static void adapt_quality (GStreamerBackend *self, GStreamerStats *stats)
+{
+    gboolean congested;
+
+    if (self->quality_uris.count < 2 || self->dvr_replaying)
+        return;
+
+    /* A paused or background stream receives nothing, which is not congestion. Start over
+     * from a clean slate once it plays again. */
+    if (self->state != GST_STATE_PLAYING || self->target_state != GST_STATE_PLAYING || g_atomic_int_get (&self->background)) {
+        self->congested_intervals = 0;
+        self->healthy_intervals = 0;
+        self->average_kbps = 0;
+        self->buffering_stalled = FALSE;
+        self->last_packets_lost = stats.packetsLost;
+        self->last_packets_late = stats.packetsLate;
+        return;
+    }
+
+    if (self->pending_level >= 0) {
+        if (!pending_level_prerolled (self))
+            return;
+        self->quality_level = self->pending_level;
+        self->pending_level = -1;
+        self->congested_intervals = 0;
+        self->healthy_intervals = 0;
+        self->average_kbps = 0;
+        switch_uri (self, [self->quality_uris[self->quality_level] UTF8String]);
+        g_mutex_lock (&self->event_lock);
+        self->event_quality = self->quality_level;
+        post_ui_events (self, UI_EVENT_QUALITY);
+        g_mutex_unlock (&self->event_lock);
+        return;
+    }
+
+    congested = is_congested (self, stats);
+    self->intervals_since_upgrade++;
+    if (congested) {
+        self->healthy_intervals = 0;
+        if (++self->congested_intervals < QUALITY_DEGRADE_INTERVALS || self->quality_level + 1 >= self->quality_uris.count)
+            return;
+
+        /* The link could not sustain the last upgrade, wait longer before the next one */
+        if (self->intervals_since_upgrade < self->upgrade_intervals)
+            self->upgrade_intervals = MIN (self->upgrade_intervals * 2, QUALITY_MAX_UPGRADE_INTERVALS);
+        request_quality_level (self, self->quality_level + 1);
+    } else {
+        self->congested_intervals = 0;
+        if (++self->healthy_intervals < self->upgrade_intervals || self->quality_level == 0)
+            return;
+
+        self->intervals_since_upgrade = 0;
+        request_quality_level (self, self->quality_level - 1);
+    }
+}
+
+/* What the process costs in memory, as jetsam counts it, and how much more it may use */
+static void collect_memory_stats (GStreamerStats *stats)
+{
+    task_vm_info_data_t vm_info;
+    mach_msg_type_number_t count = TASK_VM_INFO_COUNT;
+
+    if (task_info (mach_task_self (), TASK_VM_INFO, (task_info_t) &vm_info, &count) == KERN_SUCCESS)
+        stats.memoryFootprintBytes = vm_info.phys_footprint;
+    stats.availableMemoryBytes = os_proc_available_memory ();
+}
+
+/* Collect a stats snapshot, feed it to the quality adaptation and hand it to the UI delegate */
+static void report_stats (GStreamerBackend *self)
+{
+    GStreamerStats *stats;
+    GstQuery *query;
+    gint64 now = g_get_monotonic_time ();
+    gdouble interval = (now - self->last_stats_time) / (gdouble) G_USEC_PER_SEC;
+    guint frames = g_atomic_int_get (&self->frames_rendered);
+    guint bytes = g_atomic_int_and (&self->interval_bytes, 0);
+    guint64 value;
+
+    if (interval <= 0)
+        return;
+
+    stats = [[GStreamerStats alloc] init];
+    stats.framesRendered = frames;
+    stats.framesPerSecond = (frames - self->last_frames_rendered) / interval;
+    stats.framesDropped = (NSUInteger) self->frames_dropped;
+    stats.lateFrames = self->interval_late_frames;
+    stats.lastLatenessMs = self->last_lateness_ms;
+    stats.bitrateKbps = bytes * 8 / interval / 1000;
+    stats.qualityLevel = self->quality_level;
+    stats.abrBitrateKbps = self->abr_bitrate / 1000.0;
+    stats.abrSwitches = self->abr_switches;
+    stats.abrThroughputKbps = self->abr_throughput_kbps;
+    stats.abrFragmentDownloadMs = self->abr_download_ms;
+    stats.reconnects = self->reconnects;
+    stats.lastOutageMs = g_atomic_int_get (&self->last_outage_ms);
+    if (network_name (self->network))
+        stats.network = @(network_name (self->network));
+
+    /* Frames flow again, the next failure gets the full set of attempts */
+    if (!g_atomic_int_get (&self->outage_open))
+        self->reconnect_attempt = 0;
+
+    g_mutex_lock (&self->stats_lock);
+    for (guint i = 0; i < self->jitterbuffers->len; i++) {
+        GstStructure *jitterbuffer_stats = NULL;
+
+        g_object_get (g_ptr_array_index (self->jitterbuffers, i), "stats", &jitterbuffer_stats, NULL);
+        if (!jitterbuffer_stats)
+            continue;
+        if (gst_structure_get_uint64 (jitterbuffer_stats, "num-lost", &value))
+            stats.packetsLost += value;
+        if (gst_structure_get_uint64 (jitterbuffer_stats, "num-late", &value))
+            stats.packetsLate += value;
+        if (gst_structure_get_uint64 (jitterbuffer_stats, "num-duplicates", &value))
+            stats.packetsDuplicated += value;
+        if (gst_structure_get_uint64 (jitterbuffer_stats, "avg-jitter", &value))
+            stats.jitterMs = MAX (stats.jitterMs, value / (gdouble) GST_MSECOND);
+        gst_structure_free (jitterbuffer_stats);
+    }
+    if (self->srt_source)
+        collect_srt_stats (self->srt_source, stats);
+    g_mutex_unlock (&self->stats_lock);
+    collect_memory_stats (stats);
+
+    query = gst_query_new_latency ();
+    if (gst_element_query (self->pipeline, query)) {
+        GstClockTime min_latency;
+
+        gst_query_parse_latency (query, NULL, &min_latency, NULL);
+        stats.pipelineLatencyMs = min_latency / (gdouble) GST_MSECOND;
+    }
+    gst_query_unref (query);
+
+    self->last_frames_rendered = frames;
+    self->interval_late_frames = 0;
+    self->last_stats_time = now;
+
+    adapt_quality (self, stats);
+    g_mutex_lock (&self->event_lock);
+    self->event_stats = stats;
+    post_ui_events (self, UI_EVENT_STATS);
+    g_mutex_unlock (&self->event_lock);
+}
+
+/* Called 4 times per second by the timeout source created in app_function */
+static gboolean refresh_ui (GStreamerBackend *self)
+{
+    gint64 position;
+
+    /* We do not want to update anything unless we have a working pipeline in the PAUSED or PLAYING state */
+    if (!self->pipeline || self->state < GST_STATE_PAUSED)
+        return TRUE;
+
+    /* If we didn't know it yet, query the stream duration */
+    if (!GST_CLOCK_TIME_IS_VALID (self->duration))
+        gst_element_query_duration (self->pipeline, GST_FORMAT_TIME, &self->duration);
+
+    /* Live streams have no duration to scrub through */
+    if (GST_CLOCK_TIME_IS_VALID (self->duration) && gst_element_query_position (self->pipeline, GST_FORMAT_TIME, &position))
+        [self setCurrentUIPosition:position / GST_MSECOND duration:self->duration / GST_MSECOND];
+
+    if (++self->ui_ticks % STATS_REPORT_TICKS == 0)
+        report_stats (self);
+    return TRUE;
+}
+
+/* An element changed its latency, e.g. a jitterbuffer retuned for a new network path */
+static void latency_cb (GstBus *bus, GstMessage *msg, GStreamerBackend *self)
+{
+    gst_bin_recalculate_latency (GST_BIN (self->pipeline));
+}
+
+/* Sinks and decoders post a QoS message every time they drop or are late with a buffer */
+static void qos_cb (GstBus *bus, GstMessage *msg, GStreamerBackend *self)
+{
+    GstFormat format;
+    guint64 processed;
+    guint64 dropped;
+    gint64 jitter;
+
+    gst_message_parse_qos_stats (msg, &format, &processed, &dropped);
+    gst_message_parse_qos_values (msg, &jitter, NULL, NULL);
+    if (format == GST_FORMAT_BUFFERS && dropped != (guint64) -1)
+        self->frames_dropped = MAX (self->frames_dropped, dropped);
+    self->interval_late_frames++;
+    self->last_lateness_ms = jitter / (gdouble) GST_MSECOND;
+}
+
+static gboolean is_srt_source (GstElement *element)
+{
+    GstElementFactory *factory = gst_element_get_factory (element);
+
+    return factory && g_strcmp0 (GST_OBJECT_NAME (factory), "srtsrc") == 0;
+}
+
+static gboolean is_rtsp_source (GstObject *object)
+{
+    GstElementFactory *factory = GST_IS_ELEMENT (object) ? gst_element_get_factory (GST_ELEMENT (object)) : NULL;
+
+    return factory && g_strcmp0 (GST_OBJECT_NAME (factory), "rtspsrc") == 0;
+}
+
+/* Called by rtspsrc for each stream of the SDP before the SETUP. Audio streams are left out
+ * in GStreamerAudioModeNone. */
+static gboolean select_stream_cb (GstElement *rtspsrc, guint num, GstCaps *caps, GStreamerBackend *self)
+{
+    const GstStructure *structure = gst_caps_get_structure (caps, 0);
+
+    return g_strcmp0 (gst_structure_get_string (structure, "media"), "audio") != 0;
+}
+
+/* Apply the SRT settings selected with setSRTLatency:mode:. Anything left at its default
+ * keeps what the srt:// URI asked for. */
+static void configure_srt_source (GStreamerBackend *self, GstElement *source)
+{
+    NSUInteger latency_ms = self->srt_latency_ms;
+
+    /* Lost packets take longer to retransmit over cellular */
+    if (latency_ms == 0 && self->network >= NETWORK_CELLULAR)
+        latency_ms = NETWORK_CELLULAR_SRT_LATENCY_MS;
+    if (latency_ms > 0)
+        g_object_set (source, "latency", (gint) latency_ms, NULL);
+
+    switch (self->srt_mode) {
+        case GStreamerSRTModeCaller:
+            gst_util_set_object_arg (G_OBJECT (source), "mode", "caller");
+            break;
+        case GStreamerSRTModeListener:
+            gst_util_set_object_arg (G_OBJECT (source), "mode", "listener");
+            break;
+        default:
+            break;
+    }
+    GST_DEBUG ("Configured %s for SRT latency %lu ms", GST_OBJECT_NAME (source), (unsigned long) latency_ms);
+}
+
+/* Jitterbuffer latency of the low latency profiles, deeper over cellular. 0 for the default
+ * profile, which keeps the rtspsrc default. */
+static guint jitterbuffer_latency_ms (GStreamerBackend *self)
+{
+    guint latency;
+
+    switch (self->latency_profile) {
+        case GStreamerLatencyProfileLow:
+            latency = LOW_LATENCY_JITTERBUFFER_MS;
+            break;
+        case GStreamerLatencyProfileUltraLow:
+            latency = ULTRA_LOW_LATENCY_JITTERBUFFER_MS;
+            break;
+        default:
+            return 0;
+    }
+    if (self->network >= NETWORK_CELLULAR)
+        latency *= NETWORK_CELLULAR_JITTERBUFFER_FACTOR;
+    return latency;
+}
+
+/* Called by playbin when it has created its source element, before it starts to
+ * connect. This is the only chance to tune rtspsrc or srtsrc for the selected profile. */
+static void source_setup_cb (GstElement *bin, GstElement *source, GStreamerBackend *self)
+{
+    gchar *location = NULL;
+    guint latency;
+
+    /* Sources of the standby pipeline are watched once it gets promoted */
+    if (bin == self->pipeline)
+        watch_source (self, source);
+
+    if (is_srt_source (source)) {
+        configure_srt_source (self, source);
+        return;
+    }
+    if (!is_rtsp_source (GST_OBJECT (source)))
+        return;
+
+    if (self->audio_mode == GStreamerAudioModeNone)
+        g_signal_connect (source, "select-stream", G_CALLBACK (select_stream_cb), (__bridge void *)self);
+
+    /* The server was only reachable over TCP last time */
+    if (self->transport == GStreamerTransportAuto && self->tcp_only_uri) {
+        g_object_get (source, "location", &location, NULL);
+        if (g_strcmp0 (location, self->tcp_only_uri) == 0)
+            gst_util_set_object_arg (G_OBJECT (source), "protocols", "tcp");
+        g_free (location);
+    }
+
+    switch (self->transport) {
+        case GStreamerTransportUDP:
+            gst_util_set_object_arg (G_OBJECT (source), "protocols", "udp");
+            break;
+        case GStreamerTransportTCP:
+            gst_util_set_object_arg (G_OBJECT (source), "protocols", "tcp");
+            break;
+        default:
+            /* Carrier NATs often drop the RTP streams, and rtspsrc only falls back to TCP once
+             * its UDP timeout ran out */
+            if (self->network >= NETWORK_CELLULAR)
+                gst_util_set_object_arg (G_OBJECT (source), "protocols", "tcp");
+            break;
+    }
+
+    latency = jitterbuffer_latency_ms (self);
+    if (latency > 0)
+        g_object_set (source, "latency", latency, "drop-on-latency", TRUE, NULL);
+    GST_DEBUG ("Configured %s for latency profile %d, network %d", GST_OBJECT_NAME (source),
+               (int) self->latency_profile, (int) self->network);
+}
+
+/* Create the decoder for the given RTP encoding name. vtdec_hw refuses to fall back to software
+ * decoding inside VideoToolbox, so it fails loudly instead of silently decoding on the CPU. */
+static GstElement *make_video_decoder (GStreamerBackend *self, gboolean h265, const gchar *name)
+{
+    const gchar **candidates = h265 ? software_h265_decoders : software_h264_decoders;
+    GstElement *element;
+
+    if (!self->software_decode) {
+        element = gst_element_factory_make ("vtdec_hw", name);
+        if (element)
+            return element;
+        GST_WARNING ("vtdec_hw not available, using a software decoder");
+        self->software_decode = TRUE;
+    }
+
+    for (; *candidates; candidates++) {
+        element = gst_element_factory_make (*candidates, name);
+        if (element)
+            return element;
+    }
+    return NULL;
+}
+
+/* Whether a bus message comes from a VideoToolbox hardware decoder */
+static gboolean is_hardware_decoder (GstObject *object)
+{
+    GstElementFactory *factory;
+
+    if (!GST_IS_ELEMENT (object))
+        return FALSE;
+    factory = gst_element_get_factory (GST_ELEMENT (object));
+    return factory && g_strcmp0 (GST_OBJECT_NAME (factory), "vtdec_hw") == 0;
+}
+
+/* Drop a newly created element that never made it into a bin */
+static void release_floating (GstElement **element)
+{
+    if (*element) {
+        gst_object_unref (gst_object_ref_sink (*element));
+        *element = NULL;
+    }
+}
+
+/* Remove one decoding chain from a hardware pipeline. The pipeline must not be PLAYING
+ * or PAUSED, unless the source feeding the chain is already gone. */
+static void remove_decode_chain (GstElement *bin, GstElement **depayloader, GstElement **parser, GstElement **decoder)
+{
+    GstElement **chain[] = { depayloader, parser, decoder };
+
+    for (int i = 0; i < G_N_ELEMENTS (chain); i++) {
+        if (!*chain[i])
+            continue;
+        gst_element_set_state (*chain[i], GST_STATE_NULL);
+        gst_bin_remove (GST_BIN (bin), *chain[i]);
+        *chain[i] = NULL;
+    }
+}
+
+/* Remove all decoding chains, the DVR recorder, the audio chain and the fakesinks of discarded streams, from
+ * the hardware pipeline. The sources and the mixer pads of a composite stay. The pipeline must not be
+ * PLAYING or PAUSED. */
+static void teardown_decode_chain (GStreamerBackend *self)
+{
+    GPtrArray *discard_sinks;
+
+    remove_decode_chain (self->pipeline, &self->depayloader, &self->parser, &self->decoder);
+    remove_dvr_recorder (self->pipeline);
+    remove_audio_chain (self->pipeline);
+    for (guint i = 0; i < self->tiles->len; i++) {
+        CompositeTile *tile = g_ptr_array_index (self->tiles, i);
+        remove_decode_chain (self->pipeline, &tile->depayloader, &tile->parser, &tile->decoder);
+    }
+
+    g_mutex_lock (&self->stats_lock);
+    discard_sinks = self->discard_sinks;
+    self->discard_sinks = g_ptr_array_new ();
+    g_mutex_unlock (&self->stats_lock);
+    for (guint i = 0; i < discard_sinks->len; i++) {
+        GstElement *fakesink = g_ptr_array_index (discard_sinks, i);
+        gst_element_set_state (fakesink, GST_STATE_NULL);
+        gst_bin_remove (GST_BIN (self->pipeline), fakesink);
+    }
+    g_ptr_array_unref (discard_sinks);
+}
+
+/* Link a stream we are not interested in to a fakesink, so rtspsrc does not get
+ * not-linked errors for it */
+static void discard_pad (GStreamerBackend *self, GstElement *bin, GstPad *pad)
+{
+    GstElement *fakesink = gst_element_factory_make ("fakesink", NULL);
+    GstPad *sink_pad;
+
+    g_object_set (fakesink, "sync", FALSE, "async", FALSE, NULL);
+    gst_bin_add (GST_BIN (bin), fakesink);
+    sink_pad = gst_element_get_static_pad (fakesink, "sink");
+    gst_pad_link (pad, sink_pad);
+    gst_object_unref (sink_pad);
+    gst_element_sync_state_with_parent (fakesink);
+
+    /* A standby pipeline takes its fakesinks along when it is disposed */
+    if (bin == self->pipeline) {
+        g_mutex_lock (&self->stats_lock);
+        g_ptr_array_add (self->discard_sinks, fakesink);
+        g_mutex_unlock (&self->stats_lock);
+    }
+}
+
+/* Check whether a new source pad carries H.264 or H.265 video, either over RTP or, for
+ * MPEG-TS sources such as SRT, as a demuxed elementary stream */
+static gboolean get_video_encoding (GStreamerBackend *self, GstPad *pad, gboolean *h265, gboolean *rtp)
+{
+    GstCaps *caps;
+    GstStructure *structure;
+    const gchar *media;
+    const gchar *encoding;
+    gboolean supported = TRUE;
+
+    caps = gst_pad_get_current_caps (pad);
+    if (!caps)
+        caps = gst_pad_query_caps (pad, NULL);
+    /* Nothing to go by on a pad that cannot negotiate yet */
+    if (gst_caps_is_empty (caps)) {
+        *rtp = FALSE;
+        gst_caps_unref (caps);
+        return FALSE;
+    }
+    structure = gst_caps_get_structure (caps, 0);
+    media = gst_structure_get_string (structure, "media");
+    encoding = gst_structure_get_string (structure, "encoding-name");
+    *rtp = gst_structure_has_name (structure, "application/x-rtp");
+
+    if (gst_structure_has_name (structure, "video/x-h264")) {
+        *h265 = FALSE;
+    } else if (gst_structure_has_name (structure, "video/x-h265")) {
+        *h265 = TRUE;
+    } else if (!*rtp || g_strcmp0 (media, "video") != 0) {
+        supported = FALSE;
+    } else if (encoding && g_ascii_strcasecmp (encoding, "H264") == 0) {
+        *h265 = FALSE;
+    } else if (encoding && g_ascii_strcasecmp (encoding, "H265") == 0) {
+        *h265 = TRUE;
+    } else {
+        gchar *message = g_strdup_printf ("Unsupported video encoding %s for hardware decoding", encoding ? encoding : "(none)");
+        [self setUIMessage:message];
+        g_free (message);
+        supported = FALSE;
+    }
+    gst_caps_unref (caps);
+    return supported;
+}
+
+/* Keep a slow disk from holding back the live video without corrupting the recording: once
+ * the recorder queue holds DVR_QUEUE_OVERFLOW, whole frames are dropped from there up to the
+ * next keyframe that finds room again, so the recording skips ahead at a GOP boundary instead
+ * of referencing frames it never got. */
+static GstPadProbeReturn dvr_overflow_probe_cb (GstPad *pad, GstPadProbeInfo *info, DvrOverflow *overflow)
+{
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+    GstObject *queue = gst_pad_get_parent (pad);
+    guint64 level = 0;
+
+    if (!queue)
+        return GST_PAD_PROBE_OK;
+    g_object_get (queue, "current-level-time", &level, NULL);
+    gst_object_unref (queue);
+
+    if (!GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+        overflow->discarding = level >= DVR_QUEUE_OVERFLOW;
+    else if (level >= DVR_QUEUE_OVERFLOW)
+        overflow->discarding = TRUE;
+    if (!overflow->discarding)
+        return GST_PAD_PROBE_OK;
+
+    if (!overflow->reported) {
+        overflow->reported = TRUE;
+        [overflow->backend setUIMessage:"The disk is too slow for the DVR recording, it skips ahead"];
+    }
+    return GST_PAD_PROBE_DROP;
+}
+
+/* Build the DVR recorder that goes between the parser and the decoder: a tee feeding the
+ * decoder and a splitmuxsink, which writes the still compressed stream into MP4 fragments
+ * behind a queue that skips whole GOPs on a slow disk, see dvr_overflow_probe_cb(). Each
+ * recorder numbers its fragments apart from the previous ones, since a promoted standby
+ * pipeline starts recording while the old recorder may not have closed its last fragment. */
+static GstElement *make_dvr_recorder (GStreamerBackend *self)
+{
+    GstElement *bin;
+    GstElement *tee = gst_element_factory_make ("tee", NULL);
+    GstElement *queue = gst_element_factory_make ("queue", NULL);
+    GstElement *splitmux = gst_element_factory_make ("splitmuxsink", NULL);
+    DvrOverflow *overflow;
+    gchar *location;
+    GstPad *pad;
+
+    if (!tee || !queue || !splitmux) {
+        release_floating (&tee);
+        release_floating (&queue);
+        release_floating (&splitmux);
+        [self setUIMessage:"Unable to create the DVR recorder, playing without it"];
+        return NULL;
+    }
+
+    g_mkdir_with_parents (self->dvr_directory, 0700);
+    location = g_strdup_printf ("%s/%d-%%05d.mp4", self->dvr_directory, g_atomic_int_add (&self->dvr_generation, 1));
+    g_object_set (queue, "max-size-buffers", 0, "max-size-bytes", 0, "max-size-time", (guint64) (2 * DVR_QUEUE_OVERFLOW), NULL);
+    overflow = g_new0 (DvrOverflow, 1);
+    overflow->backend = self;
+    pad = gst_element_get_static_pad (queue, "sink");
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback) dvr_overflow_probe_cb, overflow, g_free);
+    gst_object_unref (pad);
+    /* Fragments are cut at the stream's own keyframes, max-size-time is the shortest fragment */
+    g_object_set (splitmux, "location", location, "max-size-time", (guint64) DVR_FRAGMENT_DURATION, NULL);
+    g_free (location);
+
+    bin = gst_bin_new ("recorder");
+    gst_bin_add_many (GST_BIN (bin), tee, queue, splitmux, NULL);
+    gst_element_link_many (tee, queue, splitmux, NULL);
+
+    pad = gst_element_get_static_pad (tee, "sink");
+    gst_element_add_pad (bin, gst_ghost_pad_new ("sink", pad));
+    gst_object_unref (pad);
+    pad = gst_element_request_pad_simple (tee, "src_%u");
+    gst_element_add_pad (bin, gst_ghost_pad_new ("src", pad));
+    gst_object_unref (pad);
+    return bin;
+}
+
+/* Remove the DVR recorder of the single stream chain, if any. Its open fragment is lost. */
+static void remove_dvr_recorder (GstElement *bin)
+{
+    GstElement *recorder = gst_bin_get_by_name (GST_BIN (bin), "recorder");
+
+    if (!recorder)
+        return;
+    gst_element_set_state (recorder, GST_STATE_NULL);
+    gst_bin_remove (GST_BIN (bin), recorder);
+    gst_object_unref (recorder);
+}
+
+/* Whether a new source pad carries audio, over RTP or as an elementary stream */
+static gboolean is_audio_pad (GstPad *pad)
+{
+    GstCaps *caps = gst_pad_get_current_caps (pad);
+    const GstStructure *structure;
+    gboolean audio;
+
+    if (!caps)
+        caps = gst_pad_query_caps (pad, NULL);
+    if (gst_caps_is_empty (caps)) {
+        gst_caps_unref (caps);
+        return FALSE;
+    }
+    structure = gst_caps_get_structure (caps, 0);
+    if (gst_structure_has_name (structure, "application/x-rtp"))
+        audio = g_strcmp0 (gst_structure_get_string (structure, "media"), "audio") == 0;
+    else
+        audio = g_str_has_prefix (gst_structure_get_name (structure), "audio/");
+    gst_caps_unref (caps);
+    return audio;
+}
+
+/* The elements from decoded audio to the speaker in GStreamerAudioModeLowLatency. The audio
+ * sink keeps a short buffer and does not provide the clock: the video of a live stream is
+ * rendered as soon as it is due, not slaved to an audio clock. */
+static gchar *low_latency_audio_description (void)
+{
+    GstElementFactory *probe = gst_element_factory_find ("webrtcechoprobe");
+    gchar *description;
+
+    description = g_strdup_printf ("audioconvert ! audioresample ! %s%s%s osxaudiosink buffer-time=%d latency-time=%d provide-clock=false",
+                                   probe ? "webrtcechoprobe name=" : "", probe ? [GStreamerEchoProbeName UTF8String] : "", probe ? " !" : "",
+                                   LOW_LATENCY_AUDIO_BUFFER_TIME, LOW_LATENCY_AUDIO_LATENCY_TIME);
+    g_clear_object (&probe);
+    return description;
+}
+
+/* Audio sink for playbin, NULL for its default one */
+static GstElement *make_audio_sink (GStreamerBackend *self)
+{
+    GError *error = NULL;
+    GstElement *sink;
+    gchar *description;
+
+    if (self->audio_mode != GStreamerAudioModeLowLatency)
+        return NULL;
+    description = low_latency_audio_description ();
+    sink = gst_parse_bin_from_description (description, TRUE, &error);
+    g_free (description);
+    if (!sink) {
+        GST_ERROR ("Could not build the low latency audio sink: %s", error ? error->message : "unknown error");
+        g_clear_error (&error);
+        return NULL;
+    }
+    g_clear_error (&error);
+    return sink;
+}
+
+/* Apply the audio mode to playbin: audio decoding on or off, and the audio sink */
+static void configure_playbin_audio (GStreamerBackend *self, GstElement *playbin)
+{
+    guint flags;
+
+    g_object_get (playbin, "flags", &flags, NULL);
+    if (self->audio_mode == GStreamerAudioModeNone)
+        flags &= ~PLAY_FLAG_AUDIO;
+    else
+        flags |= PLAY_FLAG_AUDIO;
+    g_object_set (playbin, "flags", flags, "audio-sink", make_audio_sink (self), NULL);
+}
+
+/* Decode and play the audio stream of the single stream source in the hardware pipeline.
+ * decodebin plugs the depayloader and decoder for whatever the stream carries. */
+static gboolean link_audio_chain (GStreamerBackend *self, GstElement *bin, GstPad *pad)
+{
+    GstElement *existing = gst_bin_get_by_name (GST_BIN (bin), "audio-chain");
+    GError *error = NULL;
+    GstElement *chain;
+    GstPad *sink_pad;
+    gchar *audio, *description;
+
+    /* Only the first audio stream is played */
+    if (existing) {
+        gst_object_unref (existing);
+        return FALSE;
+    }
+
+    audio = low_latency_audio_description ();
+    description = g_strdup_printf ("decodebin ! %s", audio);
+    chain = gst_parse_bin_from_description (description, TRUE, &error);
+    g_free (audio);
+    g_free (description);
+    if (!chain) {
+        GST_ERROR ("Could not build the low latency audio chain: %s", error ? error->message : "unknown error");
+        g_clear_error (&error);
+        return FALSE;
+    }
+    g_clear_error (&error);
+
+    gst_object_set_name (GST_OBJECT (chain), "audio-chain");
+    gst_bin_add (GST_BIN (bin), chain);
+    sink_pad = gst_element_get_static_pad (chain, "sink");
+    if (gst_pad_link (pad, sink_pad) != GST_PAD_LINK_OK) {
+        GST_ERROR ("Could not link the source to the audio chain");
+        gst_object_unref (sink_pad);
+        gst_bin_remove (GST_BIN (bin), chain);
+        return FALSE;
+    }
+    gst_object_unref (sink_pad);
+    gst_element_sync_state_with_parent (chain);
+    return TRUE;
+}
+
+static void remove_audio_chain (GstElement *bin)
+{
+    GstElement *chain = gst_bin_get_by_name (GST_BIN (bin), "audio-chain");
+
+    if (!chain)
+        return;
+    gst_element_set_state (chain, GST_STATE_NULL);
+    gst_bin_remove (GST_BIN (bin), chain);
+    gst_object_unref (chain);
+}
+
+/* Build a depayloader ! parser ! decoder chain inside bin for a source pad and link it to target,
+ * a sink pad of the video sink or of the mixer. Elementary streams skip the depayloader. There
+ * is no conversion in between, so frames decoded by VideoToolbox stay in GL memory. Named chains
+ * belong to the single stream source and can be found again when a standby pipeline is
+ * promoted. */
+static gboolean link_decode_chain (GStreamerBackend *self, GstElement *bin, GstPad *pad, gboolean h265, gboolean rtp,
+                                   GstPad *target, gboolean named, GstElement **depayloader, GstElement **parser,
+                                   GstElement **decoder)
+{
+    GstElement *first;
+    GstElement *recorder = NULL;
+    GstPad *first_pad;
+    GstPad *decoder_pad;
+    gboolean linked;
+
+    *depayloader = NULL;
+    if (rtp)
+        *depayloader = gst_element_factory_make (h265 ? "rtph265depay" : "rtph264depay", named ? "depayloader" : NULL);
+    *parser = gst_element_factory_make (h265 ? "h265parse" : "h264parse", named ? "parser" : NULL);
+    *decoder = make_video_decoder (self, h265, named ? "decoder" : NULL);
+    if ((rtp && !*depayloader) || !*parser || !*decoder) {
+        release_floating (depayloader);
+        release_floating (parser);
+        release_floating (decoder);
+        [self setUIMessage:"Unable to create the video decoding elements"];
+        return FALSE;
+    }
+
+    /* Repeat SPS/PPS in front of every IDR so the decoder can start on any keyframe */
+    g_object_set (*parser, "config-interval", -1, NULL);
+
+    /* Record the live single stream, not the replay of the recording */
+    if (named && self->dvr_window > 0 && !self->dvr_replaying)
+        recorder = make_dvr_recorder (self);
+
+    gst_bin_add_many (GST_BIN (bin), *parser, *decoder, NULL);
+    first = *parser;
+    linked = TRUE;
+    if (*depayloader) {
+        gst_bin_add (GST_BIN (bin), *depayloader);
+        linked = gst_element_link (*depayloader, *parser);
+        first = *depayloader;
+    }
+    if (recorder) {
+        gst_bin_add (GST_BIN (bin), recorder);
+        linked = linked && gst_element_link_many (*parser, recorder, *decoder, NULL);
+    } else {
+        linked = linked && gst_element_link (*parser, *decoder);
+    }
+    decoder_pad = gst_element_get_static_pad (*decoder, "src");
+    linked = linked && gst_pad_link (decoder_pad, target) == GST_PAD_LINK_OK;
+    gst_object_unref (decoder_pad);
+    if (!linked) {
+        GST_ERROR ("Could not link the video decoding chain");
+        remove_decode_chain (bin, depayloader, parser, decoder);
+        if (recorder)
+            remove_dvr_recorder (bin);
+        return FALSE;
+    }
+    gst_element_sync_state_with_parent (*decoder);
+    if (recorder)
+        gst_element_sync_state_with_parent (recorder);
+    gst_element_sync_state_with_parent (*parser);
+    if (*depayloader)
+        gst_element_sync_state_with_parent (*depayloader);
+
+    first_pad = gst_element_get_static_pad (first, "sink");
+    if (gst_pad_link (pad, first_pad) != GST_PAD_LINK_OK)
+        GST_ERROR ("Could not link the source to the decoding chain");
+    gst_object_unref (first_pad);
+
+    GST_DEBUG ("Decoding with %s", GST_OBJECT_NAME (gst_element_get_factory (*decoder)));
+    return TRUE;
+}
+
+/* Called when the source of a hardware pipeline exposes a stream. The first H.264 or H.265
+ * video stream is decoded into the video sink, everything else is discarded. The source may
+ * sit in the standby pipeline, so everything is looked up in its own bin. */
+static void source_pad_added_cb (GstElement *src, GstPad *pad, GStreamerBackend *self)
+{
+    GstElement *bin = GST_ELEMENT (gst_object_get_parent (GST_OBJECT (src)));
+    GstElement *existing = gst_bin_get_by_name (GST_BIN (bin), "decoder");
+    GstElement *sink = gst_bin_get_by_name (GST_BIN (bin), "render-filter");
+    GstElement *depayloader, *parser, *decoder;
+    gboolean h265, rtp;
+    GstPad *sink_pad;
+
+    if (self->audio_mode == GStreamerAudioModeLowLatency && is_audio_pad (pad)) {
+        if (!link_audio_chain (self, bin, pad))
+            discard_pad (self, bin, pad);
+    } else if (existing || !sink || !get_video_encoding (self, pad, &h265, &rtp)) {
+        discard_pad (self, bin, pad);
+    } else {
+        sink_pad = gst_element_get_static_pad (sink, "sink");
+        if (!link_decode_chain (self, bin, pad, h265, rtp, sink_pad, TRUE, &depayloader, &parser, &decoder)) {
+            discard_pad (self, bin, pad);
+        } else if (bin == self->pipeline) {
+            self->depayloader = depayloader;
+            self->parser = parser;
+            self->decoder = decoder;
+        }
+        gst_object_unref (sink_pad);
+    }
+
+    g_clear_object (&existing);
+    g_clear_object (&sink);
+    gst_object_unref (bin);
+}
+
+/* Same for the sources of a composite, whose video goes to their pad on the mixer */
+static void tile_pad_added_cb (GstElement *src, GstPad *pad, CompositeTile *tile)
+{
+    GStreamerBackend *self = tile->backend;
+    gboolean h265, rtp;
+
+    if (tile->decoder || !get_video_encoding (self, pad, &h265, &rtp)) {
+        discard_pad (self, self->pipeline, pad);
+        return;
+    }
+
+    if (!link_decode_chain (self, self->pipeline, pad, h265, rtp, tile->mixer_pad, FALSE, &tile->depayloader, &tile->parser, &tile->decoder))
+        discard_pad (self, self->pipeline, pad);
+}
+
+/* Expose a stream of the demuxer on the bin wrapping it */
+static void ghost_demuxer_pad_cb (GstElement *demuxer, GstPad *pad, GstElement *bin)
+{
+    GstPad *ghost = gst_ghost_pad_new (GST_PAD_NAME (pad), pad);
+
+    g_object_set_data (G_OBJECT (pad), "ghost-pad", ghost);
+    gst_pad_set_active (ghost, TRUE);
+    gst_element_add_pad (bin, ghost);
+}
+
+static void unghost_demuxer_pad_cb (GstElement *demuxer, GstPad *pad, GstElement *bin)
+{
+    GstPad *ghost = g_object_get_data (G_OBJECT (pad), "ghost-pad");
+
+    if (ghost) {
+        g_object_set_data (G_OBJECT (pad), "ghost-pad", NULL);
+        gst_element_remove_pad (bin, ghost);
+    }
+}
+
+/* SRT carries MPEG-TS rather than RTP. Put the source and a tsdemux in a bin that exposes
+ * the demuxed streams as its own pads, so the rest of the hardware pipeline handles it like
+ * any other source. */
+static GstElement *wrap_transport_stream (GStreamerBackend *self, GstElement *ts_source, const gchar *name)
+{
+    GstElement *bin;
+    GstElement *demuxer = gst_element_factory_make ("tsdemux", NULL);
+
+    if (!demuxer) {
+        release_floating (&ts_source);
+        [self setUIMessage:"Unable to create tsdemux"];
+        return NULL;
+    }
+
+    bin = gst_bin_new (name);
+    gst_bin_add_many (GST_BIN (bin), ts_source, demuxer, NULL);
+    gst_element_link (ts_source, demuxer);
+    g_signal_connect (demuxer, "pad-added", G_CALLBACK (ghost_demuxer_pad_cb), bin);
+    g_signal_connect (demuxer, "pad-removed", G_CALLBACK (unghost_demuxer_pad_cb), bin);
+    return bin;
+}
+
+/* Create a source for the given URI inside a hardware pipeline. The pad-added callback builds
+ * the decoding chain once the source exposes its streams. */
+static GstElement *make_source (GStreamerBackend *self, GstElement *bin, const gchar *uri, const gchar *name,
+                                GCallback pad_added_cb, gpointer user_data)
+{
+    GError *error = NULL;
+    GstElement *new_source;
+
+    new_source = gst_element_make_from_uri (GST_URI_SRC, uri, NULL, &error);
+    if (!new_source) {
+        gchar *message = g_strdup_printf ("Unable to create a source for %s: %s", uri, error ? error->message : "unsupported URI");
+        g_clear_error (&error);
+        [self setUIMessage:message];
+        g_free (message);
+        return NULL;
+    }
+
+    source_setup_cb (bin, new_source, self);
+    if (is_srt_source (new_source)) {
+        new_source = wrap_transport_stream (self, new_source, name);
+        if (!new_source)
+            return NULL;
+    } else if (name) {
+        gst_object_set_name (GST_OBJECT (new_source), name);
+    }
+    g_signal_connect (new_source, "pad-added", pad_added_cb, user_data);
+    gst_bin_add (GST_BIN (bin), new_source);
+    gst_element_sync_state_with_parent (new_source);
+    return new_source;
+}
+
+/* Remove the single stream source. The pipeline must not be PLAYING or PAUSED. */
+static void remove_source (GStreamerBackend *self)
+{
+    if (self->source) {
+        gst_element_set_state (self->source, GST_STATE_NULL);
+        gst_bin_remove (GST_BIN (self->pipeline), self->source);
+        self->source = NULL;
+    }
+}
+
+/* Free a tile once its elements are gone from the pipeline */
+static void free_tile (CompositeTile *tile)
+{
+    if (tile->pending)
+        free_tile (tile->pending);
+    if (tile->mixer_pad)
+        gst_object_unref (tile->mixer_pad);
+    g_free (tile->uris[TILE_QUALITY_LOW]);
+    g_free (tile->uris[TILE_QUALITY_HIGH]);
+    g_free (tile);
+}
+
+/* Remove the source and decoding chain of a tile and release its mixer pad. The source
+ * goes first, so this also works while the pipeline is running. */
+static void remove_tile_stream (GStreamerBackend *self, CompositeTile *tile)
+{
+    if (tile->source) {
+        gst_element_set_state (tile->source, GST_STATE_NULL);
+        gst_bin_remove (GST_BIN (self->pipeline), tile->source);
+        tile->source = NULL;
+    }
+    remove_decode_chain (self->pipeline, &tile->depayloader, &tile->parser, &tile->decoder);
+    gst_element_release_request_pad (self->mixer, tile->mixer_pad);
+}
+
+/* Remove the composite sources and the mixer, leaving the video sink unlinked. The pipeline
+ * must not be PLAYING or PAUSED. */
+static void teardown_composite (GStreamerBackend *self)
+{
+    if (!self->mixer)
+        return;
+
+    for (guint i = 0; i < self->tiles->len; i++) {
+        CompositeTile *tile = g_ptr_array_index (self->tiles, i);
+
+        if (tile->pending)
+            remove_tile_stream (self, tile->pending);
+        remove_tile_stream (self, tile);
+    }
+    g_ptr_array_set_size (self->tiles, 0);
+    self->tiled_columns = 0;
+    self->tiled_rows = 0;
+
+    gst_element_set_state (self->mixer, GST_STATE_NULL);
+    gst_element_set_state (self->mixer_caps, GST_STATE_NULL);
+    gst_bin_remove_many (GST_BIN (self->pipeline), self->mixer, self->mixer_caps, NULL);
+    self->mixer = NULL;
+    self->mixer_caps = NULL;
+}
+
+/* Set the output size of the mixer */
+static void update_mixer_caps (GStreamerBackend *self)
+{
+    GstCaps *caps = gst_caps_new_simple ("video/x-raw",
+                                         "width", G_TYPE_INT, self->canvas_width,
+                                         "height", G_TYPE_INT, self->canvas_height, NULL);
+
+    gst_caps_set_features (caps, 0, gst_caps_features_new ("memory:GLMemory", NULL));
+    g_object_set (self->mixer_caps, "caps", caps, NULL);
+    gst_caps_unref (caps);
+}
+
+/* Insert glvideomixer ! capsfilter in front of the render filter. All tiles are mixed on the GPU,
+ * into the single GL context and overlay surface of the sink. */
+static gboolean build_mixer (GStreamerBackend *self)
+{
+    self->mixer = gst_element_factory_make ("glvideomixer", "mixer");
+    self->mixer_caps = gst_element_factory_make ("capsfilter", "mixer-caps");
+    if (!self->mixer || !self->mixer_caps) {
+        release_floating (&self->mixer);
+        release_floating (&self->mixer_caps);
+        [self setUIMessage:"Unable to build the compositor: glvideomixer not available"];
+        return FALSE;
+    }
+
+    gst_util_set_object_arg (G_OBJECT (self->mixer), "background", "black");
+    update_mixer_caps (self);
+
+    gst_bin_add_many (GST_BIN (self->pipeline), self->mixer, self->mixer_caps, NULL);
+    if (!gst_element_link_many (self->mixer, self->mixer_caps, self->render_filter, NULL)) {
+        GST_ERROR ("Could not link the mixer to the video sink");
+        gst_bin_remove_many (GST_BIN (self->pipeline), self->mixer, self->mixer_caps, NULL);
+        self->mixer = NULL;
+        self->mixer_caps = NULL;
+        return FALSE;
+    }
+    gst_element_sync_state_with_parent (self->mixer_caps);
+    gst_element_sync_state_with_parent (self->mixer);
+    return TRUE;
+}
+
+/* Place a tile on the canvas according to its frame, given in fractions of the canvas */
+static void layout_tile (GStreamerBackend *self, CompositeTile *tile)
+{
+    g_object_set (tile->mixer_pad,
+                  "xpos", (gint) (tile->frame.origin.x * self->canvas_width),
+                  "ypos", (gint) (tile->frame.origin.y * self->canvas_height),
+                  "width", (gint) (tile->frame.size.width * self->canvas_width),
+                  "height", (gint) (tile->frame.size.height * self->canvas_height), NULL);
+}
+
+/* Whether a tile of the equirectangular grid is within margin degrees of the viewport. Yaw
+ * goes from -180 at the left edge of the frame to 180 at the right, pitch from 90 at the top
+ * to -90 at the bottom. */
+static gboolean tile_in_viewport (GStreamerBackend *self, guint column, guint row, gdouble margin)
+{
+    gdouble tile_width = 360.0 / self->tiled_columns;
+    gdouble tile_height = 180.0 / self->tiled_rows;
+    gdouble top = 90 - row * tile_height;
+    gdouble bottom = top - tile_height;
+    gdouble view_top = self->viewport_pitch + self->viewport_vfov / 2 + margin;
+    gdouble view_bottom = self->viewport_pitch - self->viewport_vfov / 2 - margin;
+    gdouble latitude, half_width, distance;
+
+    if (bottom > view_top || top < view_bottom)
+        return FALSE;
+
+    /* Looking over a pole, every direction is in view */
+    if (view_top >= 90 || view_bottom <= -90)
+        return TRUE;
+
+    /* Towards the poles the viewport spans more yaw, as much as at the latitude closest to
+     * the pole that the tile and the viewport share */
+    latitude = MAX (fabs (MAX (bottom, view_bottom)), fabs (MIN (top, view_top)));
+    half_width = (self->viewport_hfov / 2 + margin) / cos (latitude * G_PI / 180);
+    if (half_width >= 180)
+        return TRUE;
+
+    distance = fmod ((column + 0.5) * tile_width - 180 - self->viewport_yaw, 360);
+    if (distance < 0)
+        distance += 360;
+    if (distance > 180)
+        distance = 360 - distance;
+    return distance <= half_width + tile_width / 2;
+}
+
+/* Called from a streaming thread with the first frame of a pending tile. The switch itself
+ * happens on our context. */
+static GstPadProbeReturn pending_tile_probe_cb (GstPad *pad, GstPadProbeInfo *info, CompositeTile *pending)
+{
+    GStreamerBackend *self = pending->backend;
+
+    g_atomic_int_set (&pending->ready, TRUE);
+    g_main_context_invoke (self->context, (GSourceFunc) promote_ready_tiles_cb, (__bridge void *)self);
+    return GST_PAD_PROBE_REMOVE;
+}
+
+/* Replace the tiles whose other quality stream has started with it. Until then both were
+ * mixed, the pending stream above the current one, so the tile never goes blank. */
+static gboolean promote_ready_tiles_cb (GStreamerBackend *self)
+{
+    for (guint i = 0; i < self->tiles->len; i++) {
+        CompositeTile *tile = g_ptr_array_index (self->tiles, i);
+        CompositeTile *pending = tile->pending;
+
+        if (!pending || !g_atomic_int_get (&pending->ready))
+            continue;
+
+        /* The pending tile takes the place of the current one: its source still signals
+         * new pads with it */
+        tile->pending = NULL;
+        remove_tile_stream (self, tile);
+        pending->uris[TILE_QUALITY_LOW] = tile->uris[TILE_QUALITY_LOW];
+        pending->uris[TILE_QUALITY_HIGH] = tile->uris[TILE_QUALITY_HIGH];
+        tile->uris[TILE_QUALITY_LOW] = tile->uris[TILE_QUALITY_HIGH] = NULL;
+        self->tiles->pdata[i] = pending;
+        free_tile (tile);
+        g_object_set (pending->mixer_pad, "zorder", 0, NULL);
+        GST_DEBUG ("Tile %u switched to %s quality", i, pending->quality == TILE_QUALITY_HIGH ? "high" : "low");
+    }
+    return G_SOURCE_REMOVE;
+}
+
+/* Start playing a tile at the given quality, in a pending tile on top of the current one */
+static void switch_tile_quality (GStreamerBackend *self, CompositeTile *tile, gint quality)
+{
+    CompositeTile *pending;
+
+    /* The head turned back before the other quality got going */
+    if (tile->pending) {
+        if (tile->pending->quality == quality)
+            return;
+        remove_tile_stream (self, tile->pending);
+        g_clear_pointer (&tile->pending, free_tile);
+    }
+    if (tile->quality == quality)
+        return;
+
+    pending = g_new0 (CompositeTile, 1);
+    pending->backend = self;
+    pending->quality = quality;
+    pending->frame = tile->frame;
+    pending->mixer_pad = gst_element_request_pad_simple (self->mixer, "sink_%u");
+    if (!pending->mixer_pad) {
+        g_free (pending);
+        return;
+    }
+    g_object_set (pending->mixer_pad, "zorder", 1, NULL);
+    layout_tile (self, pending);
+    gst_pad_add_probe (pending->mixer_pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback) pending_tile_probe_cb, pending, NULL);
+    pending->source = make_source (self, self->pipeline, tile->uris[quality], NULL, G_CALLBACK (tile_pad_added_cb), pending);
+    tile->pending = pending;
+}
+
+/* Give the tiles in the viewport their high quality stream and the others their low quality
+ * one */
+static void update_viewport (GStreamerBackend *self)
+{
+    if (!self->tiled_columns)
+        return;
+
+    for (guint i = 0; i < self->tiles->len; i++) {
+        CompositeTile *tile = g_ptr_array_index (self->tiles, i);
+        gint quality = tile->pending ? tile->pending->quality : tile->quality;
+        guint column = i % self->tiled_columns, row = i / self->tiled_columns;
+
+        if (quality == TILE_QUALITY_LOW && tile_in_viewport (self, column, row, VIEWPORT_MARGIN_DEGREES))
+            switch_tile_quality (self, tile, TILE_QUALITY_HIGH);
+        else if (quality == TILE_QUALITY_HIGH && !tile_in_viewport (self, column, row, 2 * VIEWPORT_MARGIN_DEGREES))
+            switch_tile_quality (self, tile, TILE_QUALITY_LOW);
+    }
+}
+
+/* Tear down whatever feeds the video sink of the hardware pipeline, before a new source is
+ * put in. Returns the state the pipeline was in, to go back to once the new source exists. */
+static GstState clear_hardware_sources (GStreamerBackend *self)
+{
+    GstState current = GST_STATE (self->pipeline);
+
+    set_webrtc_signalling (self, nil);
+    self->dvr_replaying = FALSE;
+    if (self->source || self->mixer) {
+        gst_element_set_state (self->pipeline, GST_STATE_READY);
+        teardown_decode_chain (self);
+        teardown_composite (self);
+        remove_source (self);
+    }
+    return current;
+}
+
+/* Bring the pipeline back to where it was before clear_hardware_sources() */
+static void restore_hardware_state (GStreamerBackend *self, GstState previous)
+{
+    if (self->source && previous > GST_STATE_READY && self->target_state >= GST_STATE_PAUSED)
+        self->is_live = (gst_element_set_state (self->pipeline, self->target_state) == GST_STATE_CHANGE_NO_PREROLL);
+}
+
+/* Replace the source of the hardware pipeline with one that handles the given URI. The
+ * pipeline and its sink stay alive, only the source and decoding chain are rebuilt. */
+static void set_hardware_source (GStreamerBackend *self, const gchar *uri)
+{
+    GstState previous = clear_hardware_sources (self);
+
+    self->source = make_source (self, self->pipeline, uri, "source", G_CALLBACK (source_pad_added_cb), (__bridge void *)self);
+    restore_hardware_state (self, previous);
+}
+
+static void free_dvr_fragment (DvrFragment *fragment)
+{
+    g_free (fragment->location);
+    g_free (fragment);
+}
+
+/* Delete every fragment. A recorder still running goes on writing into the directory. */
+static void clear_dvr_recording (GStreamerBackend *self)
+{
+    GDir *dir;
+    const gchar *name;
+
+    g_mutex_lock (&self->dvr_lock);
+    g_ptr_array_set_size (self->dvr_fragments, 0);
+    dir = g_dir_open (self->dvr_directory, 0, NULL);
+    while (dir && (name = g_dir_read_name (dir))) {
+        gchar *path = g_build_filename (self->dvr_directory, name, NULL);
+        g_unlink (path);
+        g_free (path);
+    }
+    g_clear_pointer (&dir, g_dir_close);
+    g_mutex_unlock (&self->dvr_lock);
+}
+
+/* Locations of the newest fragments covering length, oldest first, or NULL if nothing has
+ * been recorded */
+static gchar **dvr_locations (GStreamerBackend *self, GstClockTime length)
+{
+    GPtrArray *locations = g_ptr_array_new ();
+    GstClockTime covered = 0;
+    guint first;
+
+    g_mutex_lock (&self->dvr_lock);
+    for (first = self->dvr_fragments->len; first > 0 && covered < length; first--)
+        covered += ((DvrFragment *) g_ptr_array_index (self->dvr_fragments, first - 1))->duration;
+    for (guint i = first; i < self->dvr_fragments->len; i++)
+        g_ptr_array_add (locations, g_strdup (((DvrFragment *) g_ptr_array_index (self->dvr_fragments, i))->location));
+    g_mutex_unlock (&self->dvr_lock);
+
+    if (locations->len == 0) {
+        g_ptr_array_unref (locations);
+        return NULL;
+    }
+    g_ptr_array_add (locations, NULL);
+    return (gchar **) g_ptr_array_free (locations, FALSE);
+}
+
+static gchar **dvr_format_location_cb (GstElement *splitmux, gchar **locations)
+{
+    return g_strdupv (locations);
+}
+
+/* Create a splitmuxsrc inside bin that plays the given fragments back to back, as a single
+ * seekable stream of the still compressed video. Takes ownership of locations. */
+static GstElement *make_dvr_source (GStreamerBackend *self, GstElement *bin, gchar **locations, const gchar *name,
+                                    GCallback pad_added_cb, gpointer user_data)
+{
+    GstElement *replay = gst_element_factory_make ("splitmuxsrc", name);
+
+    if (!replay) {
+        g_strfreev (locations);
+        [self setUIMessage:"Unable to create splitmuxsrc"];
+        return NULL;
+    }
+
+    g_signal_connect_data (replay, "format-location", G_CALLBACK (dvr_format_location_cb), locations,
+                           (GClosureNotify) g_strfreev, 0);
+    g_signal_connect (replay, "pad-added", pad_added_cb, user_data);
+    gst_bin_add (GST_BIN (bin), replay);
+    gst_element_sync_state_with_parent (replay);
+    return replay;
+}
+
+static void export_pad_added_cb (GstElement *src, GstPad *pad, GstElement *muxer)
+{
+    GstPad *sink_pad = gst_element_get_compatible_pad (muxer, pad, NULL);
+
+    if (!sink_pad || gst_pad_link (pad, sink_pad) != GST_PAD_LINK_OK)
+        GST_ERROR ("Could not link %s to the clip muxer", GST_PAD_NAME (pad));
+    g_clear_object (&sink_pad);
+}
+
+static NSError *dvr_error (GQuark domain, gint code, const gchar *message)
+{
+    return [NSError errorWithDomain:[NSString stringWithUTF8String:g_quark_to_string (domain)]
+                               code:code
+                           userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithUTF8String:message] }];
+}
+
+/* Release an export and hand its result to the completion handler */
+static void finish_dvr_export (DvrExport *export, NSError *error)
+{
+    GStreamerClipCompletion completion = (__bridge_transfer GStreamerClipCompletion) export->completion;
+
+    if (export->pipeline) {
+        gst_element_set_state (export->pipeline, GST_STATE_NULL);
+        gst_object_unref (export->pipeline);
+    }
+    g_free (export);
+    if (completion) {
+        dispatch_async (dispatch_get_main_queue (), ^{
+            completion (error);
+        });
+    }
+}
+
+/* The clip is complete once mp4mux has written its index, on EOS */
+static gboolean export_bus_cb (GstBus *bus, GstMessage *msg, DvrExport *export)
+{
+    GError *err = NULL;
+    NSError *error = nil;
+
+    switch (GST_MESSAGE_TYPE (msg)) {
+        case GST_MESSAGE_EOS:
+            break;
+        case GST_MESSAGE_ERROR:
+            gst_message_parse_error (msg, &err, NULL);
+            error = dvr_error (err->domain, err->code, err->message);
+            g_clear_error (&err);
+            break;
+        default:
+            return TRUE;
+    }
+    finish_dvr_export (export, error);
+    return FALSE;
+}
+
+/* Replace the signalling channel. Only the context does, the webrtcbin threads read it
+ * through copy_webrtc_signalling(). */
+static void set_webrtc_signalling (GStreamerBackend *self, id<GStreamerWebRTCSignalling> signalling)
+{
+    g_mutex_lock (&self->webrtc_lock);
+    self->webrtc_signalling = signalling;
+    g_mutex_unlock (&self->webrtc_lock);
+}
+
+/* The signalling channel of the current session, nil once it is gone. The strong reference
+ * keeps it alive while a webrtcbin thread uses it, even if the context replaces it meanwhile. */
+static id<GStreamerWebRTCSignalling> copy_webrtc_signalling (GStreamerBackend *self)
+{
+    id<GStreamerWebRTCSignalling> signalling;
+
+    g_mutex_lock (&self->webrtc_lock);
+    signalling = self->webrtc_signalling;
+    g_mutex_unlock (&self->webrtc_lock);
+    return signalling;
+}
+
+/* Apply a local description created by webrtcbin and hand it to the signalling channel */
+static void send_local_description (GStreamerBackend *self, GstPromise *promise, const gchar *type)
+{
+    id<GStreamerWebRTCSignalling> signalling = copy_webrtc_signalling (self);
+    const GstStructure *reply;
+    GstWebRTCSessionDescription *description = NULL;
+    gchar *text;
+
+    if (gst_promise_wait (promise) == GST_PROMISE_RESULT_REPLIED) {
+        reply = gst_promise_get_reply (promise);
+        gst_structure_get (reply, type, GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &description, NULL);
+    }
+    gst_promise_unref (promise);
+
+    /* The session may have been replaced in the meantime */
+    if (!signalling) {
+        if (description)
+            gst_webrtc_session_description_free (description);
+        return;
+    }
+    if (!description) {
+        [self setUIMessage:"Unable to create the WebRTC session description"];
+        return;
+    }
+
+    g_signal_emit_by_name (self->source, "set-local-description", description, NULL);
+    text = gst_sdp_message_as_text (description->sdp);
+    [signalling gstreamerSendSessionDescription:[NSString stringWithUTF8String:text]
+                                           type:[NSString stringWithUTF8String:type]];
+    g_free (text);
+    gst_webrtc_session_description_free (description);
+}
+
+static void offer_created_cb (GstPromise *promise, GStreamerBackend *self)
+{
+    send_local_description (self, promise, "offer");
+}
+
+static void answer_created_cb (GstPromise *promise, GStreamerBackend *self)
+{
+    send_local_description (self, promise, "answer");
+}
+
+/* The remote offer is in place, answer it */
+static void remote_offer_set_cb (GstPromise *promise, GStreamerBackend *self)
+{
+    gst_promise_unref (promise);
+    if (!copy_webrtc_signalling (self))
+        return;
+    promise = gst_promise_new_with_change_func ((GstPromiseChangeFunc) answer_created_cb, (__bridge void *)self, NULL);
+    g_signal_emit_by_name (self->source, "create-answer", NULL, promise);
+}
+
+/* Emitted by webrtcbin once it can create an offer, only used when we are the offerer */
+static void negotiation_needed_cb (GstElement *webrtc, GStreamerBackend *self)
+{
+    GstPromise *promise;
+
+    if (!self->webrtc_offer)
+        return;
+    promise = gst_promise_new_with_change_func ((GstPromiseChangeFunc) offer_created_cb, (__bridge void *)self, NULL);
+    g_signal_emit_by_name (webrtc, "create-offer", NULL, promise);
+}
+
+static void ice_candidate_cb (GstElement *webrtc, guint mline_index, gchar *candidate, GStreamerBackend *self)
+{
+    id<GStreamerWebRTCSignalling> signalling = copy_webrtc_signalling (self);
+
+    [signalling gstreamerSendIceCandidate:[NSString stringWithUTF8String:candidate] sdpMLineIndex:mline_index];
+}
+
+/* Create a receive-only webrtcbin in place of the RTSP source. The RTP pads it exposes once
+ * the session is up look the same as those of rtspsrc, so source_pad_added_cb builds the
+ * usual hardware decoding chain for them. */
+static GstElement *make_webrtc_source (GStreamerBackend *self, const gchar *stun_server)
+{
+    GstElement *webrtc = gst_element_factory_make ("webrtcbin", "source");
+    guint latency = jitterbuffer_latency_ms (self);
+
+    if (!webrtc) {
+        [self setUIMessage:"Unable to create webrtcbin"];
+        return NULL;
+    }
+
+    gst_util_set_object_arg (G_OBJECT (webrtc), "bundle-policy", "max-bundle");
+    if (stun_server)
+        g_object_set (webrtc, "stun-server", stun_server, NULL);
+    if (latency > 0)
+        g_object_set (webrtc, "latency", latency, NULL);
+
+    g_signal_connect (webrtc, "on-negotiation-needed", G_CALLBACK (negotiation_needed_cb), (__bridge void *)self);
+    g_signal_connect (webrtc, "on-ice-candidate", G_CALLBACK (ice_candidate_cb), (__bridge void *)self);
+    g_signal_connect (webrtc, "pad-added", G_CALLBACK (source_pad_added_cb), (__bridge void *)self);
+    gst_bin_add (GST_BIN (self->pipeline), webrtc);
+    watch_source (self, webrtc);
+
+    /* As the offerer, tell the remote peer we only want to receive video it can send
+     * in a format VideoToolbox decodes */
+    if (self->webrtc_offer) {
+        GstCaps *caps = gst_caps_from_string (WEBRTC_VIDEO_CAPS);
+        GstWebRTCRTPTransceiver *transceiver = NULL;
+
+        g_signal_emit_by_name (webrtc, "add-transceiver", GST_WEBRTC_RTP_TRANSCEIVER_DIRECTION_RECVONLY, caps, &transceiver);
+        gst_caps_unref (caps);
+        g_clear_object (&transceiver);
+    }
+
+    gst_element_sync_state_with_parent (webrtc);
+    return webrtc;
+}
+
+/* glimagesink renders into the UIView. A GStreamerMetalView gets its frames from an appsink
+ * in the same place, which waits on the clock like any video sink, so frames reach the view
+ * paced to their presentation time and QoS works as usual. */
+static GstElement *make_video_sink (GStreamerBackend *self)
+{
+    GstElement *sink;
+    GstCaps *caps;
+
+    if (!self->metal_view)
+        return gst_element_factory_make ("glimagesink", "video-sink");
+
+    sink = gst_element_factory_make ("appsink", "video-sink");
+    if (!sink)
+        return NULL;
+    caps = gst_caps_from_string (METAL_FRAME_CAPS);
+    g_object_set (sink, "sync", TRUE, "qos", TRUE, "caps", caps, "max-buffers", 1, "drop", TRUE,
+                  "enable-last-sample", FALSE, NULL);
+    gst_caps_unref (caps);
+    return sink;
+}
+
+/* Build the explicit hardware decoding pipeline. Only the render filter and video sink exist up
+ * front: the source is created by setUri: and the decoding chain once the source exposes its
+ * streams. */
+static GstElement *build_hardware_pipeline (GStreamerBackend *self)
+{
+    GstElement *hardware_pipeline = gst_pipeline_new ("hardware-pipeline");
+    GstElement *filter = make_render_filter (self);
+    GstElement *sink = make_video_sink (self);
+
+    if (!sink) {
+        release_floating (&filter);
+        gst_object_unref (hardware_pipeline);
+        return NULL;
+    }
+    gst_bin_add_many (GST_BIN (hardware_pipeline), filter, sink, NULL);
+    gst_element_link (filter, sink);
+    return hardware_pipeline;
+}
+
+/* Configure the video sink so late buffers are dropped (low profile) or so it
+ * does not wait on the clock at all and shows each frame as soon as it is decoded
+ * (ultra low profile). */
+static void configure_video_sink_latency (GStreamerBackend *self)
+{
+    gboolean latest_frame = self->render_mode == GStreamerRenderModeLatestFrame;
+
+    switch (self->latency_profile) {
+        case GStreamerLatencyProfileLow:
+            g_object_set (self->video_sink, "qos", TRUE, "max-lateness", (gint64) (latest_frame ? LATEST_FRAME_MAX_LATENESS : LOW_LATENCY_MAX_LATENESS), NULL);
+            break;
+        case GStreamerLatencyProfileUltraLow:
+            g_object_set (self->video_sink, "sync", FALSE, "qos", FALSE, NULL);
+            break;
+        default:
+            g_object_set (self->video_sink, "max-lateness", (gint64) (latest_frame ? LATEST_FRAME_MAX_LATENESS : DEFAULT_MAX_LATENESS), NULL);
+            break;
+    }
+
+    configure_render_queue (self);
 }
 
-/*
- * Interface methods
- */
+/* With a single leaky slot a new frame pushes out the one still waiting for the sink, so the
+ * sink always gets the freshest decoded picture and the decoder never blocks. Only live
+ * streams go leaky: for anything else it would throw away frames a paused or prerolling sink
+ * is merely not ready for yet. Applied again once the pipeline prerolls and is_live is known. */
+static void configure_render_queue (GStreamerBackend *self)
+{
+    gboolean latest_frame = self->render_mode == GStreamerRenderModeLatestFrame;
 
--(id) init:(id) uiDelegate videoView:(UIView *)video_view
+    if (!self->render_queue)
+        return;
+    g_object_set (self->render_queue, "max-size-buffers", latest_frame ? 1 : RENDER_QUEUE_BUFFERS, NULL);
+    gst_util_set_object_arg (G_OBJECT (self->render_queue), "leaky", latest_frame && self->is_live ? "downstream" : "no");
+}
+
+/* Drop frames at the head of the tap branch while nobody wants them, so they are neither
+ * queued nor wrapped into pixel buffers. The branch is always linked, as the frame handler
+ * can be set at any time. */
+static GstPadProbeReturn frame_tap_probe_cb (GstPad *pad, GstPadProbeInfo *info, GStreamerBackend *self)
 {
-    if (self = [super init])
-    {
-        self->ui_delegate = uiDelegate;
-        self->ui_video_view = video_view;
-        self->duration = GST_CLOCK_TIME_NONE;
+    return g_atomic_int_get (&self->frame_tap_open) ? GST_PAD_PROBE_OK : GST_PAD_PROBE_DROP;
+}
 
-        GST_DEBUG_CATEGORY_INIT (debug_category, "gstreamer_swift", 0, "GStreamer Swift");
-        gst_debug_set_threshold_for_name("gstreamer_swift", GST_LEVEL_NONE); // Try GST_LEVEL_DEBUG
+/* Create the bin that sits in front of the video sink:
+ *
+ *   tee ! render-queue           -> the video sink
+ *   tee ! queue ! appsink        -> the frame tap
+ *
+ * The render queue decouples decoding from rendering, only its buffer count limits it. The
+ * tap branch holds a single leaky slot, so a slow frame handler only ever loses frames and
+ * never holds back decoding or rendering. Without a frame handler, frames stop at the tap
+ * queue, see frame_tap_probe_cb(). */
+static GstElement *make_render_filter (GStreamerBackend *self)
+{
+    GstElement *bin = gst_bin_new ("render-filter");
+    GstElement *tee = gst_element_factory_make ("tee", NULL);
+    GstElement *queue = gst_element_factory_make ("queue", "render-queue");
+    GstElement *tap_queue = gst_element_factory_make ("queue", NULL);
+    GstElement *tap = gst_element_factory_make ("appsink", "frame-tap");
+    GstPad *pad;
 
-        /* Start the bus monitoring task */
-        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-            [self app_function];
-        });
-    }
+    g_object_set (queue, "max-size-buffers", RENDER_QUEUE_BUFFERS, "max-size-bytes", 0, "max-size-time", (guint64) 0, NULL);
+    g_object_set (tap_queue, "max-size-buffers", 1, "max-size-bytes", 0, "max-size-time", (guint64) 0, NULL);
+    gst_util_set_object_arg (G_OBJECT (tap_queue), "leaky", "downstream");
+    g_object_set (tap, "sync", FALSE, "async", FALSE, "max-buffers", 1, "drop", TRUE, "enable-last-sample", FALSE, NULL);
 
-    return self;
+    pad = gst_element_get_static_pad (tap_queue, "sink");
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback) frame_tap_probe_cb, (__bridge void *)self, NULL);
+    gst_object_unref (pad);
+
+    gst_bin_add_many (GST_BIN (bin), tee, queue, tap_queue, tap, NULL);
+    gst_element_link (tee, queue);
+    gst_element_link_many (tee, tap_queue, tap, NULL);
+
+    pad = gst_element_get_static_pad (tee, "sink");
+    gst_element_add_pad (bin, gst_ghost_pad_new ("sink", pad));
+    gst_object_unref (pad);
+    pad = gst_element_get_static_pad (queue, "src");
+    gst_element_add_pad (bin, gst_ghost_pad_new ("src", pad));
+    gst_object_unref (pad);
+    return bin;
 }
 
--(void) deinit
+/* Layout of GstCoreVideoMeta, which the applemedia plugin attaches to every buffer decoded by
+ * VideoToolbox, GL memory included. Its header is not installed, so the API is looked up by
+ * name, and core_video_pixel_buffer() checks the registered meta still matches this before
+ * reading it. */
+typedef struct {
+    GstMeta meta;
+    CVBufferRef cvbuf;
+    CVPixelBufferRef pixbuf;
+} CoreVideoMeta;
+
+static void release_frame_bytes (void *frame, const void *base_address)
 {
-    if (main_loop) {
-        g_main_loop_quit(main_loop);
-    }
+    gst_video_frame_unmap (frame);
+    g_free (frame);
 }
 
--(void) play
+static void release_frame_planes (void *frame, const void *data, size_t size, size_t n_planes, const void *planes[])
 {
-    target_state = GST_STATE_PLAYING;
-    is_live = (gst_element_set_state (pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_NO_PREROLL);
+    release_frame_bytes (frame, data);
 }
 
--(void) pause
+/* Wrap a frame in system memory, as produced by the software decoders, in a CVPixelBuffer
+ * pointing at the GStreamer memory. The buffer stays mapped until the pixel buffer goes. */
+static CVPixelBufferRef wrap_system_memory (GstSample *sample)
 {
-    target_state = GST_STATE_PAUSED;
-    is_live = (gst_element_set_state (pipeline, GST_STATE_PAUSED) == GST_STATE_CHANGE_NO_PREROLL);
+    GstVideoInfo info;
+    GstVideoFrame *frame;
+    CVPixelBufferRef pixel_buffer = NULL;
+    OSType format;
+    gboolean full_range;
+    CFStringRef matrix;
+    void *planes[GST_VIDEO_MAX_PLANES];
+    size_t widths[GST_VIDEO_MAX_PLANES], heights[GST_VIDEO_MAX_PLANES], strides[GST_VIDEO_MAX_PLANES];
+    CVReturn result;
+
+    if (!gst_video_info_from_caps (&info, gst_sample_get_caps (sample)))
+        return NULL;
+    full_range = GST_VIDEO_INFO_COLORIMETRY (&info).range == GST_VIDEO_COLOR_RANGE_0_255;
+    switch (GST_VIDEO_INFO_FORMAT (&info)) {
+        case GST_VIDEO_FORMAT_NV12:
+            format = full_range ? kCVPixelFormatType_420YpCbCr8BiPlanarFullRange : kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange;
+            break;
+        case GST_VIDEO_FORMAT_I420:
+            format = full_range ? kCVPixelFormatType_420YpCbCr8PlanarFullRange : kCVPixelFormatType_420YpCbCr8Planar;
+            break;
+        case GST_VIDEO_FORMAT_BGRA:
+            format = kCVPixelFormatType_32BGRA;
+            break;
+        default:
+            return NULL;
+    }
+
+    frame = g_new0 (GstVideoFrame, 1);
+    if (!gst_video_frame_map (frame, &info, gst_sample_get_buffer (sample), GST_MAP_READ)) {
+        g_free (frame);
+        return NULL;
+    }
+
+    if (GST_VIDEO_FRAME_N_PLANES (frame) == 1) {
+        result = CVPixelBufferCreateWithBytes (kCFAllocatorDefault, GST_VIDEO_FRAME_WIDTH (frame), GST_VIDEO_FRAME_HEIGHT (frame),
+                                               format, GST_VIDEO_FRAME_PLANE_DATA (frame, 0), GST_VIDEO_FRAME_PLANE_STRIDE (frame, 0),
+                                               release_frame_bytes, frame, NULL, &pixel_buffer);
+    } else {
+        for (guint i = 0; i < GST_VIDEO_FRAME_N_PLANES (frame); i++) {
+            planes[i] = GST_VIDEO_FRAME_PLANE_DATA (frame, i);
+            widths[i] = GST_VIDEO_FRAME_COMP_WIDTH (frame, i);
+            heights[i] = GST_VIDEO_FRAME_COMP_HEIGHT (frame, i);
+            strides[i] = GST_VIDEO_FRAME_PLANE_STRIDE (frame, i);
+        }
+        result = CVPixelBufferCreateWithPlanarBytes (kCFAllocatorDefault, GST_VIDEO_FRAME_WIDTH (frame), GST_VIDEO_FRAME_HEIGHT (frame),
+                                                     format, NULL, 0, GST_VIDEO_FRAME_N_PLANES (frame), planes, widths, heights,
+                                                     strides, release_frame_planes, frame, NULL, &pixel_buffer);
+    }
+    if (result != kCVReturnSuccess) {
+        release_frame_bytes (frame, NULL);
+        return NULL;
+    }
+
+    /* Tell the renderer which YCbCr matrix the decoder used, as VideoToolbox does */
+    switch (GST_VIDEO_INFO_COLORIMETRY (&info).matrix) {
+        case GST_VIDEO_COLOR_MATRIX_BT601:
+            matrix = kCVImageBufferYCbCrMatrix_ITU_R_601_4;
+            break;
+        case GST_VIDEO_COLOR_MATRIX_BT2020:
+            matrix = kCVImageBufferYCbCrMatrix_ITU_R_2020;
+            break;
+        case GST_VIDEO_COLOR_MATRIX_BT709:
+            matrix = kCVImageBufferYCbCrMatrix_ITU_R_709_2;
+            break;
+        default:
+            matrix = NULL;
+            break;
+    }
+    if (matrix)
+        CVBufferSetAttachment (pixel_buffer, kCVImageBufferYCbCrMatrixKey, matrix, kCVAttachmentMode_ShouldPropagate);
+    return pixel_buffer;
 }
 
--(void) setUri:(NSString*)uri
+/* The pixel buffer VideoToolbox decoded a buffer into, NULL without a GstCoreVideoMeta or if
+ * the meta registered by applemedia is not laid out as CoreVideoMeta. Not retained. */
+static CVPixelBufferRef core_video_pixel_buffer (GstBuffer *buffer)
 {
-    const char *char_uri = [uri UTF8String];
-    g_object_set(pipeline, "uri", char_uri, NULL);
-    GST_DEBUG ("URI set to %s", char_uri);
+    static GType api;
+    static gint mismatch_reported;
+    GstMeta *meta;
+    const GstMetaInfo *info;
+    CVPixelBufferRef pixbuf;
+
+    if (!api)
+        api = g_type_from_name ("GstCoreVideoMetaAPI");
+    if (!api || !(meta = gst_buffer_get_meta (buffer, api)))
+        return NULL;
+
+    info = meta->info;
+    if (info->api == api && info->size == sizeof (CoreVideoMeta) && g_strcmp0 (g_type_name (info->type), "GstCoreVideoMeta") == 0) {
+        pixbuf = ((CoreVideoMeta *) meta)->pixbuf;
+        if (!pixbuf || CFGetTypeID (pixbuf) == CVPixelBufferGetTypeID ())
+            return pixbuf;
+    }
+
+    if (g_atomic_int_compare_and_exchange (&mismatch_reported, 0, 1))
+        GST_WARNING ("%s does not have the expected GstCoreVideoMeta layout, not using it", g_type_name (info->type));
+    return NULL;
 }
 
-/*
- * Private methods
- */
+/* Get a retained CVPixelBuffer for a sample without copying the pixels */
+static CVPixelBufferRef get_pixel_buffer (GstSample *sample)
+{
+    GstBuffer *buffer = gst_sample_get_buffer (sample);
+    CVPixelBufferRef pixbuf = core_video_pixel_buffer (buffer);
 
-/* Change the message on the UI through the UI delegate */
--(void)setUIMessage:(gchar*) message
+    if (pixbuf)
+        return CVPixelBufferRetain (pixbuf);
+
+    /* GL memory without VideoToolbox behind it, such as a composite, has no pixel buffer */
+    if (gst_caps_features_contains (gst_caps_get_features (gst_sample_get_caps (sample), 0), "memory:GLMemory"))
+        return NULL;
+    return wrap_system_memory (sample);
+}
+
+/* Called on the streaming thread of the frame tap for each decoded frame, straight from the
+ * decoder, not waiting on the clock */
+static GstFlowReturn frame_tap_sample_cb (GstAppSink *sink, gpointer user_data)
 {
-    NSString *string = [NSString stringWithUTF8String:message];
-    if(ui_delegate && [ui_delegate respondsToSelector:@selector(gstreamerSetUIMessage:)])
-    {
-        [ui_delegate gstreamerSetUIMessage:string];
+    GStreamerBackend *self = (__bridge GStreamerBackend *) user_data;
+    GstSample *sample = gst_app_sink_pull_sample (sink);
+    GStreamerFrameHandler handler;
+    CVPixelBufferRef pixel_buffer;
+    GstClockTime pts;
+
+    if (!sample)
+        return GST_FLOW_OK;
+
+    g_mutex_lock (&self->tap_lock);
+    handler = self->frame_handler;
+    g_mutex_unlock (&self->tap_lock);
+
+    if (handler && (pixel_buffer = get_pixel_buffer (sample))) {
+        pts = GST_BUFFER_PTS (gst_sample_get_buffer (sample));
+        handler (pixel_buffer, GST_CLOCK_TIME_IS_VALID (pts) ? CMTimeMake (pts, GST_SECOND) : kCMTimeInvalid);
+        CVPixelBufferRelease (pixel_buffer);
     }
+    gst_sample_unref (sample);
+    return GST_FLOW_OK;
 }
 
-/* Retrieve errors from the bus and show them on the UI */
-static void error_cb (GstBus *bus, GstMessage *msg, GStreamerBackend *self)
+/* Called on the streaming thread of the video sink of a GStreamerMetalView, once each frame
+ * is due on the clock */
+static GstFlowReturn metal_sink_sample_cb (GstAppSink *sink, gpointer user_data)
 {
-    GError *err;
-    gchar *debug_info;
-    gchar *message_string;
+    GStreamerBackend *self = (__bridge GStreamerBackend *) user_data;
+    GstSample *sample = gst_app_sink_pull_sample (sink);
+    GStreamerMetalView *metal_view;
+    CVPixelBufferRef pixel_buffer;
 
-    gst_message_parse_error (msg, &err, &debug_info);
-    message_string = g_strdup_printf ("Error received from element %s: %s", GST_OBJECT_NAME (msg->src), err->message);
-    g_clear_error (&err);
-    g_free (debug_info);
-    [self setUIMessage:message_string];
-    g_free (message_string);
-    gst_element_set_state (self->pipeline, GST_STATE_NULL);
+    if (!sample)
+        return GST_FLOW_OK;
+
+    g_mutex_lock (&self->tap_lock);
+    metal_view = self->metal_view;
+    g_mutex_unlock (&self->tap_lock);
+
+    if (metal_view && (pixel_buffer = get_pixel_buffer (sample))) {
+        [metal_view displayPixelBuffer:pixel_buffer];
+        CVPixelBufferRelease (pixel_buffer);
+    }
+    gst_sample_unref (sample);
+    return GST_FLOW_OK;
 }
 
-/* Called when the End Of the Stream is reached. Just move to the beginning of the media and pause. */
-static void eos_cb (GstBus *bus, GstMessage *msg, GStreamerBackend *self) {
-    self->target_state = GST_STATE_PAUSED;
-    self->is_live = (gst_element_set_state (self->pipeline, GST_STATE_PAUSED) == GST_STATE_CHANGE_NO_PREROLL);
+/* Delayed seek callback. This gets called by the timer setup in the below function. */
+static gboolean delayed_seek_cb (GStreamerBackend *self)
+{
+    g_clear_pointer (&self->seek_source, g_source_unref);
+    GST_DEBUG ("Doing delayed seek to %" GST_TIME_FORMAT, GST_TIME_ARGS (self->desired_position));
+    execute_seek (self->desired_position, self->desired_flags, self);
+    return G_SOURCE_REMOVE;
 }
 
-/* Called when buffering messages are received. We inform the UI about the current buffering level and
- * keep the pipeline paused until 100% buffering is reached. At that point, set the desired state. */
-static void buffering_cb (GstBus *bus, GstMessage *msg, GStreamerBackend *self) {
-    gint percent;
+/* Perform seek, if we are not too close to the previous seek. Otherwise, schedule the seek for
+ * some time in the future. Scrubbing seeks to the nearest keyframe, which only costs a demuxer
+ * lookup; the accurate seek when the user lets go decodes up to the exact frame and is never
+ * delayed, it replaces any seek still pending. */
+static void execute_seek (gint64 position, GstSeekFlags flags, GStreamerBackend *self)
+{
+    gint64 diff;
 
-    if (self->is_live)
+    if (position == GST_CLOCK_TIME_NONE)
         return;
 
-    gst_message_parse_buffering (msg, &percent);
-    if (percent < 100 && self->target_state >= GST_STATE_PAUSED) {
-        gchar * message_string = g_strdup_printf ("Buffering %d%%", percent);
-        gst_element_set_state (self->pipeline, GST_STATE_PAUSED);
-        [self setUIMessage:message_string];
-        g_free (message_string);
-    } else if (self->target_state >= GST_STATE_PLAYING) {
-        gst_element_set_state (self->pipeline, GST_STATE_PLAYING);
-    } else if (self->target_state >= GST_STATE_PAUSED) {
-        [self setUIMessage:"Buffering complete"];
+    diff = gst_util_get_timestamp () - self->last_seek_time;
+
+    if (!(flags & GST_SEEK_FLAG_ACCURATE) && GST_CLOCK_TIME_IS_VALID (self->last_seek_time) && diff < SEEK_MIN_DELAY) {
+        /* The previous seek was too close, delay this one */
+        if (!self->seek_source) {
+            /* There was no previous seek scheduled. Setup a timer for some time in the future */
+            self->seek_source = g_timeout_source_new ((SEEK_MIN_DELAY - diff) / GST_MSECOND);
+            g_source_set_callback (self->seek_source, (GSourceFunc)delayed_seek_cb, (__bridge void *)self, NULL);
+            g_source_attach (self->seek_source, self->context);
+        }
+        /* Update the desired seek position. If multiple requests are received before it is time
+         * to perform a seek, only the last one is remembered. */
+        self->desired_position = position;
+        self->desired_flags = flags;
+        GST_DEBUG ("Throttling seek to %" GST_TIME_FORMAT ", will be in %" GST_TIME_FORMAT,
+                   GST_TIME_ARGS (position), GST_TIME_ARGS (SEEK_MIN_DELAY - diff));
+    } else {
+        /* Perform the seek now */
+        if (self->seek_source) {
+            g_source_destroy (self->seek_source);
+            g_clear_pointer (&self->seek_source, g_source_unref);
+        }
+        self->last_seek_time = gst_util_get_timestamp ();
+        gst_element_seek_simple (self->pipeline, GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH | flags, position);
+        GST_DEBUG ("Seeking to %" GST_TIME_FORMAT, GST_TIME_ARGS (position));
+        self->desired_position = GST_CLOCK_TIME_NONE;
     }
 }
 
-/* Called when the clock is lost */
-static void clock_lost_cb (GstBus *bus, GstMessage *msg, GStreamerBackend *self) {
-    if (self->target_state >= GST_STATE_PLAYING) {
-        gst_element_set_state (self->pipeline, GST_STATE_PAUSED);
-        gst_element_set_state (self->pipeline, GST_STATE_PLAYING);
-    }
+/* Called when the duration of the media changes. Just mark it as unknown, so we re-query it in the next UI refresh. */
+static void duration_cb (GstBus *bus, GstMessage *msg, GStreamerBackend *self)
+{
+    self->duration = GST_CLOCK_TIME_NONE;
 }
 
 /* Retrieve the video sink's Caps and tell the application about the media size */
@@ -155,7 +3949,11 @@ static void check_media_size (GStreamerBackend *self) {
     GstVideoInfo info;
 
     /* Retrieve the Caps at the entrance of the video sink */
-    g_object_get (self->pipeline, "video-sink", &video_sink, NULL);
+    if (self->decode_mode == GStreamerDecodeModeHardware) {
+        video_sink = self->video_sink ? gst_object_ref (self->video_sink) : NULL;
+    } else {
+        g_object_get (self->pipeline, "video-sink", &video_sink, NULL);
+    }
 
     /* Do nothing if there is no video sink (this might be an audio-only clip */
     if (!video_sink) return;
@@ -167,10 +3965,11 @@ static void check_media_size (GStreamerBackend *self) {
         info.width = info.width * info.par_n / info.par_d;
         GST_DEBUG ("Media size is %dx%d, notifying application", info.width, info.height);
 
-        if (self->ui_delegate && [self->ui_delegate respondsToSelector:@selector(mediaSizeChanged:height:)])
-        {
-            [self->ui_delegate mediaSizeChanged:info.width height:info.height];
-        }
+        g_mutex_lock (&self->event_lock);
+        self->event_width = info.width;
+        self->event_height = info.height;
+        post_ui_events (self, UI_EVENT_MEDIA_SIZE);
+        g_mutex_unlock (&self->event_lock);
     }
 
     gst_caps_unref(caps);
@@ -186,13 +3985,19 @@ static void state_changed_cb (GstBus *bus, GstMessage *msg, GStreamerBackend *se
     /* Only pay attention to messages coming from the pipeline, not its children */
     if (GST_MESSAGE_SRC (msg) == GST_OBJECT (self->pipeline)) {
         self->state = new_state;
-        gchar *message = g_strdup_printf("State changed to %s", gst_element_state_get_name(new_state));
-        [self setUIMessage:message];
-        g_free (message);
+        g_mutex_lock (&self->event_lock);
+        self->event_state = (GStreamerPlaybackState) (new_state - GST_STATE_NULL);
+        post_ui_events (self, UI_EVENT_STATE);
+        g_mutex_unlock (&self->event_lock);
 
         if (old_state == GST_STATE_READY && new_state == GST_STATE_PAUSED)
         {
             check_media_size(self);
+            configure_render_queue(self);
+
+            /* If there was a scheduled seek, perform it now that we have moved to the Paused state */
+            if (GST_CLOCK_TIME_IS_VALID (self->desired_position))
+                execute_seek (self->desired_position, self->desired_flags, self);
         }
     }
 }
@@ -201,7 +4006,7 @@ static void state_changed_cb (GstBus *bus, GstMessage *msg, GStreamerBackend *se
  * These conditions will change depending on the application */
 -(void) check_initialization_complete
 {
-    if (!initialized && main_loop) {
+    if (!initialized && (main_loop || shared_context)) {
         GST_DEBUG ("Initialization complete, notifying application.");
         if (ui_delegate && [ui_delegate respondsToSelector:@selector(gstreamerInitialized)])
         {
@@ -211,57 +4016,546 @@ static void state_changed_cb (GstBus *bus, GstMessage *msg, GStreamerBackend *se
     }
 }
 
-/* Main method for the bus monitoring code */
--(void) app_function
+/* Build a pipeline for the configured decode mode. It is not played until
+ * attach_pipeline() makes it the current one. */
+static GstElement *create_pipeline (GStreamerBackend *self)
 {
-    GstBus *bus;
-    GSource *timeout_source;
-    GSource *bus_source;
+    GstElement *new_pipeline;
     GError *error = NULL;
 
-    GST_DEBUG ("Creating pipeline");
-
-    /* Create our own GLib Main Context and make it the default one */
-    context = g_main_context_new ();
-    g_main_context_push_thread_default(context);
+    if (self->decode_mode == GStreamerDecodeModeHardware) {
+        new_pipeline = build_hardware_pipeline (self);
+        if (!new_pipeline)
+            [self setUIMessage:"Unable to build pipeline: glimagesink not available"];
+        else
+            g_signal_connect (new_pipeline, "deep-element-added", G_CALLBACK (deep_element_added_cb), (__bridge void *)self);
+        return new_pipeline;
+    }
 
-    /* Build pipeline */
-    pipeline = gst_parse_launch("playbin", &error);
+    new_pipeline = gst_parse_launch ("playbin", &error);
     if (error) {
-        gchar *message = g_strdup_printf("Unable to build pipeline: %s", error->message);
+        gchar *message = g_strdup_printf ("Unable to build pipeline: %s", error->message);
         g_clear_error (&error);
         [self setUIMessage:message];
         g_free (message);
-        return;
+        if (new_pipeline)
+            gst_object_unref (new_pipeline);
+        return NULL;
     }
+    g_signal_connect (new_pipeline, "source-setup", G_CALLBACK (source_setup_cb), (__bridge void *)self);
+    g_signal_connect (new_pipeline, "deep-element-added", G_CALLBACK (deep_element_added_cb), (__bridge void *)self);
+    g_object_set (new_pipeline, "video-filter", make_render_filter (self), NULL);
+    configure_playbin_audio (self, new_pipeline);
+    if (self->budget_queue_bytes > 0)
+        g_object_set (new_pipeline, "buffer-size", (gint) MIN (self->budget_queue_bytes, G_MAXINT), NULL);
+    if (GST_CLOCK_TIME_IS_VALID (self->adaptive_buffer_target))
+        g_object_set (new_pipeline, "buffer-duration", (gint64) self->adaptive_buffer_target, NULL);
+    if (self->metal_view)
+        g_object_set (new_pipeline, "video-sink", make_video_sink (self), NULL);
+    return new_pipeline;
+}
+
+/* Make the given pipeline the one being played: hand its video sink our UIView, hook the
+ * statistics probes and watch its bus from our main context */
+static gboolean attach_pipeline (GStreamerBackend *self, GstElement *new_pipeline)
+{
+    GstBus *bus;
+    GstPad *video_sink_pad;
+    GstElement *current_source = NULL;
 
     /* Set the pipeline to READY, so it can already accept a window handle */
-    gst_element_set_state(pipeline, GST_STATE_READY);
+    if (GST_STATE (new_pipeline) < GST_STATE_READY)
+        gst_element_set_state (new_pipeline, GST_STATE_READY);
 
-    video_sink = gst_bin_get_by_interface(GST_BIN(pipeline), GST_TYPE_VIDEO_OVERLAY);
-    if (!video_sink) {
+    if (self->decode_mode == GStreamerDecodeModeHardware) {
+        self->video_sink = gst_bin_get_by_name (GST_BIN (new_pipeline), "video-sink");
+        current_source = gst_bin_get_by_name (GST_BIN (new_pipeline), "source");
+    } else {
+        if (self->metal_view)
+            g_object_get (new_pipeline, "video-sink", &self->video_sink, NULL);
+        else
+            self->video_sink = gst_bin_get_by_interface (GST_BIN (new_pipeline), GST_TYPE_VIDEO_OVERLAY);
+        g_object_get (new_pipeline, "source", &current_source, NULL);
+    }
+    if (!self->video_sink) {
         GST_ERROR ("Could not retrieve video sink");
-        return;
+        g_clear_object (&current_source);
+        return FALSE;
+    }
+
+    self->pipeline = new_pipeline;
+    /* playbin only puts its video filter in place once it builds the video chain */
+    if (self->decode_mode == GStreamerDecodeModeHardware)
+        self->render_filter = gst_bin_get_by_name (GST_BIN (new_pipeline), "render-filter");
+    else
+        g_object_get (new_pipeline, "video-filter", &self->render_filter, NULL);
+    if (self->render_filter) {
+        self->render_queue = gst_bin_get_by_name (GST_BIN (self->render_filter), "render-queue");
+        self->frame_tap = gst_bin_get_by_name (GST_BIN (self->render_filter), "frame-tap");
+    }
+    if (self->frame_tap) {
+        GstAppSinkCallbacks callbacks = { .new_sample = frame_tap_sample_cb };
+        gst_app_sink_set_callbacks (GST_APP_SINK (self->frame_tap), &callbacks, (__bridge void *)self, NULL);
+    }
+    if (GST_IS_VIDEO_OVERLAY (self->video_sink))
+        gst_video_overlay_set_window_handle (GST_VIDEO_OVERLAY (self->video_sink), (guintptr) (id) self->ui_video_view);
+    if (GST_IS_APP_SINK (self->video_sink)) {
+        GstAppSinkCallbacks callbacks = { .new_sample = metal_sink_sample_cb };
+        gst_app_sink_set_callbacks (GST_APP_SINK (self->video_sink), &callbacks, (__bridge void *)self, NULL);
+    }
+    configure_video_sink_latency (self);
+
+    /* Count the frames reaching the video sink */
+    video_sink_pad = gst_element_get_static_pad (self->video_sink, "sink");
+    if (video_sink_pad) {
+        gst_pad_add_probe (video_sink_pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback) video_sink_probe_cb, (__bridge void *)self, NULL);
+        gst_object_unref (video_sink_pad);
+    }
+
+    /* A promoted standby pipeline already has its source */
+    if (current_source) {
+        if (self->decode_mode == GStreamerDecodeModeHardware)
+            self->source = current_source; /* The pipeline keeps it alive */
+        watch_source (self, current_source);
+        watch_existing_jitterbuffers (self, current_source);
+        gst_object_unref (current_source);
+        raise_video_threads_qos (new_pipeline);
+    }
+
+    /* Pick up the decoding chain that source_pad_added_cb built inside a standby pipeline */
+    if (self->decode_mode == GStreamerDecodeModeHardware && !self->decoder) {
+        GstElement **chain[] = { &self->depayloader, &self->parser, &self->decoder };
+        const gchar *names[] = { "depayloader", "parser", "decoder" };
+
+        for (int i = 0; i < G_N_ELEMENTS (chain); i++) {
+            *chain[i] = gst_bin_get_by_name (GST_BIN (new_pipeline), names[i]);
+            if (*chain[i])
+                gst_object_unref (*chain[i]); /* The pipeline keeps it alive */
+        }
     }
-    gst_video_overlay_set_window_handle(GST_VIDEO_OVERLAY(video_sink), (guintptr) (id) ui_video_view);
 
     /* Instruct the bus to emit signals for each received message, and connect to the interesting signals */
-    bus = gst_element_get_bus (pipeline);
-    bus_source = gst_bus_create_watch (bus);
-    g_source_set_callback (bus_source, (GSourceFunc) gst_bus_async_signal_func, NULL, NULL);
-    g_source_attach (bus_source, context);
-    g_source_unref (bus_source);
+    bus = gst_element_get_bus (new_pipeline);
+    gst_bus_set_sync_handler (bus, NULL, NULL, NULL);
+    gst_bus_set_sync_handler (bus, bus_sync_cb, NULL, NULL);
+    self->bus_source = gst_bus_create_watch (bus);
+    g_source_set_callback (self->bus_source, (GSourceFunc) gst_bus_async_signal_func, NULL, NULL);
+    g_source_attach (self->bus_source, self->context);
     g_signal_connect (G_OBJECT (bus), "message::error", (GCallback)error_cb, (__bridge void *)self);
+    g_signal_connect (G_OBJECT (bus), "message::warning", (GCallback)warning_cb, (__bridge void *)self);
     g_signal_connect (G_OBJECT (bus), "message::eos", (GCallback)eos_cb, (__bridge void *)self);
     g_signal_connect (G_OBJECT (bus), "message::state-changed", (GCallback)state_changed_cb, (__bridge void *)self);
     g_signal_connect (G_OBJECT (bus), "message::buffering", (GCallback)buffering_cb, (__bridge void *)self);
     g_signal_connect (G_OBJECT (bus), "message::clock-lost", (GCallback)clock_lost_cb, (__bridge void *)self);
+    g_signal_connect (G_OBJECT (bus), "message::qos", (GCallback)qos_cb, (__bridge void *)self);
+    g_signal_connect (G_OBJECT (bus), "message::latency", (GCallback)latency_cb, (__bridge void *)self);
+    g_signal_connect (G_OBJECT (bus), "message::duration-changed", (GCallback)duration_cb, (__bridge void *)self);
+    g_signal_connect (G_OBJECT (bus), "message::element", (GCallback)element_cb, (__bridge void *)self);
+    gst_object_unref (bus);
+
+    return TRUE;
+}
+
+/* Stop the current pipeline and release it, together with everything pointing into it */
+static void detach_pipeline (GStreamerBackend *self)
+{
+    GstBus *bus;
+
+    if (!self->pipeline)
+        return;
+
+    if (self->bus_source) {
+        g_source_destroy (self->bus_source);
+        g_source_unref (self->bus_source);
+        self->bus_source = NULL;
+    }
+    bus = gst_element_get_bus (self->pipeline);
+    g_signal_handlers_disconnect_by_data (bus, (__bridge void *)self);
     gst_object_unref (bus);
 
+    gst_element_set_state (self->pipeline, GST_STATE_NULL);
+    if (self->video_sink && GST_IS_APP_SINK (self->video_sink)) {
+        GstAppSinkCallbacks callbacks = { 0 };
+        gst_app_sink_set_callbacks (GST_APP_SINK (self->video_sink), &callbacks, NULL, NULL);
+    }
+    g_clear_object (&self->video_sink);
+    if (self->frame_tap) {
+        GstAppSinkCallbacks callbacks = { 0 };
+        gst_app_sink_set_callbacks (GST_APP_SINK (self->frame_tap), &callbacks, NULL, NULL);
+    }
+    g_clear_object (&self->frame_tap);
+    g_clear_object (&self->render_queue);
+    g_clear_object (&self->render_filter);
+    self->source = NULL;
+    self->depayloader = NULL;
+    self->parser = NULL;
+    self->decoder = NULL;
+    self->mixer = NULL;
+    self->mixer_caps = NULL;
+    g_ptr_array_set_size (self->tiles, 0);
+    g_mutex_lock (&self->stats_lock);
+    g_ptr_array_set_size (self->discard_sinks, 0);
+    g_ptr_array_set_size (self->jitterbuffers, 0);
+    gst_object_replace ((GstObject **) &self->srt_source, NULL);
+    g_mutex_unlock (&self->stats_lock);
+    gst_object_unref (self->pipeline);
+    self->pipeline = NULL;
+}
+
+/* Throw away the pipeline created by prerollUri: */
+static void discard_standby (GStreamerBackend *self)
+{
+    if (self->standby_pipeline) {
+        gst_element_set_state (self->standby_pipeline, GST_STATE_NULL);
+        gst_object_unref (self->standby_pipeline);
+        self->standby_pipeline = NULL;
+    }
+    g_clear_pointer (&self->standby_uri, g_free);
+}
+
+/* The URI GStreamer is given for uri: its proxy URI when playbin plays through the segment
+ * cache. The hardware pipeline only plays RTSP, SRT and WebRTC, there is nothing to cache. */
+static gchar *playback_uri (GStreamerBackend *self, const gchar *uri)
+{
+    if (!self->segment_cache || self->decode_mode == GStreamerDecodeModeHardware)
+        return g_strdup (uri);
+    return g_strdup ([[self->segment_cache proxyUriForUri:@(uri)] UTF8String]);
+}
+
+/* Play the given URI, promoting the standby pipeline if it was prerolled for it */
+static void switch_uri (GStreamerBackend *self, const gchar *requested_uri)
+{
+    gchar *char_uri = playback_uri (self, requested_uri);
+    gchar *previous_uri = self->live_uri;
+
+    /* Also where resumeLive comes back to, so requested_uri may be live_uri itself */
+    self->live_uri = g_strdup (requested_uri);
+    g_free (previous_uri);
+
+    reset_stats(self);
+    self->duration = GST_CLOCK_TIME_NONE;
+    self->desired_position = GST_CLOCK_TIME_NONE;
+
+    /* The standby pipeline already holds a session for this URI, just swap it in */
+    if (self->standby_uri && g_strcmp0 (self->standby_uri, char_uri) == 0) {
+        promote_standby(self);
+        GST_DEBUG ("Switched to prerolled URI %s", char_uri);
+        g_free (char_uri);
+        preroll_backup(self);
+        return;
+    }
+    discard_standby(self);
+
+    if (self->decode_mode == GStreamerDecodeModeHardware) {
+        set_hardware_source(self, char_uri);
+    } else {
+        /* Keep the pipeline and its sink alive: playbin only needs to go through READY
+         * to pick up the new URI */
+        GstState current = GST_STATE (self->pipeline);
+        if (current > GST_STATE_READY)
+            gst_element_set_state (self->pipeline, GST_STATE_READY);
+        g_object_set(self->pipeline, "uri", char_uri, NULL);
+        if (current > GST_STATE_READY && self->target_state >= GST_STATE_PAUSED)
+            self->is_live = (gst_element_set_state (self->pipeline, self->target_state) == GST_STATE_CHANGE_NO_PREROLL);
+    }
+    GST_DEBUG ("URI set to %s", char_uri);
+    g_free (char_uri);
+    preroll_backup(self);
+}
+
+/* Replace the current pipeline with the standby one, which already went through the
+ * connection and session setup while the previous stream was playing */
+static void promote_standby (GStreamerBackend *self)
+{
+    GstElement *promoted = self->standby_pipeline;
+
+    self->standby_pipeline = NULL;
+    g_clear_pointer (&self->standby_uri, g_free);
+
+    detach_pipeline (self);
+    if (!attach_pipeline (self, promoted)) {
+        gst_element_set_state (promoted, GST_STATE_NULL);
+        gst_object_unref (promoted);
+        return;
+    }
+    if (self->target_state >= GST_STATE_PAUSED)
+        self->is_live = (gst_element_set_state (self->pipeline, self->target_state) == GST_STATE_CHANGE_NO_PREROLL);
+}
+
+/* Whether the standby pipeline holds a session to the backup server */
+static gboolean standby_is_backup (GStreamerBackend *self)
+{
+    gchar *char_uri;
+    gboolean is_backup;
+
+    if (!self->standby_uri || !self->backup_uri)
+        return FALSE;
+    char_uri = playback_uri (self, self->backup_uri);
+    is_backup = g_strcmp0 (self->standby_uri, char_uri) == 0;
+    g_free (char_uri);
+    return is_backup;
+}
+
+/* Connect the standby pipeline to the backup server, once there is a stream to back up,
+ * unless it is already connected or the backup is what plays. A rendition being prerolled
+ * keeps the standby pipeline, the backup comes back after the switch. */
+static void preroll_backup (GStreamerBackend *self)
+{
+    if (!self->backup_uri || !self->live_uri || g_strcmp0 (self->backup_uri, self->live_uri) == 0 || self->pending_level >= 0)
+        return;
+    if (standby_is_backup (self) && !g_atomic_int_get (&self->standby_failed))
+        return;
+    [self prerollUri:[NSString stringWithUTF8String:self->backup_uri]];
+}
+
+/* Open the current URI again. The pipeline and its sink are kept, only the source (and, in
+ * the hardware pipeline, the decoding chain) are rebuilt. */
+static void restart_source (GStreamerBackend *self)
+{
+    gchar *char_uri = playback_uri (self, self->live_uri);
+
+    reset_stats (self);
+    if (self->decode_mode == GStreamerDecodeModeHardware) {
+        clear_hardware_sources (self);
+        self->source = make_source (self, self->pipeline, char_uri, "source", G_CALLBACK (source_pad_added_cb), (__bridge void *)self);
+    } else {
+        gst_element_set_state (self->pipeline, GST_STATE_READY);
+    }
+    if (self->target_state >= GST_STATE_PAUSED)
+        self->is_live = (gst_element_set_state (self->pipeline, self->target_state) == GST_STATE_CHANGE_NO_PREROLL);
+    g_free (char_uri);
+}
+
+/* Reconnect timer. Fails over to the backup server when its session is up, the server that
+ * failed becomes the backup. Otherwise the same URI is opened again. */
+static gboolean reconnect_cb (GStreamerBackend *self)
+{
+    g_clear_pointer (&self->reconnect_source, g_source_unref);
+    self->reconnects++;
+
+    if (standby_is_backup (self) && !g_atomic_int_get (&self->standby_failed)) {
+        gchar *backup = self->backup_uri;
+
+        GST_DEBUG ("Failing over from %s to %s", self->live_uri, backup);
+        self->backup_uri = g_strdup (self->live_uri);
+        switch_uri (self, backup);
+        g_free (backup);
+        return G_SOURCE_REMOVE;
+    }
+
+    GST_DEBUG ("Reconnecting to %s, attempt %u", self->live_uri, self->reconnect_attempt);
+    restart_source (self);
+    preroll_backup (self);
+    return G_SOURCE_REMOVE;
+}
+
+/* Called when the stream failed with a network error or a live stream ended. Stops the
+ * pipeline and schedules a reconnect, with exponential backoff. Returns FALSE when the
+ * failure should be reported instead: reconnecting is disabled, the attempts ran out, or
+ * the stream is not one that can be opened again (composite, WebRTC, DVR replay). */
+static gboolean schedule_reconnect (GStreamerBackend *self)
+{
+    GstClockTime delay;
+    gchar *message;
+
+    /* Several elements report the same failure */
+    if (self->reconnect_source)
+        return TRUE;
+    if (self->reconnect_attempt >= self->reconnect_max_attempts || !self->live_uri || self->mixer
+        || self->webrtc_signalling || self->dvr_replaying || self->target_state < GST_STATE_PAUSED)
+        return FALSE;
+
+    if (!g_atomic_int_get (&self->outage_open)) {
+        self->outage_start = g_get_monotonic_time ();
+        g_atomic_int_set (&self->outage_open, TRUE);
+    }
+
+    /* A warm backup session is failed over to right away */
+    if (standby_is_backup (self) && !g_atomic_int_get (&self->standby_failed))
+        delay = 0;
+    else
+        delay = MIN (RECONNECT_INITIAL_DELAY << MIN (self->reconnect_attempt, 16), RECONNECT_MAX_DELAY);
+    self->reconnect_attempt++;
+
+    message = g_strdup_printf ("Connection lost, reconnecting in %" G_GUINT64_FORMAT " ms (attempt %u of %u)",
+                               delay / GST_MSECOND, self->reconnect_attempt, self->reconnect_max_attempts);
+    [self setUIMessage:message];
+    g_free (message);
+
+    gst_element_set_state (self->pipeline, GST_STATE_READY);
+    self->reconnect_source = g_timeout_source_new (delay / GST_MSECOND);
+    g_source_set_callback (self->reconnect_source, (GSourceFunc) reconnect_cb, (__bridge void *)self, NULL);
+    g_source_attach (self->reconnect_source, self->context);
+    return TRUE;
+}
+
+/* Drop the pending reconnect and start counting attempts and outages afresh, for a new stream */
+static void cancel_reconnect (GStreamerBackend *self)
+{
+    if (self->reconnect_source) {
+        g_source_destroy (self->reconnect_source);
+        g_clear_pointer (&self->reconnect_source, g_source_unref);
+    }
+    self->reconnect_attempt = 0;
+    self->reconnects = 0;
+    g_atomic_int_set (&self->outage_open, FALSE);
+    g_atomic_int_set (&self->last_outage_ms, 0);
+}
+
+/* Apply a new network path. The transport, SRT latency and start bitrate are picked as sources
+ * and demuxers are created, the running session is retuned in place: the jitterbuffers get
+ * their new latency and the demuxers their bitrate cap. After a handover to another interface
+ * the live source is opened again, with the transport for the new link, as the session would
+ * be lost with the old interface anyway. The pipeline and its sink are kept. */
+static void retune_network (GStreamerBackend *self, NetworkClass network, nw_interface_type_t interface)
+{
+    gboolean handover = self->network != NETWORK_UNKNOWN && network != NETWORK_UNKNOWN
+                        && interface != self->network_interface;
+    GstIterator *iterator;
+    GValue item = G_VALUE_INIT;
+    guint latency;
+    gchar *message;
+
+    if (network == self->network && !handover)
+        return;
+    self->network = network;
+    self->network_interface = interface;
+    if (network_name (network))
+        message = g_strdup_printf ("Tuning for a %s network", network_name (network));
+    else
+        message = g_strdup ("Back to the default network tuning");
+    [self setUIMessage:message];
+    g_free (message);
+    if (!self->pipeline)
+        return;
+
+    latency = jitterbuffer_latency_ms (self);
+    if (self->budget_jitterbuffer_ms > 0)
+        latency = MIN (latency, self->budget_jitterbuffer_ms);
+    if (latency > 0) {
+        g_mutex_lock (&self->stats_lock);
+        for (guint i = 0; i < self->jitterbuffers->len; i++)
+            g_object_set (g_ptr_array_index (self->jitterbuffers, i), "latency", latency, NULL);
+        g_mutex_unlock (&self->stats_lock);
+    }
+
+    iterator = gst_bin_iterate_recurse (GST_BIN (self->pipeline));
+    while (gst_iterator_next (iterator, &item) == GST_ITERATOR_OK) {
+        GstElement *element = g_value_get_object (&item);
+
+        if (is_adaptive_demuxer (element))
+            configure_demuxer_max_bitrate (self, element);
+        g_value_reset (&item);
+    }
+    g_value_unset (&item);
+    gst_iterator_free (iterator);
+
+    /* Files and VOD would start over, a pending reconnect opens the source anyway */
+    if (handover && self->is_live && self->live_uri && !self->mixer && !self->webrtc_signalling
+        && !self->dvr_replaying && !self->reconnect_source && self->target_state >= GST_STATE_PAUSED) {
+        GST_DEBUG ("Network handover, reopening %s", self->live_uri);
+        restart_source (self);
+    }
+}
+
+/* Build the first pipeline and start the UI timer. Runs on the thread of our context. */
+-(BOOL) start_pipeline
+{
+    GstElement *new_pipeline;
+
+    GST_DEBUG_CATEGORY_INIT (debug_category, "gstreamer_swift", 0, "GStreamer Swift");
+    gst_debug_set_threshold_for_name("gstreamer_swift", GST_LEVEL_NONE); // Try GST_LEVEL_DEBUG
+
+    GST_DEBUG ("Creating pipeline");
+
+    /* Build pipeline */
+    new_pipeline = create_pipeline(self);
+    if (!new_pipeline)
+        return NO;
+    if (!attach_pipeline(self, new_pipeline)) {
+        gst_element_set_state (new_pipeline, GST_STATE_NULL);
+        gst_object_unref (new_pipeline);
+        return NO;
+    }
+
     /* Register a function that GLib will call 4 times per second */
     timeout_source = g_timeout_source_new (250);
+    g_source_set_callback (timeout_source, (GSourceFunc)refresh_ui, (__bridge void *)self, NULL);
     g_source_attach (timeout_source, context);
-    g_source_unref (timeout_source);
+
+    /* Run what the UI asked for before the pipeline existed */
+    open_commands(self);
+    return YES;
+}
+
+/* Release the pipelines and the UI timer. Runs on the thread of our context. */
+-(void) stop_pipeline
+{
+    if (timeout_source) {
+        g_source_destroy (timeout_source);
+        g_source_unref (timeout_source);
+        timeout_source = NULL;
+    }
+    if (seek_source) {
+        g_source_destroy (seek_source);
+        g_clear_pointer (&seek_source, g_source_unref);
+    }
+    cancel_reconnect(self);
+    stop_network_monitor(self);
+    discard_standby(self);
+    detach_pipeline(self);
+    set_webrtc_signalling(self, nil);
+    g_mutex_lock (&tap_lock);
+    frame_handler = nil;
+    metal_view = nil;
+    g_mutex_unlock (&tap_lock);
+}
+
+/* Counterparts of app_function for backends living on a GStreamerBackendManager context */
+static gboolean shared_start_cb (GStreamerBackend *self)
+{
+    if ([self start_pipeline]) {
+        [self check_initialization_complete];
+        return G_SOURCE_REMOVE;
+    }
+
+    /* deinit would now be dropped by the closed queue, release the backend right away so
+     * the manager does not keep it forever */
+    close_commands(self);
+    shared_stop_cb(self);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean shared_stop_cb (GStreamerBackend *self)
+{
+    dispatch_block_t teardown = self->teardown_block;
+
+    [self stop_pipeline];
+    self->ui_delegate = NULL;
+    self->ui_video_view = NULL;
+    self->teardown_block = nil;
+
+    /* The manager drops its reference here, this may release self */
+    if (teardown)
+        teardown ();
+    return G_SOURCE_REMOVE;
+}
+
+/* Main method for the bus monitoring code */
+-(void) app_function
+{
+    /* GStreamer may still be initializing in the background */
+    gst_ios_wait_for_init ();
+
+    /* Create our own GLib Main Context and make it the default one */
+    context = g_main_context_new ();
+    g_main_context_push_thread_default(context);
+
+    if (![self start_pipeline]) {
+        close_commands(self);
+        g_main_context_pop_thread_default(context);
+        return;
+    }
 
     /* Create a GLib Main Loop and set it to run */
     GST_DEBUG ("Entering main loop...");
@@ -275,11 +4569,8 @@ static void state_changed_cb (GstBus *bus, GstMessage *msg, GStreamerBackend *se
     main_loop = NULL;
 
     /* Free resources */
+    [self stop_pipeline];
     g_main_context_pop_thread_default(context);
-    g_main_context_unref (context);
-    gst_element_set_state (pipeline, GST_STATE_NULL);
-    gst_object_unref (pipeline);
-    pipeline = NULL;
 
     return;
 }
@@ -1,5 +1,23 @@
 #import <Foundation/Foundation.h>
+#import "GStreamerStats.h"
 
+/* State of the pipeline, as reported by gstreamerStateChanged: */
+typedef NS_ENUM(NSInteger, GStreamerPlaybackState) {
+    GStreamerPlaybackStateNull,
+    GStreamerPlaybackStateReady,
+    GStreamerPlaybackStatePaused,
+    GStreamerPlaybackStatePlaying
+};
+
+/* userInfo key of gstreamerFailed: errors holding the name of the element
+ * that failed. The error domain is the GStreamer error domain (e.g.
+ * "gst-resource-error-quark") and the code the GstResourceError,
+ * GstStreamError, ... code. */
+extern NSString * const GStreamerErrorSourceKey;
+
+/* Except for gstreamerInitialized, all methods are called on the main queue.
+ * Events are coalesced until delivered: a method may be called once for
+ * several changes, with the latest value. */
 @protocol GStreamerBackendDelegate <NSObject>
 
 @optional
@@ -7,11 +25,33 @@
  * and is ready to accept orders. */
 -(void) gstreamerInitialized;
 
-/* Called when the GStreamer backend wants to output some message
- * to the screen. */
+/* Called when the GStreamer backend wants to output some diagnostic
+ * message to the screen. */
 -(void) gstreamerSetUIMessage:(NSString *)message;
 
+/* Called when the pipeline reached a new state */
+-(void) gstreamerStateChanged:(GStreamerPlaybackState)state;
+
+/* Called while a non-live stream buffers, 100 once it may play again */
+-(void) gstreamerBufferingChanged:(NSInteger)percent;
+
+/* Called when the pipeline stopped on an error. Only the first error is
+ * reported when several arrive before delivery. */
+-(void) gstreamerFailed:(NSError *)error;
+
 /* Called when the media size is first discovered or it changes */
 -(void) mediaSizeChanged:(NSInteger)width height:(NSInteger)height;
 
+/* Called once per second while the pipeline is running with fresh
+ * playback metrics */
+-(void) gstreamerStatsUpdated:(GStreamerStats *)stats;
+
+/* Called when quality adaptation switched to another rendition of the
+ * setQualityUris: list, 0 being the highest quality */
+-(void) gstreamerQualityChanged:(NSUInteger)level;
+
+/* Called periodically while a clip with a known duration is playing,
+ * both values in milliseconds */
+-(void) setCurrentPosition:(NSInteger)position duration:(NSInteger)duration;
+
 @end
@@ -0,0 +1,20 @@
+#import <Foundation/Foundation.h>
+#import "GStreamerBackend.h"
+
+/* Runs the bus monitoring of any number of GStreamerBackend instances on one
+ * shared GLib main context and thread, instead of a context, main loop and
+ * parked dispatch thread per backend. Each backend keeps its own pipeline,
+ * video view and delegate. */
+@interface GStreamerBackendManager : NSObject
+
+/* The manager used by the application. Its thread lives as long as the app. */
+@property (class, readonly) GStreamerBackendManager *sharedManager;
+
+/* Create a backend on the shared context. Same arguments as the GStreamerBackend
+ * initializers; release it with deinit as usual. */
+-(GStreamerBackend *) backendWithDelegate:(id) uiDelegate videoView:(UIView*) video_view latencyProfile:(GStreamerLatencyProfile) profile decodeMode:(GStreamerDecodeMode) decode_mode;
+
+/* Number of backends currently running on the shared context */
+@property (readonly) NSUInteger backendCount;
+
+@end
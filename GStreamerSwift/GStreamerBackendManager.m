@@ -0,0 +1,95 @@
+#import "GStreamerBackendManager.h"
+#import "GStreamerBackendPrivate.h"
+#import "gst_ios_init.h"
+
+@interface GStreamerBackendManager()
+-(void)run_loop;
+-(void)remove_backend:(GStreamerBackend *) backend;
+@end
+
+@implementation GStreamerBackendManager {
+    GMainContext *context;       /* GLib context shared by all backends */
+    GMainLoop *main_loop;        /* GLib main loop iterating the context */
+    NSThread *thread;            /* Thread running the main loop */
+    NSMutableSet *backends;      /* Keeps the backends alive until they are torn down */
+}
+
++(GStreamerBackendManager *) sharedManager
+{
+    static GStreamerBackendManager *manager;
+    static dispatch_once_t once;
+
+    dispatch_once(&once, ^{
+        manager = [[GStreamerBackendManager alloc] init];
+    });
+    return manager;
+}
+
+-(id) init
+{
+    if (self = [super init])
+    {
+        context = g_main_context_new ();
+        main_loop = g_main_loop_new (context, FALSE);
+        backends = [[NSMutableSet alloc] init];
+
+        thread = [[NSThread alloc] initWithTarget:self selector:@selector(run_loop) object:nil];
+        thread.name = @"GStreamerBackendManager";
+        /* Only control and UI work runs here, the media flows through the streaming threads */
+        thread.qualityOfService = NSQualityOfServiceUtility;
+        [thread start];
+    }
+
+    return self;
+}
+
+-(GStreamerBackend *) backendWithDelegate:(id) uiDelegate videoView:(UIView *) video_view latencyProfile:(GStreamerLatencyProfile) profile decodeMode:(GStreamerDecodeMode) decode_mode
+{
+    __weak GStreamerBackendManager *weak_self = self;
+    __block __weak GStreamerBackend *weak_backend = nil;
+    GStreamerBackend *backend;
+
+    backend = [[GStreamerBackend alloc] init:uiDelegate videoView:video_view latencyProfile:profile decodeMode:decode_mode
+                               sharedContext:context teardown:^{
+        [weak_self remove_backend:weak_backend];
+    }];
+    weak_backend = backend;
+
+    @synchronized (backends) {
+        [backends addObject:backend];
+    }
+    return backend;
+}
+
+-(NSUInteger) backendCount
+{
+    @synchronized (backends) {
+        return backends.count;
+    }
+}
+
+/*
+ * Private methods
+ */
+
+-(void) remove_backend:(GStreamerBackend *) backend
+{
+    if (!backend)
+        return;
+    @synchronized (backends) {
+        [backends removeObject:backend];
+    }
+}
+
+/* Body of the shared thread. Backends created before GStreamer finished initializing
+ * have their setup queued on the context, so only start iterating it afterwards. */
+-(void) run_loop
+{
+    gst_ios_wait_for_init ();
+
+    g_main_context_push_thread_default (context);
+    g_main_loop_run (main_loop);
+    g_main_context_pop_thread_default (context);
+}
+
+@end
@@ -0,0 +1,13 @@
+#import "GStreamerBackend.h"
+
+#include <gst/gst.h>
+
+/* Interface used by GStreamerBackendManager, not meant for the UI code */
+@interface GStreamerBackend (SharedContext)
+
+/* Initialization method for a backend whose bus monitoring runs on a context owned
+ * and iterated by somebody else, instead of its own context and thread. The
+ * teardown block is called on that context once deinit has released the pipeline. */
+-(id) init:(id) uiDelegate videoView:(UIView*) video_view latencyProfile:(GStreamerLatencyProfile) profile decodeMode:(GStreamerDecodeMode) decode_mode sharedContext:(GMainContext *) shared_context teardown:(dispatch_block_t) teardown;
+
+@end
@@ -0,0 +1,36 @@
+#import <Foundation/Foundation.h>
+#import <UIKit/UIKit.h>
+
+/* Latency and throughput benchmark of GStreamerBackend, run on the device
+ * itself so regressions show up before a build ships. Launch the app with
+ * -GStreamerBenchmark YES to run it instead of the app.
+ *
+ * The suite plays reproducible sources, each for the same time:
+ * - An SRT loopback: a videotestsrc encoded by VideoToolbox and served by an
+ *   srtsink listener in the app itself, played in the hardware decode mode
+ *   with each latency profile at 640x360, 1280x720 and 1920x1080. Each frame
+ *   carries its index as luma blocks in its top left corner, read back from
+ *   the decoded frame, so the source-to-frame latency of every frame is
+ *   measured against the time it was produced.
+ * - Recorded fixtures: every file in Documents/BenchmarkFixtures, played
+ *   with playbin. There is no latency to measure in a file.
+ *
+ * Each run measures the time to first frame, sustained fps, dropped frames,
+ * CPU use and peak memory footprint. The results are JSON objects, one per
+ * run, logged with a GSTBENCH prefix and written as JSON lines to
+ * Documents/GStreamerBenchmark. CPU is that of the whole process, which for
+ * the loopback includes encoding the source. */
+@interface GStreamerBenchmark : NSObject
+
+/* The frames are rendered into video_view, which should be on screen */
+-(instancetype) initWithVideoView:(UIView *)video_view;
+
+/* Measurement time of each run, after the first frame and a short warmup.
+ * 10 s by default, or -GStreamerBenchmarkDuration seconds. */
+@property (nonatomic) NSTimeInterval runDuration;
+
+/* Run the suite. completion is called on the main queue with the result of
+ * every run, once the last one is done. */
+-(void) runWithCompletion:(void (^)(NSArray<NSDictionary *> *results))completion;
+
+@end
@@ -0,0 +1,563 @@
+#import "GStreamerBenchmark.h"
+#import "GStreamerBackendManager.h"
+#import "gst_ios_init.h"
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <os/lock.h>
+#include <sys/resource.h>
+#include <sys/utsname.h>
+
+#define DEFAULT_RUN_DURATION 10
+
+/* Time between the first frame and the start of the measurement, so the start of the
+ * stream is left out */
+#define WARMUP_DURATION 2
+
+/* A run fails when no frame is shown within this time */
+#define FIRST_FRAME_TIMEOUT 20
+
+/* Pause between runs, for the previous pipelines to go */
+#define RUN_INTERVAL 1
+
+/* SRT loopback: port of the srtsink listener, SRT latency on both ends, source frame rate and
+ * keyframe interval in frames. The receiver joins a running stream, so the keyframe interval
+ * is part of the time to first frame. */
+#define LOOPBACK_PORT 17000
+#define LOOPBACK_SRT_LATENCY_MS 20
+#define LOOPBACK_FRAMERATE 30
+#define LOOPBACK_KEYFRAME_INTERVAL 15
+
+/* Frame index marker: MARKER_SYMBOLS blocks along the top of the frame, each holding a hex
+ * digit of the index as a luma level. The levels are MARKER_STEP apart, which survives
+ * compression. */
+#define MARKER_SYMBOLS 4
+#define MARKER_BLOCK 32
+#define MARKER_STEP 14
+#define MARKER_INDICES (1 << (4 * MARKER_SYMBOLS))
+
+/* Readings further from the production time than this come from a misread marker */
+#define MAX_LATENCY_US (10 * G_USEC_PER_SEC)
+
+/* One run of the suite */
+@interface GStreamerBenchmarkScenario : NSObject
+@property (nonatomic, copy) NSString *name;
+@property (nonatomic, copy) NSString *uri;
+@property (nonatomic) GStreamerLatencyProfile profile;
+@property (nonatomic) GStreamerDecodeMode decodeMode;
+@property (nonatomic) NSInteger width;   /* Size of the loopback source, 0 for a fixture */
+@property (nonatomic) NSInteger height;
+@end
+
+@implementation GStreamerBenchmarkScenario
+@end
+
+@interface GStreamerBenchmark() <GStreamerBackendDelegate>
+-(BOOL)start_loopback:(NSString **) error_message;
+-(void)stop_loopback;
+-(void)run_next;
+-(void)start_playback;
+-(void)first_frame:(gint64) time run:(NSUInteger) run;
+-(void)begin_measure:(NSUInteger) run;
+-(void)end_measure:(NSUInteger) run;
+-(void)finish_run;
+-(void)frame_rendered:(CVPixelBufferRef) pixel_buffer marked:(BOOL) marked run:(NSUInteger) run;
+@end
+
+static const char *profile_name (GStreamerLatencyProfile profile)
+{
+    switch (profile) {
+        case GStreamerLatencyProfileLow: return "low";
+        case GStreamerLatencyProfileUltraLow: return "ultra-low";
+        default: return "default";
+    }
+}
+
+/* Write the index marker into a raw I420 frame of the loopback source */
+static void write_marker (GstVideoFrame *frame, guint index)
+{
+    guint8 *luma = GST_VIDEO_FRAME_PLANE_DATA (frame, 0);
+    gint stride = GST_VIDEO_FRAME_PLANE_STRIDE (frame, 0);
+
+    for (int i = 0; i < MARKER_SYMBOLS; i++) {
+        guint8 level = 16 + MARKER_STEP / 2 + ((index >> (4 * i)) & 0xf) * MARKER_STEP;
+
+        for (int y = 0; y < MARKER_BLOCK; y++)
+            memset (luma + y * stride + i * MARKER_BLOCK, level, MARKER_BLOCK);
+    }
+
+    /* Neutral chroma, so the blocks read the same whatever the colour conversion */
+    for (int plane = 1; plane < 3; plane++) {
+        guint8 *chroma = GST_VIDEO_FRAME_PLANE_DATA (frame, plane);
+        gint chroma_stride = GST_VIDEO_FRAME_PLANE_STRIDE (frame, plane);
+
+        for (int y = 0; y < MARKER_BLOCK / 2; y++)
+            memset (chroma + y * chroma_stride, 128, MARKER_SYMBOLS * MARKER_BLOCK / 2);
+    }
+}
+
+/* Read the index marker back from a decoded frame, -1 if the frame cannot be read */
+static gint read_marker (CVPixelBufferRef pixel_buffer)
+{
+    OSType format = CVPixelBufferGetPixelFormatType (pixel_buffer);
+    gboolean bgra = format == kCVPixelFormatType_32BGRA;
+    /* Full range luma and BGRA green go from 0 to 255 instead of 16 to 235 */
+    gboolean full_range = bgra || format == kCVPixelFormatType_420YpCbCr8BiPlanarFullRange;
+    gboolean planar = CVPixelBufferIsPlanar (pixel_buffer);
+    const guint8 *base;
+    size_t stride, width, height;
+    gint index = 0;
+
+    if (!bgra && !planar)
+        return -1;
+    if (CVPixelBufferLockBaseAddress (pixel_buffer, kCVPixelBufferLock_ReadOnly) != kCVReturnSuccess)
+        return -1;
+
+    base = planar ? CVPixelBufferGetBaseAddressOfPlane (pixel_buffer, 0) : CVPixelBufferGetBaseAddress (pixel_buffer);
+    stride = planar ? CVPixelBufferGetBytesPerRowOfPlane (pixel_buffer, 0) : CVPixelBufferGetBytesPerRow (pixel_buffer);
+    width = planar ? CVPixelBufferGetWidthOfPlane (pixel_buffer, 0) : CVPixelBufferGetWidth (pixel_buffer);
+    height = planar ? CVPixelBufferGetHeightOfPlane (pixel_buffer, 0) : CVPixelBufferGetHeight (pixel_buffer);
+    if (!base || width < MARKER_SYMBOLS * MARKER_BLOCK || height < MARKER_BLOCK) {
+        CVPixelBufferUnlockBaseAddress (pixel_buffer, kCVPixelBufferLock_ReadOnly);
+        return -1;
+    }
+
+    /* Average the middle of each block, its edges bleed into the neighbours */
+    for (int i = 0; i < MARKER_SYMBOLS; i++) {
+        guint sum = 0;
+        gint level, symbol;
+
+        for (int y = MARKER_BLOCK / 2 - 4; y < MARKER_BLOCK / 2 + 4; y++) {
+            for (int x = i * MARKER_BLOCK + MARKER_BLOCK / 2 - 4; x < i * MARKER_BLOCK + MARKER_BLOCK / 2 + 4; x++)
+                sum += bgra ? base[y * stride + x * 4 + 1] : base[y * stride + x];
+        }
+        level = sum / 64;
+        if (full_range)
+            level = 16 + level * 219 / 255;
+        symbol = CLAMP ((level - 16) / MARKER_STEP, 0, 15);
+        index |= symbol << (4 * i);
+    }
+
+    CVPixelBufferUnlockBaseAddress (pixel_buffer, kCVPixelBufferLock_ReadOnly);
+    return index;
+}
+
+static NSString *device_model (void)
+{
+    struct utsname name;
+
+    uname (&name);
+    return [NSString stringWithUTF8String:name.machine];
+}
+
+static double cpu_seconds (const struct rusage *usage)
+{
+    return usage->ru_utime.tv_sec + usage->ru_utime.tv_usec / 1e6 + usage->ru_stime.tv_sec + usage->ru_stime.tv_usec / 1e6;
+}
+
+@implementation GStreamerBenchmark {
+    UIView *video_view;
+    NSMutableArray<GStreamerBenchmarkScenario *> *scenarios;
+    NSMutableArray<NSDictionary *> *results;
+    void (^completion)(NSArray<NSDictionary *> *results);
+    NSFileHandle *output;        /* JSON lines file */
+
+    /* The current run. Only touched on the main queue, unless noted. */
+    GStreamerBenchmarkScenario *scenario;
+    GStreamerBackend *backend;
+    GstElement *sender;          /* Loopback source pipeline */
+    NSUInteger run_id;           /* Tells the timers of an earlier run apart */
+    gint64 start_time;           /* When the URI was set, monotonic us */
+    gint64 first_frame_time;     /* 0 until the first frame */
+    gint first_frame_seen;       /* Set by the frame handler (atomic) */
+    gint measuring;              /* Frames are counted and timed (atomic) */
+    gint64 measure_start;
+    gint64 measure_end;
+    struct rusage usage_start;
+    struct rusage usage_end;
+    GStreamerStats *stats_start; /* Stats at the start of the measurement */
+    GStreamerStats *last_stats;
+    uint64_t memory_peak;
+    NSString *failure;           /* Why the run failed, nil if it did not */
+
+    /* Filled from streaming threads */
+    gint64 *send_times;          /* Production time of each marker index, monotonic us */
+    guint frames_sent;           /* Loopback frames produced */
+    os_unfair_lock lock;         /* Protects send_times, latencies and frames */
+    NSMutableArray<NSNumber *> *latencies; /* Source-to-frame latency of the measured frames, in ms */
+    NSUInteger frames;           /* Frames shown while measuring */
+}
+
+-(instancetype) initWithVideoView:(UIView *)view
+{
+    if (self = [super init])
+    {
+        NSInteger duration = [[NSUserDefaults standardUserDefaults] integerForKey:@"GStreamerBenchmarkDuration"];
+
+        video_view = view;
+        _runDuration = duration > 0 ? duration : DEFAULT_RUN_DURATION;
+        results = [[NSMutableArray alloc] init];
+        latencies = [[NSMutableArray alloc] init];
+        lock = OS_UNFAIR_LOCK_INIT;
+        send_times = g_new0 (gint64, MARKER_INDICES);
+    }
+
+    return self;
+}
+
+-(void) dealloc
+{
+    g_free (send_times);
+}
+
+-(void) runWithCompletion:(void (^)(NSArray<NSDictionary *> *results))handler
+{
+    NSString *documents = [NSHomeDirectory() stringByAppendingPathComponent:@"Documents"];
+    NSString *fixtures = [documents stringByAppendingPathComponent:@"BenchmarkFixtures"];
+    NSString *directory = [documents stringByAppendingPathComponent:@"GStreamerBenchmark"];
+    NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
+    NSString *path;
+
+    completion = [handler copy];
+    scenarios = [[NSMutableArray alloc] init];
+
+    for (NSValue *size in @[ [NSValue valueWithCGSize:CGSizeMake (640, 360)], [NSValue valueWithCGSize:CGSizeMake (1280, 720)],
+                             [NSValue valueWithCGSize:CGSizeMake (1920, 1080)] ]) {
+        for (NSNumber *profile in @[ @(GStreamerLatencyProfileDefault), @(GStreamerLatencyProfileLow), @(GStreamerLatencyProfileUltraLow) ]) {
+            GStreamerBenchmarkScenario *loopback = [[GStreamerBenchmarkScenario alloc] init];
+
+            loopback.width = (NSInteger) size.CGSizeValue.width;
+            loopback.height = (NSInteger) size.CGSizeValue.height;
+            loopback.name = [NSString stringWithFormat:@"srt-loopback-%ldx%ld", (long) loopback.width, (long) loopback.height];
+            loopback.uri = [NSString stringWithFormat:@"srt://127.0.0.1:%d?mode=caller", LOOPBACK_PORT];
+            loopback.profile = profile.integerValue;
+            loopback.decodeMode = GStreamerDecodeModeHardware;
+            [scenarios addObject:loopback];
+        }
+    }
+    for (NSString *file in [[[NSFileManager defaultManager] contentsOfDirectoryAtPath:fixtures error:NULL]
+                            sortedArrayUsingSelector:@selector(compare:)]) {
+        GStreamerBenchmarkScenario *fixture = [[GStreamerBenchmarkScenario alloc] init];
+
+        fixture.name = [@"fixture-" stringByAppendingString:file];
+        fixture.uri = [NSURL fileURLWithPath:[fixtures stringByAppendingPathComponent:file]].absoluteString;
+        fixture.profile = GStreamerLatencyProfileDefault;
+        fixture.decodeMode = GStreamerDecodeModeAuto;
+        [scenarios addObject:fixture];
+    }
+
+    formatter.dateFormat = @"yyyyMMdd-HHmmss";
+    formatter.locale = [NSLocale localeWithLocaleIdentifier:@"en_US_POSIX"];
+    path = [directory stringByAppendingPathComponent:[NSString stringWithFormat:@"results-%@.jsonl", [formatter stringFromDate:[NSDate date]]]];
+    [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:NULL];
+    [[NSFileManager defaultManager] createFileAtPath:path contents:nil attributes:nil];
+    output = [NSFileHandle fileHandleForWritingAtPath:path];
+    NSLog (@"GStreamerBenchmark: %lu runs, results in %@", (unsigned long) scenarios.count, path);
+
+    /* The loopback source needs GStreamer before any backend does */
+    gst_ios_init_async (^{
+        [self run_next];
+    });
+}
+
+/*
+ * Private methods
+ */
+
+/* Put the frame index marker on each loopback frame, and note when the frame was produced */
+static GstPadProbeReturn stamp_probe_cb (GstPad *pad, GstPadProbeInfo *info, GStreamerBenchmark *self)
+{
+    GstBuffer *buffer = gst_buffer_make_writable (GST_PAD_PROBE_INFO_BUFFER (info));
+    guint index = self->frames_sent++ % MARKER_INDICES;
+    GstCaps *caps = gst_pad_get_current_caps (pad);
+    GstVideoInfo video_info;
+    GstVideoFrame frame;
+
+    if (caps && gst_video_info_from_caps (&video_info, caps) && gst_video_frame_map (&frame, &video_info, buffer, GST_MAP_WRITE)) {
+        write_marker (&frame, index);
+        gst_video_frame_unmap (&frame);
+    }
+    g_clear_pointer (&caps, gst_caps_unref);
+    os_unfair_lock_lock (&self->lock);
+    self->send_times[index] = g_get_monotonic_time ();
+    os_unfair_lock_unlock (&self->lock);
+    GST_PAD_PROBE_INFO_DATA (info) = buffer;
+    return GST_PAD_PROBE_OK;
+}
+
+/* Serve a marked videotestsrc, encoded by VideoToolbox, from an SRT listener */
+-(BOOL) start_loopback:(NSString **)error_message
+{
+    GstElement *timeoverlay;
+    GError *error = NULL;
+    GstElement *stamp;
+    GstPad *pad;
+    gchar *description;
+
+    /* mpegtsmux and timeoverlay are not among the streaming plugins, and nothing has been
+     * rendered yet to register the others */
+    gst_ios_register_deferred_plugins ();
+    timeoverlay = gst_element_factory_make ("timeoverlay", NULL);
+
+    /* The timestamp overlay is for whoever watches, it goes under the marker */
+    description = g_strdup_printf ("videotestsrc is-live=true pattern=ball ! "
+                                   "video/x-raw,format=I420,width=%ld,height=%ld,framerate=%d/1 ! "
+                                   "%s identity name=stamp ! "
+                                   "vtenc_h264 realtime=true allow-frame-reordering=false max-keyframe-interval=%d ! "
+                                   "h264parse config-interval=-1 ! mpegtsmux alignment=7 ! "
+                                   "srtsink uri=\"srt://:%d?mode=listener\" latency=%d wait-for-connection=false",
+                                   (long) scenario.width, (long) scenario.height, LOOPBACK_FRAMERATE,
+                                   timeoverlay ? "timeoverlay halignment=right valignment=bottom !" : "",
+                                   LOOPBACK_KEYFRAME_INTERVAL, LOOPBACK_PORT, LOOPBACK_SRT_LATENCY_MS);
+    g_clear_pointer (&timeoverlay, gst_object_unref);
+    sender = gst_parse_launch (description, &error);
+    g_free (description);
+    if (!sender || error) {
+        *error_message = [NSString stringWithFormat:@"Unable to create the loopback source: %s", error ? error->message : "unknown error"];
+        g_clear_error (&error);
+        g_clear_object (&sender);
+        return NO;
+    }
+
+    stamp = gst_bin_get_by_name (GST_BIN (sender), "stamp");
+    pad = gst_element_get_static_pad (stamp, "src");
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback) stamp_probe_cb, (__bridge void *)self, NULL);
+    gst_object_unref (pad);
+    gst_object_unref (stamp);
+
+    if (gst_element_set_state (sender, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        *error_message = @"Unable to start the loopback source";
+        gst_element_set_state (sender, GST_STATE_NULL);
+        g_clear_object (&sender);
+        return NO;
+    }
+    return YES;
+}
+
+-(void) stop_loopback
+{
+    if (sender) {
+        gst_element_set_state (sender, GST_STATE_NULL);
+        g_clear_object (&sender);
+    }
+}
+
+-(void) run_next
+{
+    NSString *error_message = nil;
+
+    if (scenarios.count == 0) {
+        [output closeFile];
+        output = nil;
+        NSLog (@"GStreamerBenchmark: done");
+        if (completion)
+            completion (results);
+        completion = nil;
+        return;
+    }
+
+    scenario = scenarios.firstObject;
+    [scenarios removeObjectAtIndex:0];
+    first_frame_time = 0;
+    g_atomic_int_set (&first_frame_seen, 0);
+    g_atomic_int_set (&measuring, 0);
+    measure_start = measure_end = 0;
+    stats_start = last_stats = nil;
+    memory_peak = 0;
+    failure = nil;
+    frames_sent = 0;
+    os_unfair_lock_lock (&lock);
+    memset (send_times, 0, MARKER_INDICES * sizeof (gint64));
+    os_unfair_lock_unlock (&lock);
+    NSLog (@"GStreamerBenchmark: %@, %s profile", scenario.name, profile_name (scenario.profile));
+
+    if (scenario.width && ![self start_loopback:&error_message]) {
+        failure = error_message;
+        [self finish_run];
+        return;
+    }
+    backend = [GStreamerBackendManager.sharedManager backendWithDelegate:self videoView:video_view
+                                                          latencyProfile:scenario.profile decodeMode:scenario.decodeMode];
+}
+
+-(void) start_playback
+{
+    __weak GStreamerBenchmark *weak_self = self;
+    NSUInteger run = run_id;
+    BOOL marked = scenario.width != 0;
+
+    if (scenario.width)
+        [backend setSRTLatency:LOOPBACK_SRT_LATENCY_MS mode:GStreamerSRTModeCaller];
+    /* The streaming thread gets what it needs of the scenario now, the main queue moves on to
+     * the next one */
+    [backend setFrameHandler:^(CVPixelBufferRef pixel_buffer, CMTime presentation_time) {
+        [weak_self frame_rendered:pixel_buffer marked:marked run:run];
+    }];
+
+    start_time = g_get_monotonic_time ();
+    [backend setUri:scenario.uri];
+    [backend play];
+
+    dispatch_after (dispatch_time (DISPATCH_TIME_NOW, FIRST_FRAME_TIMEOUT * NSEC_PER_SEC), dispatch_get_main_queue (), ^{
+        if (run != self->run_id || self->first_frame_time)
+            return;
+        self->failure = [NSString stringWithFormat:@"No frame within %d s", FIRST_FRAME_TIMEOUT];
+        [self finish_run];
+    });
+}
+
+/* Called on a streaming thread, marked and run are those of the scenario it plays */
+-(void) frame_rendered:(CVPixelBufferRef)pixel_buffer marked:(BOOL)marked run:(NSUInteger)run
+{
+    gint64 now = g_get_monotonic_time ();
+    gint index;
+
+    if (g_atomic_int_compare_and_exchange (&first_frame_seen, 0, 1)) {
+        dispatch_async (dispatch_get_main_queue (), ^{
+            [self first_frame:now run:run];
+        });
+    }
+    if (!g_atomic_int_get (&measuring))
+        return;
+
+    index = marked ? read_marker (pixel_buffer) : -1;
+    os_unfair_lock_lock (&lock);
+    frames++;
+    if (index >= 0 && send_times[index] && now >= send_times[index] && now - send_times[index] < MAX_LATENCY_US)
+        [latencies addObject:@((now - send_times[index]) / 1000.0)];
+    os_unfair_lock_unlock (&lock);
+}
+
+-(void) first_frame:(gint64)time run:(NSUInteger)run
+{
+    if (run != run_id)
+        return;
+    first_frame_time = time;
+    dispatch_after (dispatch_time (DISPATCH_TIME_NOW, WARMUP_DURATION * NSEC_PER_SEC), dispatch_get_main_queue (), ^{
+        [self begin_measure:run];
+    });
+}
+
+-(void) begin_measure:(NSUInteger)run
+{
+    if (run != run_id)
+        return;
+
+    os_unfair_lock_lock (&lock);
+    [latencies removeAllObjects];
+    frames = 0;
+    os_unfair_lock_unlock (&lock);
+    stats_start = last_stats;
+    memory_peak = last_stats.memoryFootprintBytes;
+    getrusage (RUSAGE_SELF, &usage_start);
+    measure_start = g_get_monotonic_time ();
+    g_atomic_int_set (&measuring, 1);
+
+    dispatch_after (dispatch_time (DISPATCH_TIME_NOW, (int64_t) (self.runDuration * NSEC_PER_SEC)), dispatch_get_main_queue (), ^{
+        [self end_measure:run];
+    });
+}
+
+-(void) end_measure:(NSUInteger)run
+{
+    if (run != run_id)
+        return;
+
+    g_atomic_int_set (&measuring, 0);
+    measure_end = g_get_monotonic_time ();
+    getrusage (RUSAGE_SELF, &usage_end);
+    [self finish_run];
+}
+
+/* Summary of the latencies of a run, in ms */
+static id latency_summary (NSArray<NSNumber *> *latencies)
+{
+    NSArray<NSNumber *> *sorted = [latencies sortedArrayUsingSelector:@selector(compare:)];
+
+    if (sorted.count == 0)
+        return [NSNull null];
+    return @{ @"samples": @(sorted.count),
+              @"min": sorted.firstObject,
+              @"median": sorted[sorted.count / 2],
+              @"p95": sorted[MIN (sorted.count - 1, sorted.count * 95 / 100)],
+              @"max": sorted.lastObject };
+}
+
+/* Record the result of the current run and go on with the next one */
+-(void) finish_run
+{
+    NSMutableDictionary *result = [NSMutableDictionary dictionary];
+    double duration = measure_end > measure_start ? (measure_end - measure_start) / (double) G_USEC_PER_SEC : 0;
+    NSData *json;
+
+    [backend setFrameHandler:nil];
+    [backend deinit];
+    backend = nil;
+    [self stop_loopback];
+    run_id++;
+
+    result[@"scenario"] = scenario.name;
+    result[@"uri"] = scenario.uri;
+    result[@"profile"] = [NSString stringWithUTF8String:profile_name (scenario.profile)];
+    result[@"decode_mode"] = scenario.decodeMode == GStreamerDecodeModeHardware ? @"hardware" : @"auto";
+    result[@"width"] = scenario.width ? @(scenario.width) : [NSNull null];
+    result[@"height"] = scenario.height ? @(scenario.height) : [NSNull null];
+    result[@"device"] = device_model ();
+    result[@"os"] = [UIDevice currentDevice].systemVersion;
+    result[@"build"] = [[NSBundle mainBundle] objectForInfoDictionaryKey:@"CFBundleVersion"] ?: [NSNull null];
+    result[@"time_to_first_frame_ms"] = first_frame_time ? @((first_frame_time - start_time) / 1000.0) : [NSNull null];
+    result[@"error"] = failure ?: [NSNull null];
+    if (duration > 0) {
+        os_unfair_lock_lock (&lock);
+        result[@"duration_s"] = @(duration);
+        result[@"frames"] = @(frames);
+        result[@"fps"] = @(frames / duration);
+        result[@"latency_ms"] = latency_summary (latencies);
+        os_unfair_lock_unlock (&lock);
+        result[@"frames_dropped"] = @(last_stats.framesDropped - MIN (stats_start.framesDropped, last_stats.framesDropped));
+        result[@"cpu_percent"] = @((cpu_seconds (&usage_end) - cpu_seconds (&usage_start)) / duration * 100);
+        result[@"memory_peak_bytes"] = @(memory_peak);
+    }
+    [results addObject:result];
+
+    json = [NSJSONSerialization dataWithJSONObject:result options:NSJSONWritingSortedKeys error:NULL];
+    if (json) {
+        NSLog (@"GSTBENCH %@", [[NSString alloc] initWithData:json encoding:NSUTF8StringEncoding]);
+        [output writeData:json];
+        [output writeData:[@"\n" dataUsingEncoding:NSUTF8StringEncoding]];
+    }
+
+    dispatch_after (dispatch_time (DISPATCH_TIME_NOW, RUN_INTERVAL * NSEC_PER_SEC), dispatch_get_main_queue (), ^{
+        [self run_next];
+    });
+}
+
+/*
+ * GStreamerBackendDelegate
+ */
+
+-(void) gstreamerInitialized
+{
+    dispatch_async (dispatch_get_main_queue (), ^{
+        if (self->backend)
+            [self start_playback];
+    });
+}
+
+-(void) gstreamerStatsUpdated:(GStreamerStats *)stats
+{
+    if (!backend)
+        return;
+    last_stats = stats;
+    if (g_atomic_int_get (&measuring))
+        memory_peak = MAX (memory_peak, stats.memoryFootprintBytes);
+}
+
+-(void) gstreamerFailed:(NSError *)error
+{
+    if (!backend)
+        return;
+    failure = error.localizedDescription;
+    [self finish_run];
+}
+
+@end
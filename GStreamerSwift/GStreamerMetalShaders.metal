@@ -0,0 +1,60 @@
+#include <metal_stdlib>
+using namespace metal;
+
+/* Must match MetalUniforms in GStreamerMetalView.m */
+struct Uniforms {
+    float3x3 rotation;    /* Head pose, camera to panorama */
+    float2 tan_half_fov;  /* Horizontal and vertical extent of the eye's view */
+    float4 source_rect;   /* Region of the frame holding this eye, in texture coordinates */
+    float3x3 yuv_matrix;  /* YCbCr to RGB of the frame's matrix, with its range scaling folded in */
+    float3 yuv_offset;    /* Black level and chroma midpoint of the frame's range */
+    uint projection;      /* GStreamerProjection */
+    uint format;          /* 0 BGRA, 1 NV12, 2 I420 */
+};
+
+struct VertexOut {
+    float4 position [[position]];
+    float2 uv;
+};
+
+/* One triangle covering the viewport */
+vertex VertexOut gst_video_vertex (uint vid [[vertex_id]])
+{
+    float2 uv = float2 ((vid << 1) & 2, vid & 2);
+    VertexOut out;
+
+    out.position = float4 (uv * float2 (2, -2) + float2 (-1, 1), 0, 1);
+    out.uv = uv;
+    return out;
+}
+
+static float3 yuv_to_rgb (constant Uniforms &u, float y, float2 cbcr)
+{
+    return u.yuv_matrix * (float3 (y, cbcr) - u.yuv_offset);
+}
+
+fragment float4 gst_video_fragment (VertexOut in [[stage_in]],
+                                    constant Uniforms &u [[buffer (0)]],
+                                    texture2d<float> plane0 [[texture (0)]],
+                                    texture2d<float> plane1 [[texture (1)]],
+                                    texture2d<float> plane2 [[texture (2)]])
+{
+    constexpr sampler linear (filter::linear, address::clamp_to_edge);
+    float2 uv = in.uv;
+
+    if (u.projection == 1) {
+        float2 ndc = float2 (uv.x * 2 - 1, 1 - uv.y * 2);
+        float3 direction = normalize (u.rotation * float3 (ndc * u.tan_half_fov, -1));
+        float longitude = atan2 (direction.x, -direction.z);
+        float latitude = asin (clamp (direction.y, -1.0, 1.0));
+
+        uv = fract (float2 (longitude / (2 * M_PI_F) + 0.5, 0.5 - latitude / M_PI_F));
+    }
+    uv = u.source_rect.xy + uv * u.source_rect.zw;
+
+    if (u.format == 1)
+        return float4 (yuv_to_rgb (u, plane0.sample (linear, uv).r, plane1.sample (linear, uv).rg), 1);
+    if (u.format == 2)
+        return float4 (yuv_to_rgb (u, plane0.sample (linear, uv).r, float2 (plane1.sample (linear, uv).r, plane2.sample (linear, uv).r)), 1);
+    return plane0.sample (linear, uv);
+}
@@ -0,0 +1,52 @@
+#import <UIKit/UIKit.h>
+#import <CoreVideo/CoreVideo.h>
+#import <simd/simd.h>
+
+/* How the two eyes are packed into each frame of a stereo stream */
+typedef NS_ENUM(NSInteger, GStreamerStereoLayout) {
+    GStreamerStereoLayoutMono,
+    GStreamerStereoLayoutSideBySide, /* Left eye in the left half */
+    GStreamerStereoLayoutOverUnder   /* Left eye in the top half */
+};
+
+/* How each eye image maps onto the display */
+typedef NS_ENUM(NSInteger, GStreamerProjection) {
+    GStreamerProjectionFlat,
+    GStreamerProjectionEquirectangular /* 360x180 degree panorama, viewed from its centre */
+};
+
+/* Orientation of the viewer's head in the panorama's frame of reference, the
+ * rotation taking view directions (looking down -Z, Y up) to panorama ones.
+ * Queried once per display refresh. */
+typedef simd_quatf (^GStreamerHeadPoseProvider)(void);
+
+/* Video view rendering with Metal into its CAMetalLayer. Pass it as the video
+ * view of a GStreamerBackend to replace glimagesink: decoded frames then reach
+ * the view as CVPixelBuffers from a sink that waits on the pipeline clock,
+ * mapped to Metal textures without copies, and the newest one is drawn at the
+ * next display refresh. YCbCr frames are converted with the matrix attached
+ * to them and the range of their pixel format. The flat projection keeps the
+ * picture's aspect ratio.
+ *
+ * Stereo streams are drawn with each eye in its own half of the view, for
+ * headset viewers. In the equirectangular projection the head pose is sampled
+ * right before the frame is encoded, after the drawable is acquired, so the
+ * view matches where the head is at scan out rather than where it was when
+ * the video frame was decoded. */
+@interface GStreamerMetalView : UIView
+
+@property (nonatomic) GStreamerStereoLayout stereoLayout;
+@property (nonatomic) GStreamerProjection projection;
+
+/* Vertical field of view of each eye in the equirectangular projection, in
+ * radians. 90 degrees by default. */
+@property (nonatomic) float fieldOfView;
+
+/* Latest head pose, nil for a fixed forward view */
+@property (atomic, copy) GStreamerHeadPoseProvider headPoseProvider;
+
+/* Show this frame at the next display refresh, replacing any frame not shown
+ * yet. Can be called from any thread. */
+-(void) displayPixelBuffer:(CVPixelBufferRef)pixel_buffer;
+
+@end
@@ -0,0 +1,316 @@
+#import "GStreamerMetalView.h"
+#import <Metal/Metal.h>
+#import <QuartzCore/QuartzCore.h>
+#import <os/lock.h>
+
+/* Must match Uniforms in GStreamerMetalShaders.metal */
+typedef struct {
+    simd_float3x3 rotation;
+    simd_float2 tan_half_fov;
+    simd_float4 source_rect;
+    simd_float3x3 yuv_matrix;
+    simd_float3 yuv_offset;
+    uint32_t projection;
+    uint32_t format;
+} MetalUniforms;
+
+enum {
+    METAL_FORMAT_BGRA,
+    METAL_FORMAT_NV12,
+    METAL_FORMAT_I420
+};
+
+@interface GStreamerMetalView()
+-(void)setup_metal;
+-(void)render:(CADisplayLink *) link;
+@end
+
+@implementation GStreamerMetalView {
+    id<MTLDevice> device;
+    id<MTLCommandQueue> command_queue;
+    id<MTLRenderPipelineState> pipeline_state;
+    CVMetalTextureCacheRef texture_cache;
+    CADisplayLink *display_link;
+    os_unfair_lock lock;             /* Protects pending_buffer, set from a streaming thread */
+    CVPixelBufferRef pending_buffer; /* Newest frame, not drawn yet */
+    CVPixelBufferRef current_buffer; /* Frame on screen, redrawn when the head moves */
+}
+
++(Class) layerClass
+{
+    return [CAMetalLayer class];
+}
+
+-(id) initWithFrame:(CGRect)frame
+{
+    if (self = [super initWithFrame:frame])
+        [self setup_metal];
+    return self;
+}
+
+-(id) initWithCoder:(NSCoder *)coder
+{
+    if (self = [super initWithCoder:coder])
+        [self setup_metal];
+    return self;
+}
+
+-(void) setup_metal
+{
+    CAMetalLayer *metal_layer = (CAMetalLayer *) self.layer;
+    id<MTLLibrary> library;
+    MTLRenderPipelineDescriptor *descriptor;
+    NSError *error = nil;
+
+    lock = OS_UNFAIR_LOCK_INIT;
+    _fieldOfView = M_PI_2;
+
+    device = MTLCreateSystemDefaultDevice ();
+    command_queue = [device newCommandQueue];
+    metal_layer.device = device;
+    metal_layer.pixelFormat = MTLPixelFormatBGRA8Unorm;
+    metal_layer.framebufferOnly = YES;
+    CVMetalTextureCacheCreate (kCFAllocatorDefault, NULL, device, NULL, &texture_cache);
+
+    library = [device newDefaultLibrary];
+    descriptor = [[MTLRenderPipelineDescriptor alloc] init];
+    descriptor.vertexFunction = [library newFunctionWithName:@"gst_video_vertex"];
+    descriptor.fragmentFunction = [library newFunctionWithName:@"gst_video_fragment"];
+    descriptor.colorAttachments[0].pixelFormat = metal_layer.pixelFormat;
+    pipeline_state = [device newRenderPipelineStateWithDescriptor:descriptor error:&error];
+    if (!pipeline_state)
+        NSLog (@"GStreamerMetalView: unable to create the render pipeline: %@", error);
+}
+
+-(void) dealloc
+{
+    [display_link invalidate];
+    CVPixelBufferRelease (pending_buffer);
+    CVPixelBufferRelease (current_buffer);
+    if (texture_cache)
+        CFRelease (texture_cache);
+}
+
+/* The display link retains its target, so only keep it while we are on screen */
+-(void) didMoveToWindow
+{
+    [super didMoveToWindow];
+    [display_link invalidate];
+    display_link = nil;
+    if (self.window) {
+        display_link = [CADisplayLink displayLinkWithTarget:self selector:@selector(render:)];
+        [display_link addToRunLoop:[NSRunLoop mainRunLoop] forMode:NSRunLoopCommonModes];
+    }
+}
+
+-(void) layoutSubviews
+{
+    CGFloat scale = self.window ? self.window.screen.scale : UIScreen.mainScreen.scale;
+
+    [super layoutSubviews];
+    self.layer.contentsScale = scale;
+    ((CAMetalLayer *) self.layer).drawableSize = CGSizeMake (self.bounds.size.width * scale, self.bounds.size.height * scale);
+}
+
+-(void) displayPixelBuffer:(CVPixelBufferRef)pixel_buffer
+{
+    CVPixelBufferRef previous;
+
+    CVPixelBufferRetain (pixel_buffer);
+    os_unfair_lock_lock (&lock);
+    previous = pending_buffer;
+    pending_buffer = pixel_buffer;
+    os_unfair_lock_unlock (&lock);
+    CVPixelBufferRelease (previous);
+}
+
+/* Map one plane of the frame to a texture. Frames that are not IOSurface backed, such as
+ * software decoded ones, cannot be mapped and are uploaded instead. */
+static id<MTLTexture> plane_texture (id<MTLDevice> device, CVMetalTextureCacheRef cache, CVPixelBufferRef pixel_buffer,
+                                     size_t plane, MTLPixelFormat format, NSMutableArray *keep_alive)
+{
+    BOOL planar = CVPixelBufferIsPlanar (pixel_buffer);
+    size_t width = planar ? CVPixelBufferGetWidthOfPlane (pixel_buffer, plane) : CVPixelBufferGetWidth (pixel_buffer);
+    size_t height = planar ? CVPixelBufferGetHeightOfPlane (pixel_buffer, plane) : CVPixelBufferGetHeight (pixel_buffer);
+    CVMetalTextureRef cv_texture = NULL;
+    MTLTextureDescriptor *descriptor;
+    id<MTLTexture> texture;
+
+    if (CVPixelBufferGetIOSurface (pixel_buffer) &&
+        CVMetalTextureCacheCreateTextureFromImage (kCFAllocatorDefault, cache, pixel_buffer, NULL, format,
+                                                   width, height, plane, &cv_texture) == kCVReturnSuccess) {
+        texture = CVMetalTextureGetTexture (cv_texture);
+        /* The texture is only valid as long as its CVMetalTexture */
+        [keep_alive addObject:(__bridge_transfer id) cv_texture];
+        return texture;
+    }
+
+    descriptor = [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:format width:width height:height mipmapped:NO];
+    texture = [device newTextureWithDescriptor:descriptor];
+    CVPixelBufferLockBaseAddress (pixel_buffer, kCVPixelBufferLock_ReadOnly);
+    [texture replaceRegion:MTLRegionMake2D (0, 0, width, height) mipmapLevel:0
+                 withBytes:planar ? CVPixelBufferGetBaseAddressOfPlane (pixel_buffer, plane) : CVPixelBufferGetBaseAddress (pixel_buffer)
+               bytesPerRow:planar ? CVPixelBufferGetBytesPerRowOfPlane (pixel_buffer, plane) : CVPixelBufferGetBytesPerRow (pixel_buffer)];
+    CVPixelBufferUnlockBaseAddress (pixel_buffer, kCVPixelBufferLock_ReadOnly);
+    return texture;
+}
+
+/* YCbCr to RGB conversion for the matrix and range of a frame. The matrix comes from the
+ * pixel buffer's attachment, BT.709 when it has none; the range from its pixel format. */
+static void yuv_conversion (CVPixelBufferRef pixel_buffer, BOOL full_range, MetalUniforms *uniforms)
+{
+    CFTypeRef matrix = CVBufferGetAttachment (pixel_buffer, kCVImageBufferYCbCrMatrixKey, NULL);
+    float kr = 0.2126f, kb = 0.0722f, kg;
+    float y_scale = full_range ? 1.0f : 255.0f / 219.0f;
+    float c_scale = full_range ? 1.0f : 255.0f / 224.0f;
+
+    if (matrix && CFEqual (matrix, kCVImageBufferYCbCrMatrix_ITU_R_601_4)) {
+        kr = 0.299f;
+        kb = 0.114f;
+    } else if (matrix && CFEqual (matrix, kCVImageBufferYCbCrMatrix_ITU_R_2020)) {
+        kr = 0.2627f;
+        kb = 0.0593f;
+    }
+    kg = 1 - kr - kb;
+
+    uniforms->yuv_matrix = simd_matrix (simd_make_float3 (y_scale, y_scale, y_scale),
+                                        simd_make_float3 (0, -c_scale * 2 * kb * (1 - kb) / kg, c_scale * 2 * (1 - kb)),
+                                        simd_make_float3 (c_scale * 2 * (1 - kr), -c_scale * 2 * kr * (1 - kr) / kg, 0));
+    uniforms->yuv_offset = simd_make_float3 (full_range ? 0 : 16.0f / 255.0f, 128.0f / 255.0f, 128.0f / 255.0f);
+}
+
+/* Largest part of the viewport showing the picture undistorted, centred */
+static MTLViewport aspect_fit (MTLViewport viewport, double aspect)
+{
+    if (aspect <= 0)
+        return viewport;
+    if (viewport.width / viewport.height > aspect) {
+        double width = viewport.height * aspect;
+        viewport.originX += (viewport.width - width) / 2;
+        viewport.width = width;
+    } else {
+        double height = viewport.width / aspect;
+        viewport.originY += (viewport.height - height) / 2;
+        viewport.height = height;
+    }
+    return viewport;
+}
+
+/* Region of the frame holding each eye, in texture coordinates */
+static simd_float4 eye_rect (GStreamerStereoLayout layout, int eye)
+{
+    switch (layout) {
+        case GStreamerStereoLayoutSideBySide:
+            return simd_make_float4 (eye * 0.5f, 0, 0.5f, 1);
+        case GStreamerStereoLayoutOverUnder:
+            return simd_make_float4 (0, eye * 0.5f, 1, 0.5f);
+        default:
+            return simd_make_float4 (0, 0, 1, 1);
+    }
+}
+
+-(void) render:(CADisplayLink *) link
+{
+    CVPixelBufferRef pixel_buffer;
+    NSMutableArray *keep_alive = [NSMutableArray array];
+    id<MTLTexture> planes[3] = { nil, nil, nil };
+    id<CAMetalDrawable> drawable;
+    id<MTLCommandBuffer> command_buffer;
+    id<MTLRenderCommandEncoder> encoder;
+    MTLRenderPassDescriptor *pass;
+    GStreamerHeadPoseProvider pose_provider;
+    MetalUniforms uniforms = { 0 };
+    OSType format;
+    int eyes;
+    CGSize size;
+    MTLViewport viewport;
+    double aspect;
+
+    os_unfair_lock_lock (&lock);
+    pixel_buffer = pending_buffer;
+    pending_buffer = NULL;
+    os_unfair_lock_unlock (&lock);
+
+    if (pixel_buffer) {
+        CVPixelBufferRelease (current_buffer);
+        current_buffer = pixel_buffer;
+    } else if (!current_buffer || _projection != GStreamerProjectionEquirectangular) {
+        /* Nothing new to show, and the picture does not depend on the head pose */
+        return;
+    }
+    if (!pipeline_state)
+        return;
+
+    format = CVPixelBufferGetPixelFormatType (current_buffer);
+    switch (format) {
+        case kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange:
+        case kCVPixelFormatType_420YpCbCr8BiPlanarFullRange:
+            planes[0] = plane_texture (device, texture_cache, current_buffer, 0, MTLPixelFormatR8Unorm, keep_alive);
+            planes[1] = plane_texture (device, texture_cache, current_buffer, 1, MTLPixelFormatRG8Unorm, keep_alive);
+            uniforms.format = METAL_FORMAT_NV12;
+            yuv_conversion (current_buffer, format == kCVPixelFormatType_420YpCbCr8BiPlanarFullRange, &uniforms);
+            break;
+        case kCVPixelFormatType_420YpCbCr8Planar:
+        case kCVPixelFormatType_420YpCbCr8PlanarFullRange:
+            for (size_t i = 0; i < 3; i++)
+                planes[i] = plane_texture (device, texture_cache, current_buffer, i, MTLPixelFormatR8Unorm, keep_alive);
+            uniforms.format = METAL_FORMAT_I420;
+            yuv_conversion (current_buffer, format == kCVPixelFormatType_420YpCbCr8PlanarFullRange, &uniforms);
+            break;
+        case kCVPixelFormatType_32BGRA:
+            planes[0] = plane_texture (device, texture_cache, current_buffer, 0, MTLPixelFormatBGRA8Unorm, keep_alive);
+            uniforms.format = METAL_FORMAT_BGRA;
+            break;
+        default:
+            return;
+    }
+
+    /* Late latching: everything that can block is done, now read where the head is */
+    drawable = [(CAMetalLayer *) self.layer nextDrawable];
+    if (!drawable)
+        return;
+    pose_provider = self.headPoseProvider;
+    uniforms.rotation = simd_matrix3x3 (pose_provider ? pose_provider () : simd_quaternion (0.0f, 0.0f, 0.0f, 1.0f));
+    uniforms.projection = (uint32_t) _projection;
+
+    pass = [MTLRenderPassDescriptor renderPassDescriptor];
+    pass.colorAttachments[0].texture = drawable.texture;
+    pass.colorAttachments[0].loadAction = MTLLoadActionClear;
+    pass.colorAttachments[0].clearColor = MTLClearColorMake (0, 0, 0, 1);
+    pass.colorAttachments[0].storeAction = MTLStoreActionStore;
+
+    command_buffer = [command_queue commandBuffer];
+    encoder = [command_buffer renderCommandEncoderWithDescriptor:pass];
+    [encoder setRenderPipelineState:pipeline_state];
+    for (int i = 0; i < 3; i++)
+        [encoder setFragmentTexture:planes[i] ?: planes[0] atIndex:i];
+
+    /* Stereo streams get one half of the view per eye */
+    eyes = _stereoLayout == GStreamerStereoLayoutMono ? 1 : 2;
+    size = CGSizeMake (drawable.texture.width / (double) eyes, drawable.texture.height);
+    uniforms.tan_half_fov.y = tanf (_fieldOfView / 2);
+    uniforms.tan_half_fov.x = uniforms.tan_half_fov.y * size.width / size.height;
+    for (int eye = 0; eye < eyes; eye++) {
+        uniforms.source_rect = eye_rect (_stereoLayout, eye);
+        viewport = (MTLViewport) { eye * size.width, 0, size.width, size.height, 0, 1 };
+        /* A flat picture keeps its shape, with black bars around it */
+        if (_projection == GStreamerProjectionFlat) {
+            aspect = CVPixelBufferGetWidth (current_buffer) * uniforms.source_rect.z /
+                     (CVPixelBufferGetHeight (current_buffer) * uniforms.source_rect.w);
+            viewport = aspect_fit (viewport, aspect);
+        }
+        [encoder setViewport:viewport];
+        [encoder setFragmentBytes:&uniforms length:sizeof (uniforms) atIndex:0];
+        [encoder drawPrimitives:MTLPrimitiveTypeTriangle vertexStart:0 vertexCount:3];
+    }
+    [encoder endEncoding];
+
+    /* Keep the textures mapped until the GPU is done with them */
+    [command_buffer addCompletedHandler:^(id<MTLCommandBuffer> buffer) {
+        [keep_alive removeAllObjects];
+    }];
+    [command_buffer presentDrawable:drawable];
+    [command_buffer commit];
+}
+
+@end
@@ -0,0 +1,21 @@
+#import <Foundation/Foundation.h>
+
+/* Profiling mode, to see in Instruments where the frame budget goes on a
+ * real device, release builds included. Every buffer handed from one element
+ * to the next becomes an os_signpost interval named after the receiving
+ * element (depayloader, parser, decoder, sink...), on the thread that
+ * processes it. Nested intervals are the downstream elements running in the
+ * same streaming thread. Lateness at the sinks, and the records of the
+ * latency, proctime and queuelevel tracers, are signpost events.
+ *
+ * Record with the os_signpost instrument, subsystem org.gstreamer.swift. */
+@interface GStreamerProfiler : NSObject
+
+/* Start profiling. Call once GStreamer is initialized and before building
+ * the pipelines to look at, gst_ios_init() does it when the app is launched
+ * with -GStreamerProfiling YES. The GStreamer debug log no longer goes to
+ * stderr, so formatting it does not skew the timings. Only the first call
+ * does anything, profiling lasts until the app exits. */
++(void) start;
+
+@end
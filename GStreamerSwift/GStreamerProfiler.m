@@ -0,0 +1,192 @@
+#import "GStreamerProfiler.h"
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+#include <os/signpost.h>
+
+/* Stock tracers whose records become signpost events, with their parameters */
+static const gchar *stock_tracers[][2] = {
+    { "latency", "flags=pipeline+element" },
+    { "proctime", NULL },
+    { "queuelevel", NULL },
+};
+
+static os_log_t signpost_log;
+static GstDebugCategory *tracer_category;
+
+/* Tracer turning pad pushes into signpost intervals */
+typedef struct {
+    GstTracer parent;
+} SignpostTracer;
+
+typedef struct {
+    GstTracerClass parent_class;
+} SignpostTracerClass;
+
+G_DEFINE_TYPE (SignpostTracer, signpost_tracer, GST_TYPE_TRACER)
+
+/* Only pushes between two elements are traced: a push through a ghost pad is part of
+ * the push into the bin, which is already being traced */
+static gboolean is_traced_pad (GstPad *pad)
+{
+    GstObject *parent = GST_OBJECT_PARENT (pad);
+
+    return parent && GST_IS_ELEMENT (parent) && !GST_IS_BIN (parent);
+}
+
+/* The element a push from pad ends up in, looking through the ghost pads of bins */
+static GstElement *get_receiving_element (GstPad *pad)
+{
+    GstPad *peer = GST_PAD_PEER (pad);
+
+    while (peer) {
+        GstObject *parent = GST_OBJECT_PARENT (peer);
+
+        if (GST_IS_GHOST_PAD (peer)) {
+            /* Into a bin: the data goes on from its internal pad */
+            GstProxyPad *internal = gst_proxy_pad_get_internal (GST_PROXY_PAD (peer));
+
+            peer = internal ? GST_PAD_PEER (internal) : NULL;
+            g_clear_object (&internal);
+        } else if (parent && GST_IS_PAD (parent)) {
+            /* Out of a bin: the internal pad of a ghost pad, the data goes on from the ghost pad */
+            peer = GST_PAD_PEER (GST_PAD (parent));
+        } else {
+            return parent && GST_IS_ELEMENT (parent) ? GST_ELEMENT (parent) : NULL;
+        }
+    }
+    return NULL;
+}
+
+/* How late a buffer reaches a sink, against the time it is due to be rendered: negative is
+ * the slack left, positive means it will be dropped or shown late */
+static void emit_lateness (GstElement *sink, GstPad *pad, GstBuffer *buffer)
+{
+    GstClock *clock;
+    GstEvent *event;
+    const GstSegment *segment;
+    GstClockTime running_time, now;
+
+    if (!GST_BUFFER_PTS_IS_VALID (buffer))
+        return;
+    clock = gst_element_get_clock (sink);
+    if (!clock)
+        return;
+    event = gst_pad_get_sticky_event (pad, GST_EVENT_SEGMENT, 0);
+    if (event) {
+        gst_event_parse_segment (event, &segment);
+        running_time = gst_segment_to_running_time (segment, GST_FORMAT_TIME, GST_BUFFER_PTS (buffer));
+        now = gst_clock_get_time (clock) - gst_element_get_base_time (sink);
+        if (GST_CLOCK_TIME_IS_VALID (running_time)) {
+            os_signpost_event_emit (signpost_log, OS_SIGNPOST_ID_EXCLUSIVE, "Lateness", "%{public}s %lld us",
+                                    GST_OBJECT_NAME (sink),
+                                    (long long) GST_CLOCK_DIFF (running_time + gst_base_sink_get_latency (GST_BASE_SINK (sink)), now) / 1000);
+        }
+        gst_event_unref (event);
+    }
+    gst_object_unref (clock);
+}
+
+static void push_pre_cb (GObject *tracer, GstClockTime ts, GstPad *pad, GstBuffer *buffer)
+{
+    GstElement *element;
+
+    if (!is_traced_pad (pad))
+        return;
+    element = get_receiving_element (pad);
+    os_signpost_interval_begin (signpost_log, os_signpost_id_make_with_pointer (signpost_log, pad), "Chain",
+                                "%{public}s", element ? GST_OBJECT_NAME (element) : "unlinked");
+    if (buffer && element && GST_IS_BASE_SINK (element))
+        emit_lateness (element, pad, buffer);
+}
+
+static void push_list_pre_cb (GObject *tracer, GstClockTime ts, GstPad *pad, GstBufferList *list)
+{
+    push_pre_cb (tracer, ts, pad, NULL);
+}
+
+static void push_post_cb (GObject *tracer, GstClockTime ts, GstPad *pad, GstFlowReturn result)
+{
+    if (!is_traced_pad (pad))
+        return;
+    os_signpost_interval_end (signpost_log, os_signpost_id_make_with_pointer (signpost_log, pad), "Chain",
+                              "%{public}s", gst_flow_get_name (result));
+}
+
+static void signpost_tracer_class_init (SignpostTracerClass *klass)
+{
+}
+
+static void signpost_tracer_init (SignpostTracer *self)
+{
+    GstTracer *tracer = GST_TRACER (self);
+
+    gst_tracing_register_hook (tracer, "pad-push-pre", G_CALLBACK (push_pre_cb));
+    gst_tracing_register_hook (tracer, "pad-push-post", G_CALLBACK (push_post_cb));
+    gst_tracing_register_hook (tracer, "pad-push-list-pre", G_CALLBACK (push_list_pre_cb));
+    gst_tracing_register_hook (tracer, "pad-push-list-post", G_CALLBACK (push_post_cb));
+}
+
+/* The stock tracers log their records in the GST_TRACER category. os_signpost wants a
+ * literal name, so the common records get their own and the others share one. */
+static void tracer_log_cb (GstDebugCategory *category, GstDebugLevel level, const gchar *file, const gchar *function,
+                           gint line, GObject *object, GstDebugMessage *message, gpointer user_data)
+{
+    const gchar *record;
+
+    if (category != tracer_category)
+        return;
+
+    record = gst_debug_message_get (message);
+    if (g_str_has_prefix (record, "element-latency,"))
+        os_signpost_event_emit (signpost_log, OS_SIGNPOST_ID_EXCLUSIVE, "Element latency", "%{public}s", record);
+    else if (g_str_has_prefix (record, "latency,"))
+        os_signpost_event_emit (signpost_log, OS_SIGNPOST_ID_EXCLUSIVE, "Latency", "%{public}s", record);
+    else if (g_str_has_prefix (record, "proctime,"))
+        os_signpost_event_emit (signpost_log, OS_SIGNPOST_ID_EXCLUSIVE, "Processing time", "%{public}s", record);
+    else if (g_str_has_prefix (record, "queue-level,"))
+        os_signpost_event_emit (signpost_log, OS_SIGNPOST_ID_EXCLUSIVE, "Queue level", "%{public}s", record);
+    else
+        os_signpost_event_emit (signpost_log, OS_SIGNPOST_ID_EXCLUSIVE, "Tracer", "%{public}s", record);
+}
+
+/* GST_TRACERS is only read by gst_init(), before the static plugins providing the tracers are
+ * registered, so they are created by hand */
+static void start_stock_tracer (const gchar *name, const gchar *params)
+{
+    GstPluginFeature *feature = gst_registry_lookup_feature (gst_registry_get (), name);
+
+    if (!feature || !GST_IS_TRACER_FACTORY (feature)) {
+        NSLog (@"GStreamerProfiler: no %s tracer, is coretracers registered?", name);
+        g_clear_object (&feature);
+        return;
+    }
+
+    /* Tracers register their hooks when created and stay until the process exits */
+    g_object_new (gst_tracer_factory_get_tracer_type (GST_TRACER_FACTORY (feature)), "params", params, NULL);
+    gst_object_unref (feature);
+}
+
+@implementation GStreamerProfiler
+
++(void) start
+{
+    static dispatch_once_t once;
+
+    dispatch_once(&once, ^{
+        signpost_log = os_log_create ("org.gstreamer.swift", "Pipeline");
+
+        /* Tracer records are only logged at the TRACE level. Formatting them for stderr as
+         * well would show up in the timings. */
+        GST_DEBUG_CATEGORY_GET (tracer_category, "GST_TRACER");
+        gst_debug_set_threshold_for_name ("GST_TRACER", GST_LEVEL_TRACE);
+        gst_debug_remove_log_function (gst_debug_log_default);
+        gst_debug_add_log_function (tracer_log_cb, NULL, NULL);
+
+        for (int i = 0; i < G_N_ELEMENTS (stock_tracers); i++)
+            start_stock_tracer (stock_tracers[i][0], stock_tracers[i][1]);
+        g_object_new (signpost_tracer_get_type (), NULL);
+        NSLog (@"GStreamerProfiler: tracing to os_signpost");
+    });
+}
+
+@end
@@ -0,0 +1,36 @@
+#import <Foundation/Foundation.h>
+
+/* Bounded on-disk cache of HTTP media, for replays watched more than once.
+ * HLS/DASH segments and progressive downloads are stored under
+ * Library/Caches, keyed by their URL. Once the cache grows past sizeBudget,
+ * the least recently used entries are evicted. Manifests are never cached,
+ * so live playlists keep refreshing.
+ *
+ * GStreamer reaches the cache through an HTTP proxy on the loopback
+ * interface. A GStreamerBackend given the cache plays https URIs through
+ * proxyUriForUri:. The proxy paths mirror the original URL behind a random
+ * per-launch token, so relative segment URIs in playlists go through the
+ * proxy as well, and absolute ones are rewritten to proxy URIs as manifests
+ * pass through. The proxy only forwards to hosts handed out this way. Plain
+ * http URIs are played directly, since App Transport Security would block
+ * the proxy's own download. */
+@interface GStreamerSegmentCache : NSObject
+
++(GStreamerSegmentCache *) sharedCache;
+
+/* Maximum size of the cache on disk, in bytes, 512 MB by default. Lowering
+ * it evicts entries right away. */
+@property (nonatomic) NSUInteger sizeBudget;
+
+/* Size of the entries currently on disk, in bytes */
+@property (nonatomic, readonly) NSUInteger currentSize;
+
+/* The URI to hand to GStreamer for uri: the proxy URI for https URIs, uri
+ * itself for other schemes or while the proxy is not listening yet or could
+ * not be started */
+-(NSString *) proxyUriForUri:(NSString *)uri;
+
+/* Drop every cached entry */
+-(void) removeAllEntries;
+
+@end
@@ -0,0 +1,771 @@
+#import "GStreamerSegmentCache.h"
+#import <Network/Network.h>
+#import <CommonCrypto/CommonDigest.h>
+#import <sys/xattr.h>
+#import <sys/stat.h>
+#import <sys/time.h>
+#import <unistd.h>
+
+#define DEFAULT_SIZE_BUDGET (512 * 1024 * 1024)
+
+/* Longest request head accepted from GStreamer */
+#define MAX_REQUEST_HEAD 16384
+
+/* Chunk size when serving an entry from disk */
+#define FILE_CHUNK_SIZE (256 * 1024)
+
+/* Bytes of a download waiting for a slow client before the download is paused, and
+ * before it is resumed again */
+#define MAX_PENDING_BYTES (4 * 1024 * 1024)
+#define RESUME_PENDING_BYTES (1024 * 1024)
+
+/* Extended attribute keeping the Content-Type of an entry */
+#define CONTENT_TYPE_XATTR "org.gstreamer.content-type"
+
+/* One request the proxy could not answer from disk, from the upstream response to the
+ * last byte sent to GStreamer */
+@interface GStreamerCacheDownload : NSObject
+@property (nonatomic) nw_connection_t connection;
+@property (nonatomic) NSURLSessionDataTask *task;
+@property (nonatomic, copy) NSString *path;  /* Where the entry goes once complete, nil if not cached */
+@property (nonatomic, copy) NSString *partPath; /* Partial entry of this download only, renamed to path once complete */
+@property (nonatomic) NSFileHandle *file;    /* Partial entry being written */
+@property (nonatomic) NSMutableData *manifest; /* Manifest body, held back until complete to rewrite its URIs */
+@property (nonatomic, copy) NSString *contentType;
+@property (nonatomic) long long expectedLength;
+@property (nonatomic) long long writtenLength;
+@property (nonatomic) NSUInteger pendingBytes; /* Handed to the connection, not sent yet */
+@property (nonatomic) BOOL responded;        /* The response head was sent */
+@property (nonatomic) BOOL failed;           /* GStreamer went away */
+@end
+
+@implementation GStreamerCacheDownload
+@end
+
+@interface GStreamerSegmentCache() <NSURLSessionDataDelegate>
+-(void)start_proxy;
+-(void)accept_connection:(nw_connection_t) connection;
+-(void)receive_head:(nw_connection_t) connection data:(NSMutableData *) head;
+-(void)handle_request:(nw_connection_t) connection head:(NSString *) head;
+-(BOOL)serve_entry:(NSString *) path connection:(nw_connection_t) connection range:(NSString *) range headOnly:(BOOL) head_only;
+-(void)send_file:(NSFileHandle *) file offset:(long long) offset end:(long long) end connection:(nw_connection_t) connection;
+-(void)fetch:(NSString *) url path:(NSString *) path connection:(nw_connection_t) connection method:(NSString *) method range:(NSString *) range;
+-(void)finish_download:(GStreamerCacheDownload *) download error:(NSError *) error;
+-(void)store_download:(GStreamerCacheDownload *) download;
+-(void)evict;
+-(NSData *)rewrite_manifest:(NSData *) body;
+@end
+
+/* Name of the entry of a URL */
+static NSString *entry_name (NSString *url)
+{
+    const char *string = url.UTF8String;
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    NSMutableString *name = [NSMutableString stringWithCapacity:CC_SHA256_DIGEST_LENGTH * 2];
+
+    CC_SHA256 (string, (CC_LONG) strlen (string), digest);
+    for (int i = 0; i < CC_SHA256_DIGEST_LENGTH; i++)
+        [name appendFormat:@"%02x", digest[i]];
+    return name;
+}
+
+/* HLS playlists and DASH manifests of live streams change, they always come from the network */
+static BOOL is_manifest (NSString *url, NSString *content_type)
+{
+    NSString *extension = [NSURL URLWithString:url].path.pathExtension.lowercaseString;
+    NSString *type = content_type.lowercaseString;
+
+    return [extension isEqualToString:@"m3u8"] || [extension isEqualToString:@"mpd"] ||
+           [type containsString:@"mpegurl"] || [type containsString:@"dash+xml"];
+}
+
+/* Parse the first range of a Range header against an entry of the given size */
+static BOOL parse_range (NSString *range, long long size, long long *start, long long *end)
+{
+    NSScanner *scanner = [NSScanner scannerWithString:range];
+    long long first, last;
+
+    if (![scanner scanString:@"bytes=" intoString:NULL])
+        return NO;
+
+    /* The last bytes */
+    if ([scanner scanString:@"-" intoString:NULL]) {
+        if (![scanner scanLongLong:&last] || last <= 0 || size == 0)
+            return NO;
+        *start = MAX (0, size - last);
+        *end = size - 1;
+        return YES;
+    }
+
+    if (![scanner scanLongLong:&first] || ![scanner scanString:@"-" intoString:NULL])
+        return NO;
+    if (![scanner scanLongLong:&last])
+        last = size - 1;
+    if (first >= size || last < first)
+        return NO;
+    *start = first;
+    *end = MIN (last, size - 1);
+    return YES;
+}
+
+static const char *reason_phrase (NSInteger status)
+{
+    switch (status) {
+        case 200: return "OK";
+        case 206: return "Partial Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 416: return "Range Not Satisfiable";
+        case 502: return "Bad Gateway";
+        default: return "Status";
+    }
+}
+
+static NSData *response_head (NSInteger status, NSDictionary<NSString *, NSString *> *headers)
+{
+    NSMutableString *head = [NSMutableString stringWithFormat:@"HTTP/1.1 %ld %s\r\n", (long) status, reason_phrase (status)];
+
+    for (NSString *name in headers)
+        [head appendFormat:@"%@: %@\r\n", name, headers[name]];
+    [head appendString:@"Connection: close\r\n\r\n"];
+    return [head dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+/* Send data to GStreamer. The completion runs on the cache queue. */
+static void send_data (nw_connection_t connection, NSData *data, void (^completion) (BOOL sent))
+{
+    dispatch_data_t content = dispatch_data_create (data.bytes, data.length, NULL, ^{
+        (void) data;
+    });
+
+    nw_connection_send (connection, content, NW_CONNECTION_DEFAULT_MESSAGE_CONTEXT, false, ^(nw_error_t error) {
+        if (completion)
+            completion (error == NULL);
+    });
+}
+
+/* End the response and close the connection once everything queued has been sent */
+static void finish_response (nw_connection_t connection)
+{
+    nw_connection_send (connection, NULL, NW_CONNECTION_DEFAULT_MESSAGE_CONTEXT, true, ^(nw_error_t error) {
+        nw_connection_cancel (connection);
+    });
+}
+
+static void send_status (nw_connection_t connection, NSInteger status, NSDictionary<NSString *, NSString *> *headers)
+{
+    NSMutableDictionary *all_headers = [NSMutableDictionary dictionaryWithDictionary:headers ?: @{}];
+
+    all_headers[@"Content-Length"] = @"0";
+    send_data (connection, response_head (status, all_headers), nil);
+    finish_response (connection);
+}
+
+/* Absolute URIs in HLS playlists and DASH manifests, up to the quote or tag around them */
+static NSRegularExpression *absolute_uri_expression (void)
+{
+    static NSRegularExpression *expression;
+    static dispatch_once_t once;
+
+    dispatch_once (&once, ^{
+        expression = [NSRegularExpression regularExpressionWithPattern:@"https://[^\\s\"'<>]+"
+                                                               options:NSRegularExpressionCaseInsensitive error:NULL];
+    });
+    return expression;
+}
+
+@implementation GStreamerSegmentCache {
+    dispatch_queue_t queue;      /* Serialises the proxy, the downloads and the bookkeeping */
+    nw_listener_t listener;
+    uint16_t port;               /* Proxy port on 127.0.0.1, 0 until the listener is ready. Protected by @synchronized (self) */
+    NSString *token;             /* Random first path component of the proxy URIs, so other processes cannot use the proxy */
+    NSMutableSet<NSString *> *hosts; /* Hosts proxyUriForUri: was asked for, the only ones forwarded to. Protected by @synchronized (self) */
+    NSURLSession *session;
+    NSMutableDictionary<NSNumber *, GStreamerCacheDownload *> *downloads; /* By task identifier */
+    NSString *directory;
+    NSUInteger size_budget;
+    NSUInteger current_size;
+}
+
++(GStreamerSegmentCache *) sharedCache
+{
+    static GStreamerSegmentCache *cache;
+    static dispatch_once_t once;
+
+    dispatch_once(&once, ^{
+        cache = [[GStreamerSegmentCache alloc] init];
+    });
+    return cache;
+}
+
+-(id) init
+{
+    if (self = [super init])
+    {
+        NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+        NSOperationQueue *delegate_queue = [[NSOperationQueue alloc] init];
+
+        queue = dispatch_queue_create ("org.gstreamer.segment-cache", DISPATCH_QUEUE_SERIAL);
+        uint8_t random[16];
+        NSMutableString *hex = [NSMutableString stringWithCapacity:sizeof (random) * 2];
+
+        arc4random_buf (random, sizeof (random));
+        for (int i = 0; i < sizeof (random); i++)
+            [hex appendFormat:@"%02x", random[i]];
+        token = hex;
+        hosts = [[NSMutableSet alloc] init];
+        downloads = [[NSMutableDictionary alloc] init];
+        size_budget = DEFAULT_SIZE_BUDGET;
+        directory = [NSHomeDirectory() stringByAppendingPathComponent:@"Library/Caches/GStreamerSegments"];
+        [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:NULL];
+
+        /* We are the cache, NSURLCache would only keep a second copy */
+        configuration.URLCache = nil;
+        configuration.requestCachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
+        delegate_queue.underlyingQueue = queue;
+        delegate_queue.maxConcurrentOperationCount = 1;
+        session = [NSURLSession sessionWithConfiguration:configuration delegate:self delegateQueue:delegate_queue];
+
+        /* Pick up what previous runs left, minus the downloads they did not finish */
+        dispatch_async (queue, ^{
+            NSFileManager *manager = [NSFileManager defaultManager];
+            NSArray<NSURL *> *entries = [manager contentsOfDirectoryAtURL:[NSURL fileURLWithPath:self->directory]
+                                               includingPropertiesForKeys:@[NSURLFileSizeKey] options:0 error:NULL];
+
+            for (NSURL *entry in entries) {
+                NSNumber *size = nil;
+
+                if ([entry.pathExtension isEqualToString:@"part"]) {
+                    [manager removeItemAtURL:entry error:NULL];
+                    continue;
+                }
+                [entry getResourceValue:&size forKey:NSURLFileSizeKey error:NULL];
+                self->current_size += size.unsignedIntegerValue;
+            }
+            [self evict];
+        });
+
+        [self start_proxy];
+    }
+
+    return self;
+}
+
+-(NSUInteger) sizeBudget
+{
+    __block NSUInteger budget;
+
+    dispatch_sync (queue, ^{
+        budget = self->size_budget;
+    });
+    return budget;
+}
+
+-(void) setSizeBudget:(NSUInteger)budget
+{
+    dispatch_async (queue, ^{
+        self->size_budget = budget;
+        [self evict];
+    });
+}
+
+-(NSUInteger) currentSize
+{
+    __block NSUInteger size;
+
+    dispatch_sync (queue, ^{
+        size = self->current_size;
+    });
+    return size;
+}
+
+-(NSString *) proxyUriForUri:(NSString *)uri
+{
+    NSURLComponents *components = [NSURLComponents componentsWithString:uri];
+    NSString *authority;
+    uint16_t proxy_port;
+
+    if (!components.percentEncodedHost || ![components.scheme.lowercaseString isEqualToString:@"https"])
+        return uri;
+
+    authority = components.port ? [NSString stringWithFormat:@"%@:%@", components.percentEncodedHost, components.port] : components.percentEncodedHost;
+    authority = authority.lowercaseString;
+    @synchronized (self) {
+        proxy_port = port;
+        if (proxy_port)
+            [hosts addObject:authority];
+    }
+
+    /* Until the listener is ready, play straight from the network */
+    if (!proxy_port)
+        return uri;
+    return [NSString stringWithFormat:@"http://127.0.0.1:%u/%@/https/%@%@%@%@", proxy_port, token, authority,
+            components.percentEncodedPath.length ? components.percentEncodedPath : @"/",
+            components.percentEncodedQuery ? @"?" : @"", components.percentEncodedQuery ?: @""];
+}
+
+-(void) removeAllEntries
+{
+    dispatch_async (queue, ^{
+        NSFileManager *manager = [NSFileManager defaultManager];
+        NSArray<NSURL *> *entries = [manager contentsOfDirectoryAtURL:[NSURL fileURLWithPath:self->directory]
+                                           includingPropertiesForKeys:nil options:0 error:NULL];
+
+        /* Partial entries belong to running downloads, they are accounted for once complete */
+        for (NSURL *entry in entries) {
+            if (![entry.pathExtension isEqualToString:@"part"])
+                [manager removeItemAtURL:entry error:NULL];
+        }
+        self->current_size = 0;
+    });
+}
+
+/*
+ * Private methods
+ */
+
+/* Listen on an ephemeral port of the loopback interface. The listener gets ready in the
+ * background, proxyUriForUri: hands out the original URIs until then. */
+-(void) start_proxy
+{
+    nw_parameters_t parameters = nw_parameters_create_secure_tcp (NW_PARAMETERS_DISABLE_PROTOCOL, NW_PARAMETERS_DEFAULT_CONFIGURATION);
+    __weak GStreamerSegmentCache *weak_self = self;
+
+    nw_parameters_set_required_local_endpoint (parameters, nw_endpoint_create_host ("127.0.0.1", "0"));
+    listener = nw_listener_create (parameters);
+    if (!listener) {
+        NSLog (@"GStreamerSegmentCache: unable to create the proxy listener");
+        return;
+    }
+
+    nw_listener_set_queue (listener, queue);
+    nw_listener_set_new_connection_handler (listener, ^(nw_connection_t connection) {
+        [weak_self accept_connection:connection];
+    });
+    nw_listener_set_state_changed_handler (listener, ^(nw_listener_state_t state, nw_error_t error) {
+        GStreamerSegmentCache *cache = weak_self;
+
+        if (!cache)
+            return;
+        if (state == nw_listener_state_ready) {
+            @synchronized (cache) {
+                cache->port = nw_listener_get_port (cache->listener);
+            }
+        } else if (state == nw_listener_state_failed) {
+            NSLog (@"GStreamerSegmentCache: proxy listener failed, playing without the cache");
+            @synchronized (cache) {
+                cache->port = 0;
+            }
+        }
+    });
+    nw_listener_start (listener);
+}
+
+-(void) accept_connection:(nw_connection_t)connection
+{
+    nw_connection_set_queue (connection, queue);
+    nw_connection_start (connection);
+    [self receive_head:connection data:[NSMutableData data]];
+}
+
+/* Read until the end of the request head. GStreamer only sends GET and HEAD, without a body. */
+-(void) receive_head:(nw_connection_t)connection data:(NSMutableData *)head
+{
+    nw_connection_receive (connection, 1, MAX_REQUEST_HEAD, ^(dispatch_data_t content, nw_content_context_t context,
+                                                              bool is_complete, nw_error_t error) {
+        NSData *terminator = [NSData dataWithBytes:"\r\n\r\n" length:4];
+        NSRange end;
+
+        if (content) {
+            dispatch_data_apply (content, ^bool (dispatch_data_t region, size_t offset, const void *buffer, size_t size) {
+                [head appendBytes:buffer length:size];
+                return true;
+            });
+        }
+
+        end = [head rangeOfData:terminator options:0 range:NSMakeRange (0, head.length)];
+        if (end.location != NSNotFound) {
+            NSString *string = [[NSString alloc] initWithData:[head subdataWithRange:NSMakeRange (0, end.location)]
+                                                     encoding:NSISOLatin1StringEncoding];
+            [self handle_request:connection head:string];
+        } else if (error || is_complete || head.length > MAX_REQUEST_HEAD) {
+            nw_connection_cancel (connection);
+        } else {
+            [self receive_head:connection data:head];
+        }
+    });
+}
+
+/* Answer a request for /<token>/https/<host>/<path> from disk, or from the network */
+-(void) handle_request:(nw_connection_t)connection head:(NSString *)head
+{
+    NSArray<NSString *> *lines = [head componentsSeparatedByString:@"\r\n"];
+    NSArray<NSString *> *request_line = [lines.firstObject componentsSeparatedByString:@" "];
+    NSString *prefix = [NSString stringWithFormat:@"/%@/https/", token];
+    NSString *method, *target, *rest, *authority, *url, *path;
+    NSString *range = nil;
+    NSRange slash;
+    BOOL allowed;
+
+    if (request_line.count < 3) {
+        send_status (connection, 400, nil);
+        return;
+    }
+    method = request_line[0];
+    target = request_line[1];
+
+    for (NSUInteger i = 1; i < lines.count; i++) {
+        NSRange colon = [lines[i] rangeOfString:@":"];
+
+        if (colon.location != NSNotFound &&
+            [[lines[i] substringToIndex:colon.location] caseInsensitiveCompare:@"Range"] == NSOrderedSame) {
+            range = [[lines[i] substringFromIndex:colon.location + 1]
+                     stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+        }
+    }
+
+    if (![method isEqualToString:@"GET"] && ![method isEqualToString:@"HEAD"]) {
+        send_status (connection, 400, nil);
+        return;
+    }
+
+    /* Only our own URIs, to the hosts they were made for: the proxy is not open to whoever
+     * else can reach the loopback interface */
+    if (![target hasPrefix:prefix]) {
+        send_status (connection, 403, nil);
+        return;
+    }
+    rest = [target substringFromIndex:prefix.length];
+    slash = [rest rangeOfString:@"/"];
+    authority = slash.location == NSNotFound ? rest : [rest substringToIndex:slash.location];
+    @synchronized (self) {
+        allowed = [hosts containsObject:authority.lowercaseString];
+    }
+    if (!allowed) {
+        send_status (connection, 403, nil);
+        return;
+    }
+    url = [NSString stringWithFormat:@"https://%@", rest];
+    path = [directory stringByAppendingPathComponent:entry_name (url)];
+
+    if (![self serve_entry:path connection:connection range:range headOnly:[method isEqualToString:@"HEAD"]])
+        [self fetch:url path:path connection:connection method:method range:range];
+}
+
+/* Serve a cached entry, with byte ranges for seeking. Returns NO if there is no such entry. */
+-(BOOL) serve_entry:(NSString *)path connection:(nw_connection_t)connection range:(NSString *)range headOnly:(BOOL)head_only
+{
+    NSFileHandle *file = [NSFileHandle fileHandleForReadingAtPath:path];
+    NSMutableDictionary<NSString *, NSString *> *headers = [NSMutableDictionary dictionary];
+    char type[256];
+    ssize_t type_length;
+    struct stat info;
+    long long start, end;
+
+    if (!file || fstat (file.fileDescriptor, &info) != 0)
+        return NO;
+
+    /* Most recently used */
+    utimes (path.fileSystemRepresentation, NULL);
+
+    start = 0;
+    end = info.st_size - 1;
+    if (range && !parse_range (range, info.st_size, &start, &end)) {
+        [file closeFile];
+        send_status (connection, 416, @{ @"Content-Range": [NSString stringWithFormat:@"bytes */%lld", (long long) info.st_size] });
+        return YES;
+    }
+
+    headers[@"Accept-Ranges"] = @"bytes";
+    headers[@"Content-Length"] = [NSString stringWithFormat:@"%lld", end - start + 1];
+    if (range)
+        headers[@"Content-Range"] = [NSString stringWithFormat:@"bytes %lld-%lld/%lld", start, end, (long long) info.st_size];
+    type_length = fgetxattr (file.fileDescriptor, CONTENT_TYPE_XATTR, type, sizeof (type) - 1, 0, 0);
+    if (type_length > 0) {
+        type[type_length] = '\0';
+        headers[@"Content-Type"] = [NSString stringWithUTF8String:type];
+    }
+
+    send_data (connection, response_head (range ? 206 : 200, headers), nil);
+    if (head_only || end < start) {
+        [file closeFile];
+        finish_response (connection);
+    } else {
+        [self send_file:file offset:start end:end connection:connection];
+    }
+    return YES;
+}
+
+/* Send the next chunk of an entry once the previous one is out, so a slow reader only
+ * costs one chunk of memory */
+-(void) send_file:(NSFileHandle *)file offset:(long long)offset end:(long long)end connection:(nw_connection_t)connection
+{
+    NSData *chunk = nil;
+    BOOL last;
+
+    if ([file seekToOffset:offset error:NULL])
+        chunk = [file readDataUpToLength:(NSUInteger) MIN (FILE_CHUNK_SIZE, end - offset + 1) error:NULL];
+    if (chunk.length == 0) {
+        [file closeFile];
+        nw_connection_cancel (connection);
+        return;
+    }
+
+    last = offset + (long long) chunk.length > end;
+    send_data (connection, chunk, ^(BOOL sent) {
+        if (!sent || last) {
+            [file closeFile];
+            if (sent)
+                finish_response (connection);
+            else
+                nw_connection_cancel (connection);
+            return;
+        }
+        [self send_file:file offset:offset + chunk.length end:end connection:connection];
+    });
+}
+
+/* Forward a request to the network. Complete responses to a plain GET are stored as they
+ * stream through. */
+-(void) fetch:(NSString *)url path:(NSString *)path connection:(nw_connection_t)connection method:(NSString *)method range:(NSString *)range
+{
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:url]];
+    GStreamerCacheDownload *download = [[GStreamerCacheDownload alloc] init];
+
+    if (!request.URL) {
+        send_status (connection, 400, nil);
+        return;
+    }
+    request.HTTPMethod = method;
+    /* Entries are stored as sent, and Content-Length has to match what GStreamer receives */
+    [request setValue:@"identity" forHTTPHeaderField:@"Accept-Encoding"];
+    if (range)
+        [request setValue:range forHTTPHeaderField:@"Range"];
+
+    download.connection = connection;
+    if (!range && [method isEqualToString:@"GET"] && !is_manifest (url, nil))
+        download.path = path;
+    download.task = [session dataTaskWithRequest:request];
+    downloads[@(download.task.taskIdentifier)] = download;
+    [download.task resume];
+}
+
+/* Hand redirects to GStreamer through the proxy instead of following them, so the demuxers
+ * resolve relative URIs against the URI they were redirected to */
+-(void) URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task willPerformHTTPRedirection:(NSHTTPURLResponse *)response
+        newRequest:(NSURLRequest *)request completionHandler:(void (^)(NSURLRequest *))completion_handler
+{
+    completion_handler (nil);
+}
+
+-(void) URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)task didReceiveResponse:(NSURLResponse *)response
+ completionHandler:(void (^)(NSURLSessionResponseDisposition))completion_handler
+{
+    GStreamerCacheDownload *download = downloads[@(task.taskIdentifier)];
+    NSHTTPURLResponse *http = (NSHTTPURLResponse *) response;
+    NSMutableDictionary<NSString *, NSString *> *headers = [NSMutableDictionary dictionary];
+    NSString *location;
+
+    if (!download || ![response isKindOfClass:[NSHTTPURLResponse class]]) {
+        completion_handler (NSURLSessionResponseCancel);
+        return;
+    }
+
+    for (NSString *name in @[ @"Content-Type", @"Content-Range", @"Accept-Ranges", @"Last-Modified", @"ETag" ]) {
+        NSString *value = [http valueForHTTPHeaderField:name];
+        if (value)
+            headers[name] = value;
+    }
+    location = [http valueForHTTPHeaderField:@"Location"];
+    if (location) {
+        NSURL *target = [NSURL URLWithString:location relativeToURL:task.currentRequest.URL];
+        headers[@"Location"] = target ? [self proxyUriForUri:target.absoluteString] : location;
+    }
+    download.expectedLength = http.expectedContentLength;
+    download.contentType = headers[@"Content-Type"];
+
+    /* Manifests change length once their absolute URIs point to the proxy, the response
+     * ends when the connection closes */
+    if (is_manifest (task.originalRequest.URL.absoluteString, download.contentType) && http.statusCode == 200) {
+        download.manifest = [NSMutableData data];
+        [headers removeObjectForKey:@"Content-Range"];
+        [headers removeObjectForKey:@"Accept-Ranges"];
+    } else if (download.expectedLength >= 0 && ![http valueForHTTPHeaderField:@"Content-Encoding"]) {
+        headers[@"Content-Length"] = [NSString stringWithFormat:@"%lld", download.expectedLength];
+    }
+
+    if (http.statusCode != 200 || download.manifest)
+        download.path = nil;
+    if (download.path) {
+        /* Concurrent misses for the same URL each write their own file, the last one complete wins */
+        download.partPath = [NSString stringWithFormat:@"%@.%@.part", download.path, [NSUUID UUID].UUIDString];
+        if ([[NSFileManager defaultManager] createFileAtPath:download.partPath contents:nil attributes:nil])
+            download.file = [NSFileHandle fileHandleForWritingAtPath:download.partPath];
+        if (!download.file)
+            download.path = nil;
+    }
+
+    download.responded = YES;
+    send_data (download.connection, response_head (http.statusCode, headers), nil);
+    completion_handler (NSURLSessionResponseAllow);
+}
+
+-(void) URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)task didReceiveData:(NSData *)data
+{
+    GStreamerCacheDownload *download = downloads[@(task.taskIdentifier)];
+
+    if (!download || download.failed)
+        return;
+
+    if (download.file) {
+        if ([download.file writeData:data error:NULL]) {
+            download.writtenLength += data.length;
+        } else {
+            /* Out of space: keep streaming, without storing */
+            [download.file closeFile];
+            [[NSFileManager defaultManager] removeItemAtPath:download.partPath error:NULL];
+            download.file = nil;
+            download.path = nil;
+        }
+    }
+
+    if (download.manifest) {
+        [download.manifest appendData:data];
+        return;
+    }
+
+    download.pendingBytes += data.length;
+    if (download.pendingBytes > MAX_PENDING_BYTES)
+        [task suspend];
+    send_data (download.connection, data, ^(BOOL sent) {
+        download.pendingBytes -= data.length;
+        if (!sent) {
+            /* GStreamer closed the connection, to seek or because it is done with the stream */
+            if (!download.failed) {
+                download.failed = YES;
+                [download.task cancel];
+            }
+        } else if (download.task.state == NSURLSessionTaskStateSuspended && download.pendingBytes < RESUME_PENDING_BYTES) {
+            [download.task resume];
+        }
+    });
+}
+
+-(void) URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task didCompleteWithError:(NSError *)error
+{
+    GStreamerCacheDownload *download = downloads[@(task.taskIdentifier)];
+
+    if (!download)
+        return;
+    [downloads removeObjectForKey:@(task.taskIdentifier)];
+    [self finish_download:download error:error];
+}
+
+-(void) finish_download:(GStreamerCacheDownload *)download error:(NSError *)error
+{
+    BOOL complete = !error && !download.failed &&
+                    (download.expectedLength < 0 || download.writtenLength == download.expectedLength);
+
+    if (download.file) {
+        [download.file closeFile];
+        if (complete)
+            [self store_download:download];
+        else
+            [[NSFileManager defaultManager] removeItemAtPath:download.partPath error:NULL];
+    }
+
+    if (download.failed)
+        return;
+    if (download.manifest.length && !error)
+        send_data (download.connection, [self rewrite_manifest:download.manifest], nil);
+    if (!download.responded)
+        send_status (download.connection, 502, nil);
+    else if (error)
+        nw_connection_cancel (download.connection); /* GStreamer sees the body cut short and retries */
+    else
+        finish_response (download.connection);
+}
+
+/* Turn a complete download into an entry */
+-(void) store_download:(GStreamerCacheDownload *)download
+{
+    const char *part = download.partPath.fileSystemRepresentation;
+    struct stat previous;
+    BOOL replaced;
+
+    if (download.contentType) {
+        const char *type = download.contentType.UTF8String;
+        setxattr (part, CONTENT_TYPE_XATTR, type, strlen (type), 0, 0);
+    }
+
+    /* rename() replaces an entry another request for the same URL stored first, atomically,
+     * so readers of the entry see either version whole */
+    replaced = stat (download.path.fileSystemRepresentation, &previous) == 0;
+    if (rename (part, download.path.fileSystemRepresentation) != 0) {
+        unlink (part);
+        return;
+    }
+    if (replaced)
+        current_size -= MIN (current_size, (NSUInteger) previous.st_size);
+    current_size += (NSUInteger) download.writtenLength;
+    [self evict];
+}
+
+/* Point the absolute https URIs of a manifest to the proxy, so CDNs serving segments from
+ * absolute URLs get cached too. Relative URIs already resolve against the proxy URI. */
+-(NSData *) rewrite_manifest:(NSData *)body
+{
+    NSString *text = [[NSString alloc] initWithData:body encoding:NSUTF8StringEncoding];
+    NSMutableString *rewritten;
+    __block NSUInteger copied = 0;
+
+    if (!text)
+        return body;
+    rewritten = [NSMutableString stringWithCapacity:text.length];
+    [absolute_uri_expression () enumerateMatchesInString:text options:0 range:NSMakeRange (0, text.length)
+                                              usingBlock:^(NSTextCheckingResult *match, NSMatchingFlags flags, BOOL *stop) {
+        [rewritten appendString:[text substringWithRange:NSMakeRange (copied, match.range.location - copied)]];
+        [rewritten appendString:[self proxyUriForUri:[text substringWithRange:match.range]]];
+        copied = NSMaxRange (match.range);
+    }];
+    [rewritten appendString:[text substringFromIndex:copied]];
+    return [rewritten dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+/* Remove the least recently used entries until the cache fits its budget */
+-(void) evict
+{
+    NSFileManager *manager = [NSFileManager defaultManager];
+    NSArray<NSURL *> *entries;
+
+    if (current_size <= size_budget)
+        return;
+
+    entries = [manager contentsOfDirectoryAtURL:[NSURL fileURLWithPath:directory]
+                     includingPropertiesForKeys:@[NSURLContentModificationDateKey, NSURLFileSizeKey] options:0 error:NULL];
+    entries = [entries sortedArrayUsingComparator:^NSComparisonResult (NSURL *a, NSURL *b) {
+        NSDate *a_date = nil, *b_date = nil;
+
+        [a getResourceValue:&a_date forKey:NSURLContentModificationDateKey error:NULL];
+        [b getResourceValue:&b_date forKey:NSURLContentModificationDateKey error:NULL];
+        return [a_date ?: [NSDate distantPast] compare:b_date ?: [NSDate distantPast]];
+    }];
+
+    for (NSURL *entry in entries) {
+        NSNumber *size = nil;
+
+        if (current_size <= size_budget)
+            break;
+        if ([entry.pathExtension isEqualToString:@"part"])
+            continue;
+        [entry getResourceValue:&size forKey:NSURLFileSizeKey error:NULL];
+        if ([manager removeItemAtURL:entry error:NULL])
+            current_size -= MIN (current_size, size.unsignedIntegerValue);
+    }
+}
+
+@end
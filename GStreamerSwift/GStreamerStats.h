@@ -0,0 +1,72 @@
+#import <Foundation/Foundation.h>
+
+/* Snapshot of the playback metrics collected by GStreamerBackend. Rates are
+ * measured over the interval since the previous snapshot, counters are totals
+ * since the current stream started. */
+@interface GStreamerStats : NSObject
+
+/* Frames that reached the video sink per second */
+@property (nonatomic) double framesPerSecond;
+
+/* Total frames handed to the video sink */
+@property (nonatomic) NSUInteger framesRendered;
+
+/* Total frames the sink or decoder dropped, as reported by QoS messages */
+@property (nonatomic) NSUInteger framesDropped;
+
+/* QoS messages (late buffers) received during the last interval */
+@property (nonatomic) NSUInteger lateFrames;
+
+/* How late the last QoS-reported buffer was, in milliseconds */
+@property (nonatomic) double lastLatenessMs;
+
+/* rtpjitterbuffer counters, summed over all RTP streams */
+@property (nonatomic) NSUInteger packetsLost;
+@property (nonatomic) NSUInteger packetsLate;
+@property (nonatomic) NSUInteger packetsDuplicated;
+
+/* Average interarrival jitter reported by the jitterbuffers, in milliseconds */
+@property (nonatomic) double jitterMs;
+
+/* Minimum latency reported by the pipeline latency query, in milliseconds */
+@property (nonatomic) double pipelineLatencyMs;
+
+/* Bitrate received from the network source during the last interval */
+@property (nonatomic) double bitrateKbps;
+
+/* Statistics of the SRT connection, 0 for other sources. Round trip time,
+ * latency negotiated with the sender, and totals of lost, retransmitted and
+ * too late to be played packets. */
+@property (nonatomic) double srtRttMs;
+@property (nonatomic) NSUInteger srtLatencyMs;
+@property (nonatomic) NSUInteger srtPacketsLost;
+@property (nonatomic) NSUInteger srtPacketsRetransmitted;
+@property (nonatomic) NSUInteger srtPacketsDropped;
+
+/* HLS/DASH adaptive bitrate decisions: bitrate of the variant picked last
+ * (0 until the demuxer reports one), variant switches, and download rate
+ * and time of the last fragment */
+@property (nonatomic) double abrBitrateKbps;
+@property (nonatomic) NSUInteger abrSwitches;
+@property (nonatomic) double abrThroughputKbps;
+@property (nonatomic) double abrFragmentDownloadMs;
+
+/* Physical footprint of the whole process, the figure jetsam kills on, and
+ * how much more it may use before hitting the limit, in bytes */
+@property (nonatomic) uint64_t memoryFootprintBytes;
+@property (nonatomic) uint64_t availableMemoryBytes;
+
+/* Reconnects after network failures since setUri:, and the time from the
+ * last failure to the first frame after it, 0 until a reconnect succeeds */
+@property (nonatomic) NSUInteger reconnects;
+@property (nonatomic) double lastOutageMs;
+
+/* Network the stream is tuned for by setNetworkAware:, "unmetered",
+ * "cellular" or "constrained" (Low Data Mode), nil when not monitored */
+@property (nonatomic, copy) NSString *network;
+
+/* Index in the setQualityUris: list of the rendition being played, 0 when
+ * quality adaptation is not used */
+@property (nonatomic) NSUInteger qualityLevel;
+
+@end
@@ -0,0 +1,23 @@
+#import "GStreamerStats.h"
+
+@implementation GStreamerStats
+
+-(NSString *) description
+{
+    return [NSString stringWithFormat:@"%.1f fps, %lu rendered, %lu dropped, %lu late (%.1f ms), "
+            "%lu lost / %lu late / %lu duplicated packets, jitter %.1f ms, latency %.1f ms, %.0f kbps, quality %lu, "
+            "SRT rtt %.1f ms / latency %lu ms / %lu lost / %lu retransmitted / %lu dropped, "
+            "ABR %.0f kbps / %lu switches / %.0f kbps fragment download in %.1f ms, "
+            "memory %.1f MB (%.1f MB available), %lu reconnects (last outage %.0f ms), network %@",
+            self.framesPerSecond, (unsigned long) self.framesRendered, (unsigned long) self.framesDropped,
+            (unsigned long) self.lateFrames, self.lastLatenessMs, (unsigned long) self.packetsLost,
+            (unsigned long) self.packetsLate, (unsigned long) self.packetsDuplicated, self.jitterMs,
+            self.pipelineLatencyMs, self.bitrateKbps, (unsigned long) self.qualityLevel,
+            self.srtRttMs, (unsigned long) self.srtLatencyMs, (unsigned long) self.srtPacketsLost,
+            (unsigned long) self.srtPacketsRetransmitted, (unsigned long) self.srtPacketsDropped,
+            self.abrBitrateKbps, (unsigned long) self.abrSwitches, self.abrThroughputKbps, self.abrFragmentDownloadMs,
+            self.memoryFootprintBytes / 1048576.0, self.availableMemoryBytes / 1048576.0,
+            (unsigned long) self.reconnects, self.lastOutageMs, self.network ?: @"not monitored"];
+}
+
+@end
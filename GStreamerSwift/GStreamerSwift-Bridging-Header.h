@@ -7,5 +7,10 @@
 
 #import "gst_ios_init.h"
 #include "GStreamerBackend.h"
+#include "GStreamerBackendManager.h"
+#include "GStreamerMetalView.h"
+#include "GStreamerSegmentCache.h"
+#include "GStreamerProfiler.h"
+#include "GStreamerBenchmark.h"
 
 #endif
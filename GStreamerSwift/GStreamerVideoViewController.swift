@@ -11,8 +11,16 @@ import UIKit
 class GStreamerVideoViewController: UIViewController {
     
     private var backend: GStreamerBackend?
+    private var backendInitialized = false
     private var videoView = UIView()
+    private var backgroundTask: UIBackgroundTaskIdentifier = .invalid
     var uri: String?
+    var latencyProfile: GStreamerLatencyProfile = .low
+    var decodeMode: GStreamerDecodeMode = .hardware
+    /// Render with Metal instead of glimagesink, needed for stereo and 360 content
+    var renderWithMetal = false
+    var stereoLayout: GStreamerStereoLayout = .mono
+    var projection: GStreamerProjection = .flat
     
     deinit {
         let notificationCenter = NotificationCenter.default
@@ -38,21 +46,44 @@ class GStreamerVideoViewController: UIViewController {
         super.viewWillDisappear(animated)
         
         backend?.deinit()
+        backend = nil
+        backendInitialized = false
     }
     
     @objc func appMovedToBackground() {
         print("App moved to background!")
-        pause()
+        
+        // Keep the session alive, without decoding, for as long as iOS lets us run
+        // in the background. Only pause once that time is up.
+        backend?.setBackground(true)
+        if backgroundTask == .invalid {
+            backgroundTask = UIApplication.shared.beginBackgroundTask(withName: "GStreamerSession") { [weak self] in
+                self?.pause()
+                self?.endBackgroundTask()
+            }
+        }
     }
     
     @objc func appWillMoveToForeground() {
         print("App will move to Foreground!")
+        endBackgroundTask()
         
-        if let uri = uri {
+        // The pipeline survived in the background, resuming it is enough
+        if backend != nil {
+            backend?.setBackground(false)
+            play()
+        } else if let uri = uri {
             changeURI(uri)
         }
     }
     
+    private func endBackgroundTask() {
+        if backgroundTask != .invalid {
+            UIApplication.shared.endBackgroundTask(backgroundTask)
+            backgroundTask = .invalid
+        }
+    }
+    
     func play() {
         backend?.play()
     }
@@ -61,14 +92,35 @@ class GStreamerVideoViewController: UIViewController {
         backend?.pause()
     }
     
+    /// Start connecting to the next stream while the current one keeps playing,
+    /// so a following changeURI with the same URI switches instantly
+    func prerollURI(_ nextURI: String) {
+        backend?.prerollUri(nextURI)
+    }
+    
     func changeURI(_ newURI: String) {
         
         uri = newURI
+        
+        // Reuse the running pipeline and video view, only the URI changes
+        if let backend = backend, backendInitialized {
+            backend.setUri(newURI)
+            play()
+            return
+        }
+        
         backend?.deinit()
         
         // Replace view
         videoView.removeFromSuperview()
-        videoView = UIView()
+        if renderWithMetal {
+            let metalView = GStreamerMetalView()
+            metalView.stereoLayout = stereoLayout
+            metalView.projection = projection
+            videoView = metalView
+        } else {
+            videoView = UIView()
+        }
         view.addSubview(videoView)
         
         videoView.translatesAutoresizingMaskIntoConstraints = false
@@ -77,7 +129,10 @@ class GStreamerVideoViewController: UIViewController {
         videoView.leftAnchor.constraint(equalTo: view.leftAnchor, constant: 0).isActive = true
         videoView.rightAnchor.constraint(equalTo: view.rightAnchor, constant: 0).isActive = true
         
-        backend = GStreamerBackend(self, videoView: videoView)
+        // All video views share the manager's bus thread instead of one thread per stream
+        backend = GStreamerBackendManager.shared.backend(withDelegate: self, videoView: videoView,
+                                                         latencyProfile: latencyProfile, decodeMode: decodeMode)
+        backend?.setNetworkAware(true)
     }
 }
 
@@ -85,13 +140,35 @@ extension GStreamerVideoViewController: GStreamerBackendDelegate {
     func gstreamerInitialized() {
         print("gstreamerInitialized")
         
-        if let uri = uri {
-            backend?.setUri(uri)
-            play()
+        // Called on the backend's context, uri and the flag belong to the main thread
+        DispatchQueue.main.async { [weak self] in
+            guard let self = self else { return }
+            self.backendInitialized = true
+            
+            if let uri = self.uri {
+                self.backend?.setUri(uri)
+                self.play()
+            }
         }
     }
     
     func gstreamerSetUIMessage(_ message: String) {
         print("gstreamerSetUIMessage: \(message)")
     }
+    
+    func gstreamerStateChanged(_ state: GStreamerPlaybackState) {
+        print("gstreamerStateChanged: \(state.rawValue)")
+    }
+    
+    func gstreamerBufferingChanged(_ percent: Int) {
+        print("gstreamerBufferingChanged: \(percent)%")
+    }
+    
+    func gstreamerFailed(_ error: Error) {
+        print("gstreamerFailed: \(error.localizedDescription)")
+    }
+    
+    func gstreamerStatsUpdated(_ stats: GStreamerStats) {
+        print("gstreamerStatsUpdated: \(stats)")
+    }
 }
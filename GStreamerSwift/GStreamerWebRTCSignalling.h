@@ -0,0 +1,18 @@
+#import <Foundation/Foundation.h>
+
+/* Signalling channel used by GStreamerBackend for WebRTC sessions. GStreamer
+ * only produces and consumes the SDP and ICE messages, the application
+ * carries them to the remote peer over whatever signalling protocol it uses,
+ * and feeds the remote ones back with setRemoteDescription:type: and
+ * addRemoteIceCandidate:sdpMLineIndex:. The methods are called from a
+ * GStreamer thread. */
+@protocol GStreamerWebRTCSignalling <NSObject>
+
+/* Send our local session description to the remote peer. type is "offer"
+ * or "answer". */
+-(void) gstreamerSendSessionDescription:(NSString *)sdp type:(NSString *)type;
+
+/* Send one of our ICE candidates to the remote peer */
+-(void) gstreamerSendIceCandidate:(NSString *)candidate sdpMLineIndex:(NSUInteger)mline_index;
+
+@end
@@ -10,13 +10,28 @@ import UIKit
 class SceneDelegate: UIResponder, UIWindowSceneDelegate {
 
     var window: UIWindow?
+    var benchmark: GStreamerBenchmark?
 
 
     func scene(_ scene: UIScene, willConnectTo session: UISceneSession, options connectionOptions: UIScene.ConnectionOptions) {
         // Use this method to optionally configure and attach the UIWindow `window` to the provided UIWindowScene `scene`.
         // If using a storyboard, the `window` property will automatically be initialized and attached to the scene.
         // This delegate does not imply the connecting scene or session are new (see `application:configurationForConnectingSceneSession` instead).
-        guard let _ = (scene as? UIWindowScene) else { return }
+        guard let windowScene = (scene as? UIWindowScene) else { return }
+
+        // -GStreamerBenchmark YES runs the on-device benchmark instead of the app
+        if UserDefaults.standard.bool(forKey: "GStreamerBenchmark") {
+            let viewController = UIViewController()
+            viewController.view.backgroundColor = .black
+            window = UIWindow(windowScene: windowScene)
+            window?.rootViewController = viewController
+            window?.makeKeyAndVisible()
+
+            benchmark = GStreamerBenchmark(videoView: viewController.view)
+            benchmark?.run { results in
+                NSLog("GStreamerBenchmark: %ld runs finished", results.count)
+            }
+        }
     }
 
     func sceneDidDisconnect(_ scene: UIScene) {
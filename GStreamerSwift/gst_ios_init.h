@@ -29,11 +29,34 @@ G_PASTE(g_io_, G_PASTE(name, _load)) (NULL)
 #define GST_IOS_PLUGINS_NET_RESTRICTED
 #define GST_IOS_PLUGINS_GES
 
+/* Streaming viewer profile: registers the plugins needed to play RTSP, SRT, WebRTC
+ * and HLS/DASH streams with hardware decoding, and to record them for the DVR, even
+ * if their category is not enabled above. Comment out the categories above to keep
+ * only these in the binary. */
+#define GST_IOS_PLUGINS_STREAMING
+
+/* Only register the streaming plugins in gst_ios_init(). The remaining plugins of the
+ * enabled categories are registered by gst_ios_register_deferred_plugins(), which
+ * GStreamerBackend calls from a background queue once the first frame is shown. */
+#define GST_IOS_DEFER_PLUGINS
 
 //#define GST_IOS_GIO_MODULE_GNUTLS
 
 void gst_ios_init (void);
 
+/* Run gst_ios_init() on a background queue so it does not hold up app launch.
+ * The completion block, which can be NULL, is called on the main queue once
+ * GStreamer is ready. Only the first call starts the initialization. */
+void gst_ios_init_async (void (^completion) (void));
+
+/* Block until an initialization started by gst_ios_init_async() has finished.
+ * Returns immediately if it was never started. Do not call from the main queue. */
+void gst_ios_wait_for_init (void);
+
+/* Register the plugins left out by GST_IOS_DEFER_PLUGINS. Safe to call from any
+ * thread and more than once, only the first call does any work. */
+void gst_ios_register_deferred_plugins (void);
+
 G_END_DECLS
 
 #endif
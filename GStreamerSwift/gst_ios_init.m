@@ -2,20 +2,21 @@
 
 #include <gio/gio.h>
 #include <Foundation/Foundation.h>
+#import "GStreamerProfiler.h"
 
-#if defined(GST_IOS_PLUGIN_COREELEMENTS) || defined(GST_IOS_PLUGINS_CORE)
+#if defined(GST_IOS_PLUGIN_COREELEMENTS) || defined(GST_IOS_PLUGINS_CORE) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(coreelements);
 #endif
-#if defined(GST_IOS_PLUGIN_CORETRACERS) || defined(GST_IOS_PLUGINS_CORE)
+#if defined(GST_IOS_PLUGIN_CORETRACERS) || defined(GST_IOS_PLUGINS_CORE) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(coretracers);
 #endif
 #if defined(GST_IOS_PLUGIN_ADDER) || defined(GST_IOS_PLUGINS_CORE)
 GST_PLUGIN_STATIC_DECLARE(adder);
 #endif
-#if defined(GST_IOS_PLUGIN_APP) || defined(GST_IOS_PLUGINS_CORE)
+#if defined(GST_IOS_PLUGIN_APP) || defined(GST_IOS_PLUGINS_CORE) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(app);
 #endif
-#if defined(GST_IOS_PLUGIN_AUDIOCONVERT) || defined(GST_IOS_PLUGINS_CORE)
+#if defined(GST_IOS_PLUGIN_AUDIOCONVERT) || defined(GST_IOS_PLUGINS_CORE) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(audioconvert);
 #endif
 #if defined(GST_IOS_PLUGIN_AUDIOMIXER) || defined(GST_IOS_PLUGINS_CORE)
@@ -24,13 +25,13 @@ GST_PLUGIN_STATIC_DECLARE(audiomixer);
 #if defined(GST_IOS_PLUGIN_AUDIORATE) || defined(GST_IOS_PLUGINS_CORE)
 GST_PLUGIN_STATIC_DECLARE(audiorate);
 #endif
-#if defined(GST_IOS_PLUGIN_AUDIORESAMPLE) || defined(GST_IOS_PLUGINS_CORE)
+#if defined(GST_IOS_PLUGIN_AUDIORESAMPLE) || defined(GST_IOS_PLUGINS_CORE) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(audioresample);
 #endif
 #if defined(GST_IOS_PLUGIN_AUDIOTESTSRC) || defined(GST_IOS_PLUGINS_CORE)
 GST_PLUGIN_STATIC_DECLARE(audiotestsrc);
 #endif
-#if defined(GST_IOS_PLUGIN_COMPOSITOR) || defined(GST_IOS_PLUGINS_CORE)
+#if defined(GST_IOS_PLUGIN_COMPOSITOR) || defined(GST_IOS_PLUGINS_CORE) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(compositor);
 #endif
 #if defined(GST_IOS_PLUGIN_GIO) || defined(GST_IOS_PLUGINS_CORE)
@@ -45,22 +46,22 @@ GST_PLUGIN_STATIC_DECLARE(pango);
 #if defined(GST_IOS_PLUGIN_RAWPARSE) || defined(GST_IOS_PLUGINS_CORE)
 GST_PLUGIN_STATIC_DECLARE(rawparse);
 #endif
-#if defined(GST_IOS_PLUGIN_TYPEFINDFUNCTIONS) || defined(GST_IOS_PLUGINS_CORE)
+#if defined(GST_IOS_PLUGIN_TYPEFINDFUNCTIONS) || defined(GST_IOS_PLUGINS_CORE) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(typefindfunctions);
 #endif
-#if defined(GST_IOS_PLUGIN_VIDEOCONVERTSCALE) || defined(GST_IOS_PLUGINS_CORE)
+#if defined(GST_IOS_PLUGIN_VIDEOCONVERTSCALE) || defined(GST_IOS_PLUGINS_CORE) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(videoconvertscale);
 #endif
 #if defined(GST_IOS_PLUGIN_VIDEORATE) || defined(GST_IOS_PLUGINS_CORE)
 GST_PLUGIN_STATIC_DECLARE(videorate);
 #endif
-#if defined(GST_IOS_PLUGIN_VIDEOTESTSRC) || defined(GST_IOS_PLUGINS_CORE)
+#if defined(GST_IOS_PLUGIN_VIDEOTESTSRC) || defined(GST_IOS_PLUGINS_CORE) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(videotestsrc);
 #endif
-#if defined(GST_IOS_PLUGIN_VOLUME) || defined(GST_IOS_PLUGINS_CORE)
+#if defined(GST_IOS_PLUGIN_VOLUME) || defined(GST_IOS_PLUGINS_CORE) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(volume);
 #endif
-#if defined(GST_IOS_PLUGIN_AUTODETECT) || defined(GST_IOS_PLUGINS_CORE)
+#if defined(GST_IOS_PLUGIN_AUTODETECT) || defined(GST_IOS_PLUGINS_CORE) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(autodetect);
 #endif
 #if defined(GST_IOS_PLUGIN_VIDEOFILTER) || defined(GST_IOS_PLUGINS_CORE)
@@ -78,7 +79,7 @@ GST_PLUGIN_STATIC_DECLARE(theora);
 #if defined(GST_IOS_PLUGIN_VORBIS) || defined(GST_IOS_PLUGINS_CODECS)
 GST_PLUGIN_STATIC_DECLARE(vorbis);
 #endif
-#if defined(GST_IOS_PLUGIN_OPUS) || defined(GST_IOS_PLUGINS_CODECS)
+#if defined(GST_IOS_PLUGIN_OPUS) || defined(GST_IOS_PLUGINS_CODECS) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(opus);
 #endif
 #if defined(GST_IOS_PLUGIN_ALAW) || defined(GST_IOS_PLUGINS_CODECS)
@@ -87,7 +88,7 @@ GST_PLUGIN_STATIC_DECLARE(alaw);
 #if defined(GST_IOS_PLUGIN_APETAG) || defined(GST_IOS_PLUGINS_CODECS)
 GST_PLUGIN_STATIC_DECLARE(apetag);
 #endif
-#if defined(GST_IOS_PLUGIN_AUDIOPARSERS) || defined(GST_IOS_PLUGINS_CODECS)
+#if defined(GST_IOS_PLUGIN_AUDIOPARSERS) || defined(GST_IOS_PLUGINS_CODECS) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(audioparsers);
 #endif
 #if defined(GST_IOS_PLUGIN_AUPARSE) || defined(GST_IOS_PLUGINS_CODECS)
@@ -114,7 +115,7 @@ GST_PLUGIN_STATIC_DECLARE(icydemux);
 #if defined(GST_IOS_PLUGIN_ID3DEMUX) || defined(GST_IOS_PLUGINS_CODECS)
 GST_PLUGIN_STATIC_DECLARE(id3demux);
 #endif
-#if defined(GST_IOS_PLUGIN_ISOMP4) || defined(GST_IOS_PLUGINS_CODECS)
+#if defined(GST_IOS_PLUGIN_ISOMP4) || defined(GST_IOS_PLUGINS_CODECS) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(isomp4);
 #endif
 #if defined(GST_IOS_PLUGIN_JPEG) || defined(GST_IOS_PLUGINS_CODECS)
@@ -165,7 +166,7 @@ GST_PLUGIN_STATIC_DECLARE(adpcmdec);
 #if defined(GST_IOS_PLUGIN_ADPCMENC) || defined(GST_IOS_PLUGINS_CODECS)
 GST_PLUGIN_STATIC_DECLARE(adpcmenc);
 #endif
-#if defined(GST_IOS_PLUGIN_DASH) || defined(GST_IOS_PLUGINS_CODECS)
+#if defined(GST_IOS_PLUGIN_DASH) || defined(GST_IOS_PLUGINS_CODECS) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(dash);
 #endif
 #if defined(GST_IOS_PLUGIN_DVBSUBOVERLAY) || defined(GST_IOS_PLUGINS_CODECS)
@@ -174,9 +175,12 @@ GST_PLUGIN_STATIC_DECLARE(dvbsuboverlay);
 #if defined(GST_IOS_PLUGIN_DVDSPU) || defined(GST_IOS_PLUGINS_CODECS)
 GST_PLUGIN_STATIC_DECLARE(dvdspu);
 #endif
-#if defined(GST_IOS_PLUGIN_HLS) || defined(GST_IOS_PLUGINS_CODECS)
+#if defined(GST_IOS_PLUGIN_HLS) || defined(GST_IOS_PLUGINS_CODECS) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(hls);
 #endif
+#if defined(GST_IOS_PLUGIN_ADAPTIVEDEMUX2) || defined(GST_IOS_PLUGINS_CODECS) || defined(GST_IOS_PLUGINS_STREAMING)
+GST_PLUGIN_STATIC_DECLARE(adaptivedemux2);
+#endif
 #if defined(GST_IOS_PLUGIN_ID3TAG) || defined(GST_IOS_PLUGINS_CODECS)
 GST_PLUGIN_STATIC_DECLARE(id3tag);
 #endif
@@ -210,7 +214,7 @@ GST_PLUGIN_STATIC_DECLARE(smoothstreaming);
 #if defined(GST_IOS_PLUGIN_SUBENC) || defined(GST_IOS_PLUGINS_CODECS)
 GST_PLUGIN_STATIC_DECLARE(subenc);
 #endif
-#if defined(GST_IOS_PLUGIN_VIDEOPARSERSBAD) || defined(GST_IOS_PLUGINS_CODECS)
+#if defined(GST_IOS_PLUGIN_VIDEOPARSERSBAD) || defined(GST_IOS_PLUGINS_CODECS) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(videoparsersbad);
 #endif
 #if defined(GST_IOS_PLUGIN_Y4MDEC) || defined(GST_IOS_PLUGINS_CODECS)
@@ -237,49 +241,49 @@ GST_PLUGIN_STATIC_DECLARE(sbc);
 #if defined(GST_IOS_PLUGIN_ENCODING) || defined(GST_IOS_PLUGINS_ENCODING)
 GST_PLUGIN_STATIC_DECLARE(encoding);
 #endif
-#if defined(GST_IOS_PLUGIN_TCP) || defined(GST_IOS_PLUGINS_NET)
+#if defined(GST_IOS_PLUGIN_TCP) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(tcp);
 #endif
-#if defined(GST_IOS_PLUGIN_RTSP) || defined(GST_IOS_PLUGINS_NET)
+#if defined(GST_IOS_PLUGIN_RTSP) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(rtsp);
 #endif
-#if defined(GST_IOS_PLUGIN_RTP) || defined(GST_IOS_PLUGINS_NET)
+#if defined(GST_IOS_PLUGIN_RTP) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(rtp);
 #endif
-#if defined(GST_IOS_PLUGIN_RTPMANAGER) || defined(GST_IOS_PLUGINS_NET)
+#if defined(GST_IOS_PLUGIN_RTPMANAGER) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(rtpmanager);
 #endif
-#if defined(GST_IOS_PLUGIN_SOUP) || defined(GST_IOS_PLUGINS_NET)
+#if defined(GST_IOS_PLUGIN_SOUP) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(soup);
 #endif
-#if defined(GST_IOS_PLUGIN_UDP) || defined(GST_IOS_PLUGINS_NET)
+#if defined(GST_IOS_PLUGIN_UDP) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(udp);
 #endif
-#if defined(GST_IOS_PLUGIN_DTLS) || defined(GST_IOS_PLUGINS_NET)
+#if defined(GST_IOS_PLUGIN_DTLS) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(dtls);
 #endif
-#if defined(GST_IOS_PLUGIN_SDPELEM) || defined(GST_IOS_PLUGINS_NET)
+#if defined(GST_IOS_PLUGIN_SDPELEM) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(sdpelem);
 #endif
-#if defined(GST_IOS_PLUGIN_SRTP) || defined(GST_IOS_PLUGINS_NET)
+#if defined(GST_IOS_PLUGIN_SRTP) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(srtp);
 #endif
-#if defined(GST_IOS_PLUGIN_WEBRTC) || defined(GST_IOS_PLUGINS_NET)
+#if defined(GST_IOS_PLUGIN_WEBRTC) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(webrtc);
 #endif
-#if defined(GST_IOS_PLUGIN_SRT) || defined(GST_IOS_PLUGINS_NET)
+#if defined(GST_IOS_PLUGIN_SRT) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(srt);
 #endif
-#if defined(GST_IOS_PLUGIN_SCTP) || defined(GST_IOS_PLUGINS_NET)
+#if defined(GST_IOS_PLUGIN_SCTP) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(sctp);
 #endif
-#if defined(GST_IOS_PLUGIN_NICE) || defined(GST_IOS_PLUGINS_NET)
+#if defined(GST_IOS_PLUGIN_NICE) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(nice);
 #endif
 #if defined(GST_IOS_PLUGIN_RTSPCLIENTSINK) || defined(GST_IOS_PLUGINS_NET)
 GST_PLUGIN_STATIC_DECLARE(rtspclientsink);
 #endif
-#if defined(GST_IOS_PLUGIN_PLAYBACK) || defined(GST_IOS_PLUGINS_PLAYBACK)
+#if defined(GST_IOS_PLUGIN_PLAYBACK) || defined(GST_IOS_PLUGINS_PLAYBACK) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(playback);
 #endif
 #if defined(GST_IOS_PLUGIN_GOOM) || defined(GST_IOS_PLUGINS_VIS)
@@ -291,13 +295,13 @@ GST_PLUGIN_STATIC_DECLARE(goom2k1);
 #if defined(GST_IOS_PLUGIN_AUDIOVISUALIZERS) || defined(GST_IOS_PLUGINS_VIS)
 GST_PLUGIN_STATIC_DECLARE(audiovisualizers);
 #endif
-#if defined(GST_IOS_PLUGIN_OPENGL) || defined(GST_IOS_PLUGINS_SYS)
+#if defined(GST_IOS_PLUGIN_OPENGL) || defined(GST_IOS_PLUGINS_SYS) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(opengl);
 #endif
-#if defined(GST_IOS_PLUGIN_OSXAUDIO) || defined(GST_IOS_PLUGINS_SYS)
+#if defined(GST_IOS_PLUGIN_OSXAUDIO) || defined(GST_IOS_PLUGINS_SYS) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(osxaudio);
 #endif
-#if defined(GST_IOS_PLUGIN_APPLEMEDIA) || defined(GST_IOS_PLUGINS_SYS)
+#if defined(GST_IOS_PLUGIN_APPLEMEDIA) || defined(GST_IOS_PLUGINS_SYS) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(applemedia);
 #endif
 #if defined(GST_IOS_PLUGIN_SHM) || defined(GST_IOS_PLUGINS_SYS)
@@ -345,7 +349,7 @@ GST_PLUGIN_STATIC_DECLARE(interleave);
 #if defined(GST_IOS_PLUGIN_LEVEL) || defined(GST_IOS_PLUGINS_EFFECTS)
 GST_PLUGIN_STATIC_DECLARE(level);
 #endif
-#if defined(GST_IOS_PLUGIN_MULTIFILE) || defined(GST_IOS_PLUGINS_EFFECTS)
+#if defined(GST_IOS_PLUGIN_MULTIFILE) || defined(GST_IOS_PLUGINS_EFFECTS) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(multifile);
 #endif
 #if defined(GST_IOS_PLUGIN_REPLAYGAIN) || defined(GST_IOS_PLUGINS_EFFECTS)
@@ -441,7 +445,7 @@ GST_PLUGIN_STATIC_DECLARE(soundtouch);
 #if defined(GST_IOS_PLUGIN_VIDEOFILTERSBAD) || defined(GST_IOS_PLUGINS_EFFECTS)
 GST_PLUGIN_STATIC_DECLARE(videofiltersbad);
 #endif
-#if defined(GST_IOS_PLUGIN_WEBRTCDSP) || defined(GST_IOS_PLUGINS_EFFECTS)
+#if defined(GST_IOS_PLUGIN_WEBRTCDSP) || defined(GST_IOS_PLUGINS_EFFECTS) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(webrtcdsp);
 #endif
 #if defined(GST_IOS_PLUGIN_LADSPA) || defined(GST_IOS_PLUGINS_EFFECTS)
@@ -468,7 +472,7 @@ GST_PLUGIN_STATIC_DECLARE(mpegpsdemux);
 #if defined(GST_IOS_PLUGIN_MPEGPSMUX) || defined(GST_IOS_PLUGINS_CODECS_RESTRICTED)
 GST_PLUGIN_STATIC_DECLARE(mpegpsmux);
 #endif
-#if defined(GST_IOS_PLUGIN_MPEGTSDEMUX) || defined(GST_IOS_PLUGINS_CODECS_RESTRICTED)
+#if defined(GST_IOS_PLUGIN_MPEGTSDEMUX) || defined(GST_IOS_PLUGINS_CODECS_RESTRICTED) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(mpegtsdemux);
 #endif
 #if defined(GST_IOS_PLUGIN_MPEGTSMUX) || defined(GST_IOS_PLUGINS_CODECS_RESTRICTED)
@@ -504,7 +508,7 @@ GST_PLUGIN_STATIC_DECLARE(realmedia);
 #if defined(GST_IOS_PLUGIN_X264) || defined(GST_IOS_PLUGINS_CODECS_RESTRICTED)
 GST_PLUGIN_STATIC_DECLARE(x264);
 #endif
-#if defined(GST_IOS_PLUGIN_LIBAV) || defined(GST_IOS_PLUGINS_CODECS_RESTRICTED)
+#if defined(GST_IOS_PLUGIN_LIBAV) || defined(GST_IOS_PLUGINS_CODECS_RESTRICTED) || defined(GST_IOS_PLUGINS_STREAMING)
 GST_PLUGIN_STATIC_DECLARE(libav);
 #endif
 #if defined(GST_IOS_PLUGIN_RTMP) || defined(GST_IOS_PLUGINS_NET_RESTRICTED)
@@ -518,6 +522,39 @@ GST_PLUGIN_STATIC_DECLARE(nle);
   GST_G_IO_MODULE_DECLARE(openssl);
 #endif
 
+static dispatch_group_t
+gst_ios_init_group (void)
+{
+  static dispatch_group_t group;
+  static dispatch_once_t once;
+
+  dispatch_once (&once, ^{
+    group = dispatch_group_create ();
+  });
+  return group;
+}
+
+void
+gst_ios_init_async (void (^completion) (void))
+{
+  static dispatch_once_t once;
+  dispatch_group_t group = gst_ios_init_group ();
+
+  dispatch_once (&once, ^{
+    dispatch_group_async (group, dispatch_get_global_queue (QOS_CLASS_USER_INITIATED, 0), ^{
+      gst_ios_init ();
+    });
+  });
+  if (completion)
+    dispatch_group_notify (group, dispatch_get_main_queue (), completion);
+}
+
+void
+gst_ios_wait_for_init (void)
+{
+  dispatch_group_wait (gst_ios_init_group (), DISPATCH_TIME_FOREVER);
+}
+
 void
 gst_ios_init (void)
 {
@@ -566,36 +603,177 @@ gst_ios_init (void)
 
   gst_init (NULL, NULL);
 
-  #if defined(GST_IOS_PLUGIN_COREELEMENTS) || defined(GST_IOS_PLUGINS_CORE)
+  /* Plugins needed to play RTSP, SRT, WebRTC and HLS/DASH streams are registered
+   * right away, everything else in gst_ios_register_deferred_plugins() */
+#if defined(GST_IOS_PLUGIN_COREELEMENTS) || defined(GST_IOS_PLUGINS_CORE) || defined(GST_IOS_PLUGINS_STREAMING)
     GST_PLUGIN_STATIC_REGISTER(coreelements);
 #endif
-#if defined(GST_IOS_PLUGIN_CORETRACERS) || defined(GST_IOS_PLUGINS_CORE)
+#if defined(GST_IOS_PLUGIN_CORETRACERS) || defined(GST_IOS_PLUGINS_CORE) || defined(GST_IOS_PLUGINS_STREAMING)
     GST_PLUGIN_STATIC_REGISTER(coretracers);
 #endif
-#if defined(GST_IOS_PLUGIN_ADDER) || defined(GST_IOS_PLUGINS_CORE)
-    GST_PLUGIN_STATIC_REGISTER(adder);
-#endif
-#if defined(GST_IOS_PLUGIN_APP) || defined(GST_IOS_PLUGINS_CORE)
+#if defined(GST_IOS_PLUGIN_APP) || defined(GST_IOS_PLUGINS_CORE) || defined(GST_IOS_PLUGINS_STREAMING)
     GST_PLUGIN_STATIC_REGISTER(app);
 #endif
-#if defined(GST_IOS_PLUGIN_AUDIOCONVERT) || defined(GST_IOS_PLUGINS_CORE)
+#if defined(GST_IOS_PLUGIN_AUDIOCONVERT) || defined(GST_IOS_PLUGINS_CORE) || defined(GST_IOS_PLUGINS_STREAMING)
     GST_PLUGIN_STATIC_REGISTER(audioconvert);
 #endif
+#if defined(GST_IOS_PLUGIN_AUDIORESAMPLE) || defined(GST_IOS_PLUGINS_CORE) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(audioresample);
+#endif
+#if defined(GST_IOS_PLUGIN_COMPOSITOR) || defined(GST_IOS_PLUGINS_CORE) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(compositor);
+#endif
+#if defined(GST_IOS_PLUGIN_TYPEFINDFUNCTIONS) || defined(GST_IOS_PLUGINS_CORE) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(typefindfunctions);
+#endif
+#if defined(GST_IOS_PLUGIN_VIDEOCONVERTSCALE) || defined(GST_IOS_PLUGINS_CORE) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(videoconvertscale);
+#endif
+#if defined(GST_IOS_PLUGIN_VIDEOTESTSRC) || defined(GST_IOS_PLUGINS_CORE) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(videotestsrc);
+#endif
+#if defined(GST_IOS_PLUGIN_VOLUME) || defined(GST_IOS_PLUGINS_CORE) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(volume);
+#endif
+#if defined(GST_IOS_PLUGIN_AUTODETECT) || defined(GST_IOS_PLUGINS_CORE) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(autodetect);
+#endif
+#if defined(GST_IOS_PLUGIN_OPUS) || defined(GST_IOS_PLUGINS_CODECS) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(opus);
+#endif
+#if defined(GST_IOS_PLUGIN_AUDIOPARSERS) || defined(GST_IOS_PLUGINS_CODECS) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(audioparsers);
+#endif
+#if defined(GST_IOS_PLUGIN_ISOMP4) || defined(GST_IOS_PLUGINS_CODECS) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(isomp4);
+#endif
+#if defined(GST_IOS_PLUGIN_DASH) || defined(GST_IOS_PLUGINS_CODECS) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(dash);
+#endif
+#if defined(GST_IOS_PLUGIN_HLS) || defined(GST_IOS_PLUGINS_CODECS) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(hls);
+#endif
+#if defined(GST_IOS_PLUGIN_ADAPTIVEDEMUX2) || defined(GST_IOS_PLUGINS_CODECS) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(adaptivedemux2);
+#endif
+#if defined(GST_IOS_PLUGIN_VIDEOPARSERSBAD) || defined(GST_IOS_PLUGINS_CODECS) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(videoparsersbad);
+#endif
+#if defined(GST_IOS_PLUGIN_TCP) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(tcp);
+#endif
+#if defined(GST_IOS_PLUGIN_RTSP) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(rtsp);
+#endif
+#if defined(GST_IOS_PLUGIN_RTP) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(rtp);
+#endif
+#if defined(GST_IOS_PLUGIN_RTPMANAGER) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(rtpmanager);
+#endif
+#if defined(GST_IOS_PLUGIN_SOUP) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(soup);
+#endif
+#if defined(GST_IOS_PLUGIN_UDP) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(udp);
+#endif
+#if defined(GST_IOS_PLUGIN_DTLS) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(dtls);
+#endif
+#if defined(GST_IOS_PLUGIN_SDPELEM) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(sdpelem);
+#endif
+#if defined(GST_IOS_PLUGIN_SRTP) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(srtp);
+#endif
+#if defined(GST_IOS_PLUGIN_WEBRTC) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(webrtc);
+#endif
+#if defined(GST_IOS_PLUGIN_SRT) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(srt);
+#endif
+#if defined(GST_IOS_PLUGIN_SCTP) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(sctp);
+#endif
+#if defined(GST_IOS_PLUGIN_NICE) || defined(GST_IOS_PLUGINS_NET) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(nice);
+#endif
+#if defined(GST_IOS_PLUGIN_PLAYBACK) || defined(GST_IOS_PLUGINS_PLAYBACK) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(playback);
+#endif
+#if defined(GST_IOS_PLUGIN_OPENGL) || defined(GST_IOS_PLUGINS_SYS) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(opengl);
+#endif
+#if defined(GST_IOS_PLUGIN_OSXAUDIO) || defined(GST_IOS_PLUGINS_SYS) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(osxaudio);
+#endif
+#if defined(GST_IOS_PLUGIN_WEBRTCDSP) || defined(GST_IOS_PLUGINS_EFFECTS) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(webrtcdsp);
+#endif
+#if defined(GST_IOS_PLUGIN_MULTIFILE) || defined(GST_IOS_PLUGINS_EFFECTS) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(multifile);
+#endif
+#if defined(GST_IOS_PLUGIN_APPLEMEDIA) || defined(GST_IOS_PLUGINS_SYS) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(applemedia);
+#endif
+#if defined(GST_IOS_PLUGIN_MPEGTSDEMUX) || defined(GST_IOS_PLUGINS_CODECS_RESTRICTED) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(mpegtsdemux);
+#endif
+#if defined(GST_IOS_PLUGIN_LIBAV) || defined(GST_IOS_PLUGINS_CODECS_RESTRICTED) || defined(GST_IOS_PLUGINS_STREAMING)
+    GST_PLUGIN_STATIC_REGISTER(libav);
+#endif
+
+  /* Lower the rank of filesrc so iosavassetsrc is
+   * tried first in gst_element_make_from_uri() for file:// */
+  reg = gst_registry_get();
+  plugin = gst_registry_lookup_feature(reg, "filesrc");
+  if (plugin)
+    gst_plugin_feature_set_rank(plugin, GST_RANK_SECONDARY);
+
+  /* Prefer the adaptivedemux2 demuxers, which support LL-HLS partial
+   * segments and download ahead on their own thread, over hls and dash */
+  plugin = gst_registry_lookup_feature(reg, "hlsdemux2");
+  if (plugin) {
+    gst_plugin_feature_set_rank(plugin, GST_RANK_PRIMARY + 1);
+    gst_object_unref(plugin);
+  }
+  plugin = gst_registry_lookup_feature(reg, "dashdemux2");
+  if (plugin) {
+    gst_plugin_feature_set_rank(plugin, GST_RANK_PRIMARY + 1);
+    gst_object_unref(plugin);
+  }
+
+  /* Launch with -GStreamerProfiling YES to trace the pipelines into Instruments */
+  if ([[NSUserDefaults standardUserDefaults] boolForKey:@"GStreamerProfiling"])
+    [GStreamerProfiler start];
+
+#if !defined(GST_IOS_DEFER_PLUGINS)
+  gst_ios_register_deferred_plugins ();
+#endif
+}
+
+void
+gst_ios_register_deferred_plugins (void)
+{
+  static gsize registered = 0;
+  GstPluginFeature *plugin;
+  GstRegistry *reg;
+
+  if (!g_once_init_enter (&registered))
+    return;
+
+#if defined(GST_IOS_PLUGIN_ADDER) || defined(GST_IOS_PLUGINS_CORE)
+    GST_PLUGIN_STATIC_REGISTER(adder);
+#endif
 #if defined(GST_IOS_PLUGIN_AUDIOMIXER) || defined(GST_IOS_PLUGINS_CORE)
     GST_PLUGIN_STATIC_REGISTER(audiomixer);
 #endif
 #if defined(GST_IOS_PLUGIN_AUDIORATE) || defined(GST_IOS_PLUGINS_CORE)
     GST_PLUGIN_STATIC_REGISTER(audiorate);
 #endif
-#if defined(GST_IOS_PLUGIN_AUDIORESAMPLE) || defined(GST_IOS_PLUGINS_CORE)
-    GST_PLUGIN_STATIC_REGISTER(audioresample);
-#endif
 #if defined(GST_IOS_PLUGIN_AUDIOTESTSRC) || defined(GST_IOS_PLUGINS_CORE)
     GST_PLUGIN_STATIC_REGISTER(audiotestsrc);
 #endif
-#if defined(GST_IOS_PLUGIN_COMPOSITOR) || defined(GST_IOS_PLUGINS_CORE)
-    GST_PLUGIN_STATIC_REGISTER(compositor);
-#endif
 #if defined(GST_IOS_PLUGIN_GIO) || defined(GST_IOS_PLUGINS_CORE)
     GST_PLUGIN_STATIC_REGISTER(gio);
 #endif
@@ -608,24 +786,9 @@ gst_ios_init (void)
 #if defined(GST_IOS_PLUGIN_RAWPARSE) || defined(GST_IOS_PLUGINS_CORE)
     GST_PLUGIN_STATIC_REGISTER(rawparse);
 #endif
-#if defined(GST_IOS_PLUGIN_TYPEFINDFUNCTIONS) || defined(GST_IOS_PLUGINS_CORE)
-    GST_PLUGIN_STATIC_REGISTER(typefindfunctions);
-#endif
-#if defined(GST_IOS_PLUGIN_VIDEOCONVERTSCALE) || defined(GST_IOS_PLUGINS_CORE)
-    GST_PLUGIN_STATIC_REGISTER(videoconvertscale);
-#endif
 #if defined(GST_IOS_PLUGIN_VIDEORATE) || defined(GST_IOS_PLUGINS_CORE)
     GST_PLUGIN_STATIC_REGISTER(videorate);
 #endif
-#if defined(GST_IOS_PLUGIN_VIDEOTESTSRC) || defined(GST_IOS_PLUGINS_CORE)
-    GST_PLUGIN_STATIC_REGISTER(videotestsrc);
-#endif
-#if defined(GST_IOS_PLUGIN_VOLUME) || defined(GST_IOS_PLUGINS_CORE)
-    GST_PLUGIN_STATIC_REGISTER(volume);
-#endif
-#if defined(GST_IOS_PLUGIN_AUTODETECT) || defined(GST_IOS_PLUGINS_CORE)
-    GST_PLUGIN_STATIC_REGISTER(autodetect);
-#endif
 #if defined(GST_IOS_PLUGIN_VIDEOFILTER) || defined(GST_IOS_PLUGINS_CORE)
     GST_PLUGIN_STATIC_REGISTER(videofilter);
 #endif
@@ -641,18 +804,12 @@ gst_ios_init (void)
 #if defined(GST_IOS_PLUGIN_VORBIS) || defined(GST_IOS_PLUGINS_CODECS)
     GST_PLUGIN_STATIC_REGISTER(vorbis);
 #endif
-#if defined(GST_IOS_PLUGIN_OPUS) || defined(GST_IOS_PLUGINS_CODECS)
-    GST_PLUGIN_STATIC_REGISTER(opus);
-#endif
 #if defined(GST_IOS_PLUGIN_ALAW) || defined(GST_IOS_PLUGINS_CODECS)
     GST_PLUGIN_STATIC_REGISTER(alaw);
 #endif
 #if defined(GST_IOS_PLUGIN_APETAG) || defined(GST_IOS_PLUGINS_CODECS)
     GST_PLUGIN_STATIC_REGISTER(apetag);
 #endif
-#if defined(GST_IOS_PLUGIN_AUDIOPARSERS) || defined(GST_IOS_PLUGINS_CODECS)
-    GST_PLUGIN_STATIC_REGISTER(audioparsers);
-#endif
 #if defined(GST_IOS_PLUGIN_AUPARSE) || defined(GST_IOS_PLUGINS_CODECS)
     GST_PLUGIN_STATIC_REGISTER(auparse);
 #endif
@@ -677,9 +834,6 @@ gst_ios_init (void)
 #if defined(GST_IOS_PLUGIN_ID3DEMUX) || defined(GST_IOS_PLUGINS_CODECS)
     GST_PLUGIN_STATIC_REGISTER(id3demux);
 #endif
-#if defined(GST_IOS_PLUGIN_ISOMP4) || defined(GST_IOS_PLUGINS_CODECS)
-    GST_PLUGIN_STATIC_REGISTER(isomp4);
-#endif
 #if defined(GST_IOS_PLUGIN_JPEG) || defined(GST_IOS_PLUGINS_CODECS)
     GST_PLUGIN_STATIC_REGISTER(jpeg);
 #endif
@@ -728,18 +882,12 @@ gst_ios_init (void)
 #if defined(GST_IOS_PLUGIN_ADPCMENC) || defined(GST_IOS_PLUGINS_CODECS)
     GST_PLUGIN_STATIC_REGISTER(adpcmenc);
 #endif
-#if defined(GST_IOS_PLUGIN_DASH) || defined(GST_IOS_PLUGINS_CODECS)
-    GST_PLUGIN_STATIC_REGISTER(dash);
-#endif
 #if defined(GST_IOS_PLUGIN_DVBSUBOVERLAY) || defined(GST_IOS_PLUGINS_CODECS)
     GST_PLUGIN_STATIC_REGISTER(dvbsuboverlay);
 #endif
 #if defined(GST_IOS_PLUGIN_DVDSPU) || defined(GST_IOS_PLUGINS_CODECS)
     GST_PLUGIN_STATIC_REGISTER(dvdspu);
 #endif
-#if defined(GST_IOS_PLUGIN_HLS) || defined(GST_IOS_PLUGINS_CODECS)
-    GST_PLUGIN_STATIC_REGISTER(hls);
-#endif
 #if defined(GST_IOS_PLUGIN_ID3TAG) || defined(GST_IOS_PLUGINS_CODECS)
     GST_PLUGIN_STATIC_REGISTER(id3tag);
 #endif
@@ -773,9 +921,6 @@ gst_ios_init (void)
 #if defined(GST_IOS_PLUGIN_SUBENC) || defined(GST_IOS_PLUGINS_CODECS)
     GST_PLUGIN_STATIC_REGISTER(subenc);
 #endif
-#if defined(GST_IOS_PLUGIN_VIDEOPARSERSBAD) || defined(GST_IOS_PLUGINS_CODECS)
-    GST_PLUGIN_STATIC_REGISTER(videoparsersbad);
-#endif
 #if defined(GST_IOS_PLUGIN_Y4MDEC) || defined(GST_IOS_PLUGINS_CODECS)
     GST_PLUGIN_STATIC_REGISTER(y4mdec);
 #endif
@@ -800,51 +945,9 @@ gst_ios_init (void)
 #if defined(GST_IOS_PLUGIN_ENCODING) || defined(GST_IOS_PLUGINS_ENCODING)
     GST_PLUGIN_STATIC_REGISTER(encoding);
 #endif
-#if defined(GST_IOS_PLUGIN_TCP) || defined(GST_IOS_PLUGINS_NET)
-    GST_PLUGIN_STATIC_REGISTER(tcp);
-#endif
-#if defined(GST_IOS_PLUGIN_RTSP) || defined(GST_IOS_PLUGINS_NET)
-    GST_PLUGIN_STATIC_REGISTER(rtsp);
-#endif
-#if defined(GST_IOS_PLUGIN_RTP) || defined(GST_IOS_PLUGINS_NET)
-    GST_PLUGIN_STATIC_REGISTER(rtp);
-#endif
-#if defined(GST_IOS_PLUGIN_RTPMANAGER) || defined(GST_IOS_PLUGINS_NET)
-    GST_PLUGIN_STATIC_REGISTER(rtpmanager);
-#endif
-#if defined(GST_IOS_PLUGIN_SOUP) || defined(GST_IOS_PLUGINS_NET)
-    GST_PLUGIN_STATIC_REGISTER(soup);
-#endif
-#if defined(GST_IOS_PLUGIN_UDP) || defined(GST_IOS_PLUGINS_NET)
-    GST_PLUGIN_STATIC_REGISTER(udp);
-#endif
-#if defined(GST_IOS_PLUGIN_DTLS) || defined(GST_IOS_PLUGINS_NET)
-    GST_PLUGIN_STATIC_REGISTER(dtls);
-#endif
-#if defined(GST_IOS_PLUGIN_SDPELEM) || defined(GST_IOS_PLUGINS_NET)
-    GST_PLUGIN_STATIC_REGISTER(sdpelem);
-#endif
-#if defined(GST_IOS_PLUGIN_SRTP) || defined(GST_IOS_PLUGINS_NET)
-    GST_PLUGIN_STATIC_REGISTER(srtp);
-#endif
-#if defined(GST_IOS_PLUGIN_WEBRTC) || defined(GST_IOS_PLUGINS_NET)
-    GST_PLUGIN_STATIC_REGISTER(webrtc);
-#endif
-#if defined(GST_IOS_PLUGIN_SRT) || defined(GST_IOS_PLUGINS_NET)
-    GST_PLUGIN_STATIC_REGISTER(srt);
-#endif
-#if defined(GST_IOS_PLUGIN_SCTP) || defined(GST_IOS_PLUGINS_NET)
-    GST_PLUGIN_STATIC_REGISTER(sctp);
-#endif
-#if defined(GST_IOS_PLUGIN_NICE) || defined(GST_IOS_PLUGINS_NET)
-    GST_PLUGIN_STATIC_REGISTER(nice);
-#endif
 #if defined(GST_IOS_PLUGIN_RTSPCLIENTSINK) || defined(GST_IOS_PLUGINS_NET)
     GST_PLUGIN_STATIC_REGISTER(rtspclientsink);
 #endif
-#if defined(GST_IOS_PLUGIN_PLAYBACK) || defined(GST_IOS_PLUGINS_PLAYBACK)
-    GST_PLUGIN_STATIC_REGISTER(playback);
-#endif
 #if defined(GST_IOS_PLUGIN_GOOM) || defined(GST_IOS_PLUGINS_VIS)
     GST_PLUGIN_STATIC_REGISTER(goom);
 #endif
@@ -854,15 +957,6 @@ gst_ios_init (void)
 #if defined(GST_IOS_PLUGIN_AUDIOVISUALIZERS) || defined(GST_IOS_PLUGINS_VIS)
     GST_PLUGIN_STATIC_REGISTER(audiovisualizers);
 #endif
-#if defined(GST_IOS_PLUGIN_OPENGL) || defined(GST_IOS_PLUGINS_SYS)
-    GST_PLUGIN_STATIC_REGISTER(opengl);
-#endif
-#if defined(GST_IOS_PLUGIN_OSXAUDIO) || defined(GST_IOS_PLUGINS_SYS)
-    GST_PLUGIN_STATIC_REGISTER(osxaudio);
-#endif
-#if defined(GST_IOS_PLUGIN_APPLEMEDIA) || defined(GST_IOS_PLUGINS_SYS)
-    GST_PLUGIN_STATIC_REGISTER(applemedia);
-#endif
 #if defined(GST_IOS_PLUGIN_SHM) || defined(GST_IOS_PLUGINS_SYS)
     GST_PLUGIN_STATIC_REGISTER(shm);
 #endif
@@ -908,9 +1002,6 @@ gst_ios_init (void)
 #if defined(GST_IOS_PLUGIN_LEVEL) || defined(GST_IOS_PLUGINS_EFFECTS)
     GST_PLUGIN_STATIC_REGISTER(level);
 #endif
-#if defined(GST_IOS_PLUGIN_MULTIFILE) || defined(GST_IOS_PLUGINS_EFFECTS)
-    GST_PLUGIN_STATIC_REGISTER(multifile);
-#endif
 #if defined(GST_IOS_PLUGIN_REPLAYGAIN) || defined(GST_IOS_PLUGINS_EFFECTS)
     GST_PLUGIN_STATIC_REGISTER(replaygain);
 #endif
@@ -1004,9 +1095,6 @@ gst_ios_init (void)
 #if defined(GST_IOS_PLUGIN_VIDEOFILTERSBAD) || defined(GST_IOS_PLUGINS_EFFECTS)
     GST_PLUGIN_STATIC_REGISTER(videofiltersbad);
 #endif
-#if defined(GST_IOS_PLUGIN_WEBRTCDSP) || defined(GST_IOS_PLUGINS_EFFECTS)
-    GST_PLUGIN_STATIC_REGISTER(webrtcdsp);
-#endif
 #if defined(GST_IOS_PLUGIN_LADSPA) || defined(GST_IOS_PLUGINS_EFFECTS)
     GST_PLUGIN_STATIC_REGISTER(ladspa);
 #endif
@@ -1031,9 +1119,6 @@ gst_ios_init (void)
 #if defined(GST_IOS_PLUGIN_MPEGPSMUX) || defined(GST_IOS_PLUGINS_CODECS_RESTRICTED)
     GST_PLUGIN_STATIC_REGISTER(mpegpsmux);
 #endif
-#if defined(GST_IOS_PLUGIN_MPEGTSDEMUX) || defined(GST_IOS_PLUGINS_CODECS_RESTRICTED)
-    GST_PLUGIN_STATIC_REGISTER(mpegtsdemux);
-#endif
 #if defined(GST_IOS_PLUGIN_MPEGTSMUX) || defined(GST_IOS_PLUGINS_CODECS_RESTRICTED)
     GST_PLUGIN_STATIC_REGISTER(mpegtsmux);
 #endif
@@ -1067,9 +1152,6 @@ gst_ios_init (void)
 #if defined(GST_IOS_PLUGIN_X264) || defined(GST_IOS_PLUGINS_CODECS_RESTRICTED)
     GST_PLUGIN_STATIC_REGISTER(x264);
 #endif
-#if defined(GST_IOS_PLUGIN_LIBAV) || defined(GST_IOS_PLUGINS_CODECS_RESTRICTED)
-    GST_PLUGIN_STATIC_REGISTER(libav);
-#endif
 #if defined(GST_IOS_PLUGIN_RTMP) || defined(GST_IOS_PLUGINS_NET_RESTRICTED)
     GST_PLUGIN_STATIC_REGISTER(rtmp);
 #endif
@@ -1077,13 +1159,11 @@ gst_ios_init (void)
     GST_PLUGIN_STATIC_REGISTER(nle);
 #endif
 
-  /* Lower the ranks of filesrc and giosrc so iosavassetsrc is
-   * tried first in gst_element_make_from_uri() for file:// */
+  /* Same for giosrc, which comes with the gio plugin */
   reg = gst_registry_get();
-  plugin = gst_registry_lookup_feature(reg, "filesrc");
-  if (plugin)
-    gst_plugin_feature_set_rank(plugin, GST_RANK_SECONDARY);
   plugin = gst_registry_lookup_feature(reg, "giosrc");
   if (plugin)
     gst_plugin_feature_set_rank(plugin, GST_RANK_SECONDARY-1);
+
+  g_once_init_leave (&registered, 1);
 }